@@ -12,21 +12,36 @@
  *
  * As mentioned in testsuite.h, add the __VERBOSE__ flag when compiling this test suite to use verbose printing by default.
  *
- * See testsuite.h for more information. There are no comments here. This is the wild west of this test suite.
+ * See catom.h for more information.
  */
 
 #include "catom.h"
 
 #include "libs/arrcmp.h"
-#include "libs/genarrays.h"
+#include "libs/counters.h"
+#include "libs/environment.h"
+#include "libs/fpcmp.h"
 #include "libs/hashing.h"
+#include "libs/instrument.h"
 #include "libs/memalloc.h"
+#include "libs/output.h"
+#include "libs/parallel.h"
+#include "libs/property.h"
+#include "libs/report.h"
+#include "libs/selection.h"
 #include "libs/salloc.h"
+#include "libs/snapshot.h"
+#include "libs/stats.h"
+#include "libs/testcache.h"
+#include "libs/threads.h"
+#include "libs/timer.h"
 #include "libs/tprinterr.h"
 #include "libs/vbprint.h"
 #include "libs/whatos.h"
+#include "libs/workpool.h"
 
 #include <inttypes.h>
+#include <math.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <string.h>
@@ -34,402 +49,2563 @@
 
 #define SEP "--------------------------------------------------------------------------------"
 
-// Helper for assertion failure message printer.
-static char __last_assert_caller_file[MAX_STR_LEN] = { '\0' };
-static char __last_assert_caller[MAX_STR_LEN] = { '\0' };
-static char __last_assert_used[MAX_STR_LEN] = { '\0' };
-static int __last_line_of_assert_caller = 0;
+// Upper bound on the number of iterations a scaled benchmark is calibrated to.
+#define MAX_BENCHMARK_ITERATIONS ((size_t) 1000000000u)
 
+// Seconds a timed test thread is given to stop after it has been cancelled.
+#define TIMED_THREAD_GRACE 0.1
+
+// Helper for assertion failure message printer. Each thread keeps its own, so that a timed test running on a thread
+// does not change where the test waiting for it reports its failures.
+static const AssertLocation NO_LOCATION = { "", "", "", 0 };
+THREAD_LOCAL const AssertLocation *__last_location = &NO_LOCATION;
+
+// Internal assertion function. Only the thread running a test can jump back out of it when an assertion fails, so
+// failures on any other thread are counted in thread_failures and fail the test once it finishes.
+static THREAD_LOCAL jmp_buf env;
+static THREAD_LOCAL bool in_test = false;
+static THREAD_LOCAL bool in_timed = false;
+static THREAD_LOCAL jmp_buf *property_case = NULL;
+static size_t failures = 0;
+static size_t thread_failures = 0;
+static bool in_benchmark = false;
+static bool quiet_output = false;
+static bool isolate_tests = true;
+static TimedTestMode timed_test_mode = TIMED_TEST_FORK;
+static TimerSource benchmark_timer = TIMER_WALL;
+static uint64_t benchmark_target_ns = 10000000u;
+static size_t benchmark_threads = 0;
+static bool pin_benchmark_threads = false;
+static bool count_benchmark_events = false;
+static bool control_environment = false;
+static int benchmark_core = -1;
+static BenchmarkEnvironment benchmark_environment;
+
+// Machine-readable reports and baseline comparison.
+static const Reporter *test_reporter = NULL;
+static const Reporter *benchmark_reporter = NULL;
+static char test_report_path[MAX_STR_LEN] = { '\0' };
+static char benchmark_report_path[MAX_STR_LEN] = { '\0' };
+static BaselineEntry *baseline = NULL;
+static size_t baseline_size = 0;
+static double regression_threshold = 0.0;
+static size_t regressions = 0;
+
+// Test selection. Unset settings fall back to environment variables when tests are run.
+static const char *test_filter = NULL;
+static size_t shard_index = 0;
+static size_t shard_count = 0;
+static const char *shard_durations_path = NULL;
+static const char *test_cache_path = NULL;
+static const char *test_cache_key = NULL;
+static size_t max_failures = 0;
+static uint64_t property_seed = 0;
+static bool log_generated = false;
+static const char *trace_path = NULL;
+static bool trace_started = false;
+
+void reset_failures(void) {
+    failures = 0u;
+}
+
+static void fail_test(void) {
+    ATOMIC_ADD(&failures, 1);
+    longjmp(env, 1);
+}
+
+// This is defined separately at the bottom of the file.
+static inline void fail_timed_test(void);
+
+// Print the failed assertion and fail the test. Kept out of line so that passing assertions stay a compare and branch.
+static __attribute__((noinline, cold)) void assertion_failed(void) {
+    // Cases of property tests fail many times over while they are found and shrunk, so they fail without a word.
+    if (property_case) {
+        longjmp(*property_case, 1);
+    }
+
+    const char *file = __last_location->file;
+    const char *caller = *__last_location->function == '_' ? __last_location->function + 2 : __last_location->function;
+    const char *assert = *__last_location->assert == '_' ? __last_location->assert + 2 : __last_location->assert;
+
+    if (Message.width == NARROW) {
+        output_printf("\n[%s] Assertion Failed. %s failed in %s at line %d:\n%s", file, assert, caller, __last_location->line, Message.__msg.__message);
+    } else {
+        output_printf("\n[%s] Assertion Failed. %s failed in %s at line %d:\n%ls", file, assert, caller, __last_location->line, Message.__msg.__wessage);
+    }
+
+    // A failing timed test kills its process, so the failure has to be written out now.
+    output_flush();
+
+    if (in_benchmark) {
+        output_printf("\n*** [WARNING] Do not use asserts inside a benchmark or timed test! ***\n");
+    } else if (in_timed) {
+        fail_timed_test();
+    } else if (in_test) {
+        fail_test();
+    } else {
+        ATOMIC_ADD(&thread_failures, 1);
+    }
+}
+
+// Check the condition of an assertion. The message is only formatted, and its arguments only evaluated, in verbose
+// mode or when the assertion fails.
+#define __test_assert__(cond, ...) {\
+    const bool __holds = (cond);\
+    if (__builtin_expect(!__holds || __use_verbose_printing, 0)) {\
+        vbprintf(stderr, __VA_ARGS__);\
+        if (!__holds) {\
+            assertion_failed();\
+        }\
+    }\
+}
+
+// The same as __test_assert__, for wide messages.
+#define __test_wide_assert__(cond, ...) {\
+    const bool __holds = (cond);\
+    if (__builtin_expect(!__holds || __use_verbose_printing, 0)) {\
+        vbwprintf(stderr, __VA_ARGS__);\
+        if (!__holds) {\
+            assertion_failed();\
+        }\
+    }\
+}
+
+// Describe where two arrays first differ for an assertion message, or give an empty string if they do not.
+static const char *describe_mismatch(const bool found, const size_t argn, const size_t where[]) {
+    static THREAD_LOCAL char description[MAX_STR_LEN];
+
+    if (!found) {
+        return "";
+    }
+
+    size_t length = (size_t) snprintf(description, MAX_STR_LEN, "First mismatch at item ");
+    for (size_t i = 0; i < argn && length < MAX_STR_LEN; ++i) {
+        length += (size_t) snprintf(description + length, MAX_STR_LEN - length, "[%zu]", where[i]);
+    }
+
+    if (length < MAX_STR_LEN) {
+        snprintf(description + length, MAX_STR_LEN - length, ".\n");
+    }
+
+    return description;
+}
+
+// Describe the errors between two floating point arrays for an assertion message.
+static const char *describe_errors(const ErrorStats *stats, const size_t n, const double worst1, const double worst2) {
+    static THREAD_LOCAL char description[MAX_STR_LEN];
+
+    snprintf(description, MAX_STR_LEN, "Worst item [%zu]: %.9g vs %.9g, error %g. %zu of %zu items exceed the tolerance, mean error %g.\n",
+        stats->worst, worst1, worst2, stats->max_error, stats->exceeding, n, stats->mean_error
+    );
+
+    return description;
+}
+
+static const char *describe_float_errors(const float *arr1, const float *arr2, const size_t n, const ToleranceMode mode, const double tolerance) {
+    ErrorStats stats;
+    float_array_error_stats(arr1, arr2, n, mode, tolerance, &stats);
+
+    return n > 0 ? describe_errors(&stats, n, arr1[stats.worst], arr2[stats.worst]) : "";
+}
+
+static const char *describe_double_errors(const double *arr1, const double *arr2, const size_t n, const ToleranceMode mode, const double tolerance) {
+    ErrorStats stats;
+    double_array_error_stats(arr1, arr2, n, mode, tolerance, &stats);
+
+    return n > 0 ? describe_errors(&stats, n, arr1[stats.worst], arr2[stats.worst]) : "";
+}
+
+// Explain the outcome of a snapshot check for an assertion message.
+static const char *describe_snapshot(const SnapshotCheck *check) {
+    static THREAD_LOCAL char description[MAX_STR_LEN];
+
+    switch (check->result) {
+        case SNAPSHOT_CONFIRMED:
+            snprintf(description, MAX_STR_LEN, "The snapshot at \"%s\" was confirmed by its hash.\n", check->path);
+            break;
+        case SNAPSHOT_MATCHED:
+            snprintf(description, MAX_STR_LEN, "The snapshot at \"%s\" matches.\n", check->path);
+            break;
+        case SNAPSHOT_UPDATED:
+            snprintf(description, MAX_STR_LEN, "The snapshot at \"%s\" was updated.\n", check->path);
+            break;
+        case SNAPSHOT_MISSING:
+            snprintf(description, MAX_STR_LEN, "There is no snapshot at \"%s\". Use use_snapshot_update to record it.\n", check->path);
+            break;
+        case SNAPSHOT_MISMATCHED:
+            snprintf(description, MAX_STR_LEN, "The snapshot at \"%s\" has %zu bytes. The first mismatch is at byte %zu.\n", check->path, check->expected_size, check->mismatch);
+            break;
+        default:
+            snprintf(description, MAX_STR_LEN, "The snapshot at \"%s\" could not be read or written.\n", check->path);
+            break;
+    }
+
+    return description;
+}
+
+// Test runner utilities.
+// Where a worker process keeps the location of the last assertion, so that its parent can tell where it crashed.
+const AssertLocation **__shared_location = NULL;
+
+void __set_last_location(const AssertLocation *location) {
+    __last_location = location;
+
+    if (__shared_location) {
+        ATOMIC_STORE(__shared_location, location);
+    }
+}
+
+void use_verbose_print(const bool should_use) {
+    set_verbose_print_status(should_use);
+}
+
+void use_quiet_output(const bool should_quiet) {
+    quiet_output = should_quiet;
+}
+
+void use_test_isolation(const bool should_isolate) {
+    isolate_tests = should_isolate;
+}
+
+void use_timed_test_mode(const TimedTestMode mode) {
+    timed_test_mode = mode;
+}
+
+void use_arena_allocator(const bool should_use) {
+    set_arena_status(should_use);
+}
+
+void use_snapshot_directory(const char *path) {
+    set_snapshot_directory(path);
+}
+
+void use_snapshot_update(const bool should_update) {
+    set_snapshot_update(should_update);
+}
+
+void use_benchmark_target_time(const double seconds) {
+    benchmark_target_ns = seconds > 0.0 ? (uint64_t) (seconds * 1e9) : 1u;
+}
+
+void use_benchmark_threads(const size_t threads) {
+    benchmark_threads = threads;
+}
+
+void use_benchmark_pinning(const bool should_pin) {
+    pin_benchmark_threads = should_pin;
+}
+
+void use_benchmark_counters(const bool should_count) {
+    count_benchmark_events = should_count;
+}
+
+void use_trace_report(const char *path) {
+    trace_path = path;
+}
+
+void use_benchmark_environment(const bool should_control, const int core) {
+    control_environment = should_control;
+    benchmark_core = core;
+}
+
+void use_benchmark_timer(const TimerSource source) {
+    benchmark_timer = source == TIMER_DEFAULT ? TIMER_WALL : source;
+}
+
+void use_test_report(const ReportFormat format, const char *path) {
+    test_reporter = path ? get_reporter(format) : NULL;
+    strncpy(test_report_path, path ? path : "", MAX_STR_LEN - 1);
+}
+
+void use_benchmark_report(const ReportFormat format, const char *path) {
+    benchmark_reporter = path ? get_reporter(format) : NULL;
+    strncpy(benchmark_report_path, path ? path : "", MAX_STR_LEN - 1);
+}
+
+void use_benchmark_baseline(const char *path, const double threshold) {
+    free(baseline);
+    baseline = NULL;
+    baseline_size = 0;
+    regression_threshold = threshold;
+
+    if (path) {
+        baseline_size = load_baseline(path, &baseline);
+
+        if (baseline_size == 0) {
+            output_printf("*** [WARNING] No benchmarks could be loaded from the baseline \"%s\". ***\n", path);
+        }
+    }
+}
+
+void use_test_filter(const char *filter) {
+    test_filter = filter;
+}
+
+void use_test_shard(const size_t index, const size_t count) {
+    shard_index = index;
+    shard_count = count;
+}
+
+void use_shard_durations(const char *path) {
+    shard_durations_path = path;
+}
+
+void use_test_cache(const char *path, const char *key) {
+    test_cache_path = path;
+    test_cache_key = key;
+}
+
+void use_property_seed(const uint64_t seed) {
+    property_seed = seed;
+}
+
+void use_max_failures(const size_t failures_allowed) {
+    max_failures = failures_allowed;
+}
+
+// Parse a shard written as "index/count".
+static bool parse_shard(const char *text, size_t *index, size_t *count) {
+    char *end;
+    unsigned long long parsed_index = strtoull(text, &end, 10);
+
+    if (end == text || *end != '/') {
+        return false;
+    }
+
+    const char *rest = end + 1;
+    unsigned long long parsed_count = strtoull(rest, &end, 10);
+
+    if (end == rest || *end != '\0' || parsed_count == 0 || parsed_index >= parsed_count) {
+        return false;
+    }
+
+    *index = (size_t) parsed_index;
+    *count = (size_t) parsed_count;
+    return true;
+}
+
+void use_command_line(const int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+
+        if (strncmp(arg, "--filter=", 9) == 0) {
+            test_filter = arg + 9;
+        } else if (strncmp(arg, "--shard=", 8) == 0) {
+            if (!parse_shard(arg + 8, &shard_index, &shard_count)) {
+                output_printf("*** [WARNING] Ignoring the shard \"%s\", which is not of the form index/count. ***\n", arg + 8);
+            }
+        } else if (strncmp(arg, "--shard-durations=", 18) == 0) {
+            shard_durations_path = arg + 18;
+        } else if (strcmp(arg, "--no-isolation") == 0) {
+            isolate_tests = false;
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            property_seed = (uint64_t) strtoull(arg + 7, NULL, 10);
+        } else if (strcmp(arg, "--fail-fast") == 0) {
+            max_failures = 1;
+        } else if (strncmp(arg, "--max-failures=", 15) == 0) {
+            max_failures = (size_t) strtoull(arg + 15, NULL, 10);
+        }
+    }
+}
+
+size_t count_regressions(void) {
+    return regressions;
+}
+
+static FILE *open_report(const Reporter *reporter, const char *path) {
+    if (!reporter) {
+        return NULL;
+    }
+
+    FILE *report = fopen(path, "w");
+    if (!report) {
+        output_printf("*** [WARNING] Failed to open \"%s\" to write a report. ***\n\n", path);
+    }
+
+    return report;
+}
+
+ScopeMark __begin_scope(const char *name) {
+    ScopeMark mark = { name, timer_now(TIMER_WALL) };
+    return mark;
+}
+
+void __end_scope(ScopeMark *mark) {
+    instrument_record(INSTRUMENT_SCOPE, mark->name, mark->start, timer_now(TIMER_WALL) - mark->start);
+}
+
+void __add_to_counter(const char *name, const uint64_t amount) {
+    instrument_record(INSTRUMENT_COUNTER, name, timer_now(TIMER_WALL), amount);
+}
+
+static const char *get_trace_path(void) {
+    const char *path = trace_path ? trace_path : getenv("CATOM_TRACE");
+    return path && *path ? path : NULL;
+}
+
+// Start the trace, if there is one, before any worker processes are started so that they add to it.
+static void start_trace(void) {
+    const char *path = get_trace_path();
+
+    if (!path || trace_started) {
+        return;
+    }
+
+    if (instrument_start_trace(path)) {
+        instrument_tracing(true);
+        trace_started = true;
+    } else {
+        output_printf("*** [WARNING] Failed to open \"%s\" to write a trace. ***\n\n", path);
+    }
+}
+
+// Write out the events recorded since the last flush to the trace.
+static void flush_trace(void) {
+    size_t dropped = 0;
+
+    if (!trace_started) {
+        return;
+    }
+
+    if (!instrument_flush_trace(get_trace_path(), &dropped)) {
+        output_printf("*** [WARNING] Failed to add events to the trace. ***\n");
+    }
+
+    if (dropped > 0) {
+        output_printf("*** [WARNING] %zu event%s left out of the trace, since there was no room to keep them. ***\n", dropped, dropped != 1 ? "s were" : " was");
+    }
+}
+
+// Add up every scope and counter recorded in a test or benchmark, print them and forget them. Returns their totals,
+// which are only kept until the next call.
+static const InstrumentTotal *report_instruments(const char *context, size_t *count) {
+    static InstrumentTotal totals[MAX_INSTRUMENTS];
+    size_t lost = 0;
+
+    *count = instrument_totals(context, totals, MAX_INSTRUMENTS, &lost);
+    instrument_clear(context);
+
+    for (size_t i = 0; i < *count; ++i) {
+        const InstrumentTotal *total = totals + i;
+
+        if (total->kind == INSTRUMENT_SCOPE) {
+            output_printf("Scope \"%s\" left %" PRIu64 " time%s, taking %" PRIu64 " ns in total and %.1f ns on average (from %" PRIu64 " to %" PRIu64 " ns).\n",
+                total->name, total->count, total->count != 1 ? "s" : "", total->total, (double) total->total / (double) total->count, total->min, total->max);
+        } else {
+            output_printf("Counter \"%s\" added to %" PRIu64 " time%s, for %" PRIu64 " in total.\n", total->name, total->count, total->count != 1 ? "s" : "", total->total);
+        }
+    }
+
+    if (lost > 0) {
+        output_printf("*** [WARNING] %zu scope and counter recording%s left out of the totals, since there were too many different ones. ***\n", lost, lost != 1 ? "s were" : " was");
+    }
+
+    return totals;
+}
+
+// Copy the totals of instruments to keep them past the next report. Returns the copy, which must be freed, or NULL if
+// there were none or no memory for them, in which case the count is set to 0.
+static InstrumentTotal *keep_instruments(const InstrumentTotal *totals, size_t *count) {
+    InstrumentTotal *kept = *count > 0 ? (InstrumentTotal *) malloc(*count * sizeof(InstrumentTotal)) : NULL;
+    if (kept) {
+        memcpy(kept, totals, *count * sizeof(InstrumentTotal));
+    } else {
+        *count = 0;
+    }
+
+    return kept;
+}
+
+static void __run_test(Test *test) {
+    output_printf(get_verbose_print_status() ? "Running test \"%s\":\n\n" : "Running test \"%s\":\n", test->name);
+
+    instrument_context(test->name);
+
+    reset_allocation_stats();
+
+    uint64_t start = timer_now(TIMER_WALL);
+
+    // Write out everything so far, so that it comes before anything the test prints itself.
+    output_sync();
+
+    ATOMIC_STORE(&thread_failures, 0);
+    in_test = true;
+
+    if (setjmp(env) == 0) {
+        test->test();
+        test->passed = true;
+    } else {
+        test->passed = false;
+
+        // A property test's shrunk case fails by jumping out of the replay, before it stops logging and frees its
+        // inputs.
+        log_generated = false;
+        choices_release();
+    }
+
+    in_test = false;
+
+    size_t stray = ATOMIC_LOAD(&thread_failures);
+    if (stray > 0) {
+        output_printf("\n%zu assertion%s failed on other threads.\n", stray, stray != 1 ? "s" : "");
+
+        if (test->passed) {
+            test->passed = false;
+            ATOMIC_ADD(&failures, 1);
+        }
+    }
+
+    if (test->passed) {
+        tprinterr("\nTest passed. ", true);
+    } else {
+        tprinterr("\nTest failed. ", false);
+    }
+
+    test->time = timer_seconds_since(start);
+
+    output_printf("\"%s\" terminated in %f seconds.\n", test->name, test->time);
+
+    const AllocationStats *memory = get_allocation_stats();
+
+    test->allocations = memory->allocations;
+    test->allocated_bytes = memory->allocated_bytes;
+    test->peak_bytes = memory->peak_bytes;
+    test->leaked_bytes = memory->live_bytes;
+    test->leaked_allocations = memory->live_allocations;
+
+    if (test->allocations > 0) {
+        output_printf("Made %zu allocation%s of %zu bytes in total, peaking at %zu bytes.\n", test->allocations, test->allocations != 1 ? "s" : "", test->allocated_bytes, test->peak_bytes);
+    }
+
+    if (test->leaked_allocations > 0) {
+        output_printf("Leaked %zu bytes in %zu allocation%s, which will be freed now.\n", test->leaked_bytes, test->leaked_allocations, test->leaked_allocations != 1 ? "s" : "");
+    }
+
+    size_t instrument_count;
+    report_instruments(test->name, &instrument_count);
+    flush_trace();
+
+    testfunc_freeall();
+}
+
+static void print_sample_stats(const SampleStats *stats, const double *samples, const char *unit, const int precision) {
+    output_printf("Samples: min %.*f %s, median %.*f %s, p90 %.*f %s, p99 %.*f %s, max %.*f %s.\n",
+        precision, stats->min, unit, precision, stats->median, unit, precision, stats->p90, unit, precision, stats->p99, unit, precision, stats->max, unit
+    );
+
+    output_printf("Mean %.*f %s (95%% CI %.*f to %.*f %s), standard deviation %.*f %s, MAD %.*f %s.\n",
+        precision, stats->mean, unit, precision, stats->ci_low, precision, stats->ci_high, unit, precision, stats->stddev, unit, precision, stats->mad, unit
+    );
+
+    if (stats->outliers > 0) {
+        output_printf("Outlying iteration%s (mean %.*f %s without %s):", stats->outliers != 1 ? "s" : "", precision, stats->inlier_mean, unit, stats->outliers != 1 ? "them" : "it");
+
+        for (size_t i = 0; i < stats->n; ++i) {
+            if (is_outlier(stats, samples[i])) {
+                output_printf(" #%zu", i + 1u);
+            }
+        }
+
+        output_printf(".\n");
+    }
+}
+
+// The timer of the benchmark being timed, and how long it has been paused for.
+static TimerSource timing_timer = TIMER_WALL;
+static bool timing_active = false;
+static bool timing_paused = false;
+static uint64_t paused_at = 0;
+static uint64_t paused_ticks = 0;
+
+void benchmark_pause_timing(void) {
+    if (timing_active && !timing_paused) {
+        timing_paused = true;
+        paused_at = timer_now(timing_timer);
+    }
+}
+
+void benchmark_resume_timing(void) {
+    if (timing_active && timing_paused) {
+        paused_ticks += timer_now(timing_timer) - paused_at;
+        timing_paused = false;
+    }
+}
+
+// Time one call of a benchmark, leaving out its fixture and any time it paused timing for. Events are counted into
+// counted, if it is given, over the same stretch.
+static uint64_t time_benchmark(const Benchmark *benchmark, const TimerSource timer, const size_t iterations, const size_t n, ThreadTeam *team, CounterReading *counted) {
+    CounterReading before, after;
+    uint64_t ticks;
+
+    instrument_context(benchmark->name);
+
+    if (benchmark->setup) {
+        benchmark->setup(n);
+    }
+
+    if (counted && !team) {
+        counters_read(&before);
+    }
+
+    if (team) {
+        // The threads of the team count their own events, which the calling thread's counters would miss.
+        ticks = team_run(team, iterations, counted);
+    } else {
+        timing_timer = timer;
+        timing_active = true;
+        timing_paused = false;
+        paused_ticks = 0;
+
+        uint64_t start = timer_now(timer);
+
+        if (benchmark->range) {
+            benchmark->range(iterations, n);
+        } else if (benchmark->scaled) {
+            benchmark->scaled(iterations);
+        } else {
+            benchmark->benchmark();
+        }
+
+        uint64_t end = timer_now(timer);
+
+        // A benchmark that is still paused is taken to have resumed as it returned.
+        if (timing_paused) {
+            paused_ticks += end - paused_at;
+        }
+
+        timing_active = false;
+        ticks = end - start > paused_ticks ? end - start - paused_ticks : 0;
+    }
+
+    if (counted && !team) {
+        counters_read(&after);
+        counters_difference(&before, &after, counted);
+    }
+
+    if (benchmark->teardown) {
+        benchmark->teardown(n);
+    }
+
+    return ticks;
+}
+
+// Find how many iterations a scaled benchmark needs for one call to take at least the target time.
+static size_t calibrate_benchmark(const Benchmark *benchmark, const TimerSource timer, const size_t n, ThreadTeam *team) {
+    size_t iterations = 1;
+
+    for (;;) {
+        uint64_t taken = timer_ticks_to_ns(timer, time_benchmark(benchmark, timer, iterations, n, team, NULL));
+        if (taken >= benchmark_target_ns || iterations >= MAX_BENCHMARK_ITERATIONS) {
+            return iterations;
+        }
+
+        // Aim a little past the target, but only trust the last sample for extrapolation if it was long enough.
+        double multiplier = taken * 10 > benchmark_target_ns ? 1.4 * (double) benchmark_target_ns / (double) taken : 10.0;
+        double next = (double) iterations * multiplier;
+
+        iterations = next <= (double) iterations ? iterations + 1 : next >= (double) MAX_BENCHMARK_ITERATIONS ? MAX_BENCHMARK_ITERATIONS : (size_t) next;
+    }
+}
+
+// Compare a benchmark's median against the baseline, if it has one there.
+static void compare_with_baseline(BenchmarkResult *result) {
+    const BaselineEntry *entry = find_baseline(baseline, baseline_size, result->name);
+    if (!entry || entry->value <= 0.0 || result->times == 0) {
+        return;
+    }
+
+    result->has_baseline = true;
+    result->baseline = entry->value;
+    result->change = (result->stats.median - entry->value) / entry->value;
+    result->regressed = result->change > regression_threshold;
+
+    output_printf("Median is %.1f%% %s than the baseline (%.3f %s). ",
+        100.0 * (result->change < 0.0 ? -result->change : result->change),
+        result->change < 0.0 ? "faster" : "slower",
+        entry->value,
+        result->unit
+    );
+
+    if (result->regressed) {
+        ++regressions;
+        tprinterr("Regression!", false);
+        output_printf(" (threshold %.1f%%)\n", 100.0 * regression_threshold);
+    } else {
+        tprinterr("No regression.", true);
+        output_printf("\n");
+    }
+}
+
+// Print how long one iteration of a benchmark took.
+static void print_iteration(const Benchmark *benchmark, const TimerSource timer, const size_t i, const size_t warmup, const size_t times, const size_t iterations, const uint64_t ticks, const uint64_t time_taken) {
+    if (i < warmup) {
+        output_printf("Running warmup iteration %zu / %zu. Finished warmup iteration %zu / %zu in %" PRIu64 " ns", i + 1, warmup, i + 1, warmup, time_taken);
+    } else {
+        output_printf("Running benchmark iteration %zu / %zu. Finished benchmark iteration %zu / %zu in %" PRIu64 " ns", i - warmup + 1, times, i - warmup + 1, times, time_taken);
+    }
+
+    if (timer == TIMER_CYCLES) {
+        output_printf(" (%" PRIu64 " cycles)", ticks);
+    }
+
+    if (benchmark->scaled || benchmark->parallel || benchmark->range) {
+        output_printf(", %.3f ns/op", (double) time_taken / (double) iterations);
+    }
+
+    output_printf(".\n");
+}
+
+// Print the events counted during one iteration of a benchmark.
+static void print_iteration_counters(const CounterReading *counted) {
+    const uint64_t *values = counted->values;
+    const bool *valid = counted->valid;
+    const char *separator = " ";
+
+    output_printf("Counted");
+
+    if (valid[COUNTER_CYCLES]) {
+        output_printf("%s%" PRIu64 " cycles", separator, values[COUNTER_CYCLES]);
+        separator = ", ";
+    }
+
+    if (valid[COUNTER_INSTRUCTIONS]) {
+        output_printf("%s%" PRIu64 " instructions", separator, values[COUNTER_INSTRUCTIONS]);
+        separator = ", ";
+
+        if (valid[COUNTER_CYCLES] && values[COUNTER_CYCLES] > 0) {
+            output_printf(" (IPC %.2f)", (double) values[COUNTER_INSTRUCTIONS] / (double) values[COUNTER_CYCLES]);
+        }
+    }
+
+    if (valid[COUNTER_CACHE_MISSES]) {
+        output_printf("%s%" PRIu64 " cache misses", separator, values[COUNTER_CACHE_MISSES]);
+        separator = ", ";
+    }
+
+    if (valid[COUNTER_BRANCH_MISSES]) {
+        output_printf("%s%" PRIu64 " branch misses", separator, values[COUNTER_BRANCH_MISSES]);
+        separator = ", ";
+    }
+
+    if (valid[COUNTER_PAGE_FAULTS]) {
+        output_printf("%s%" PRIu64 " page faults", separator, values[COUNTER_PAGE_FAULTS]);
+    }
+
+    output_printf(".\n");
+}
+
+// Print the average events counted per iteration (or operation) of a benchmark. Counters that could not be opened are NAN.
+static void print_average_counters(const double counters[], const double ipc, const char *per) {
+    const char *labels[COUNTER_COUNT] = { "cycles", "instructions", "cache misses", "branch misses", "page faults" };
+    const char *separator = " ";
+
+    output_printf("Counted per %s:", per);
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        if (!isnan(counters[i])) {
+            output_printf("%s%.3f %s", separator, counters[i], labels[i]);
+            separator = ", ";
+        }
+    }
+
+    if (!isnan(ipc)) {
+        output_printf(" (IPC %.3f)", ipc);
+    }
+
+    output_printf(".\n");
+}
+
+// Start counting events for a benchmark, if that was asked for. Returns whether they are being counted.
+static bool start_counting(void) {
+    bool counting = count_benchmark_events && counters_open();
+    if (count_benchmark_events && !counting) {
+        output_printf("*** [WARNING] Hardware counters are not available on this system. No events will be counted. ***\n");
+    }
+
+    return counting;
+}
+
+/**
+ * The iterations of a benchmark at one size. They are all timed before any of them are printed or summarised, so that
+ * the iterations of several benchmarks can be interleaved.
+ */
+typedef struct {
+    const Benchmark *benchmark; /**< The benchmark being run. */
+    TimerSource timer;          /**< Timer it is measured with. */
+    size_t iterations;          /**< Operations per iteration. */
+    size_t n;                   /**< Size it is run at. */
+    size_t taken;               /**< Number of iterations timed so far, warmup iterations first. */
+    uint64_t *ticks;            /**< Ticks each iteration took, or NULL if they could not be allocated. */
+    CounterReading *counted;    /**< Events counted during each iteration, or NULL if they are not being counted. */
+} IterationLog;
+
+// Preallocate the log of a benchmark's iterations, so that logging one never allocates between timing them.
+static void start_iterations(IterationLog *log, const Benchmark *benchmark, const TimerSource timer, const size_t iterations, const size_t n, const size_t total, const bool counting) {
+    *log = (IterationLog) { benchmark, timer, iterations, n, 0, (uint64_t *) malloc((total > 0 ? total : 1) * sizeof(uint64_t)), NULL };
+
+    if (counting) {
+        log->counted = (CounterReading *) malloc((total > 0 ? total : 1) * sizeof(CounterReading));
+    }
+
+    if (!log->ticks || (counting && !log->counted)) {
+        output_printf("*** [WARNING] Failed to allocate space for the iterations of benchmark \"%s\". It was not run. ***\n", benchmark->name);
+        free(log->ticks);
+        free(log->counted);
+        log->ticks = NULL;
+        log->counted = NULL;
+    }
+}
+
+// Time the next iteration of a benchmark.
+static void time_iteration(IterationLog *log) {
+    if (log->ticks) {
+        // Counters are read outside of the timed region, so that counting does not affect the timings.
+        log->ticks[log->taken] = time_benchmark(log->benchmark, log->timer, log->iterations, log->n, NULL, log->counted ? log->counted + log->taken : NULL);
+        ++log->taken;
+    }
+}
+
+// Print the warmup and measured iterations of a benchmark, storing the time per operation of each measured one in
+// samples (if there are any) and adding up the time they took in total_time. If counted_total is not NULL, the events
+// counted during the measured iterations are added up in it. Frees the log, and returns the time taken by every
+// iteration.
+static uint64_t finish_iterations(IterationLog *log, const size_t warmup, const size_t times, double *samples, CounterReading *counted_total, uint64_t *total_time) {
+    const Benchmark *benchmark = log->benchmark;
+    const TimerSource timer = log->timer;
+    const size_t iterations = log->iterations;
+    bool counting = counted_total != NULL && log->counted != NULL;
+    uint64_t with_wm = 0;
+
+    if (counted_total) {
+        memset(counted_total, 0, sizeof(CounterReading));
+    }
+
+    if (samples && log->taken < warmup + times) {
+        memset(samples, 0, times * sizeof(double));
+    }
+
+    for (size_t i = 0; i < log->taken; ++i) {
+        uint64_t ticks = log->ticks[i];
+        uint64_t time_taken = timer_ticks_to_ns(timer, ticks);
+        const CounterReading *counted = counting ? log->counted + i : NULL;
+
+        if (i >= warmup) {
+            *total_time += time_taken;
+
+            if (samples) {
+                samples[i - warmup] = (double) time_taken / (double) iterations;
+            }
+
+            if (counting) {
+                for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+                    counted_total->values[c] += counted->values[c];
+                    counted_total->valid[c] = counted->valid[c] && (i == warmup || counted_total->valid[c]);
+                }
+            }
+        }
+
+        if (!quiet_output) {
+            print_iteration(benchmark, timer, i, warmup, times, iterations, ticks, time_taken);
+
+            if (counting) {
+                print_iteration_counters(counted);
+            }
+        }
+
+        with_wm += time_taken;
+    }
+
+    free(log->ticks);
+    free(log->counted);
+    log->ticks = NULL;
+    log->counted = NULL;
+
+    return with_wm;
+}
+
+// Run the warmup and measured iterations of a benchmark at a size, and print and add them up as finish_iterations does.
+static uint64_t sample_benchmark(const Benchmark *benchmark, const TimerSource timer, const size_t iterations, const size_t n, const size_t warmup, const size_t times, double *samples, CounterReading *counted_total, uint64_t *total_time) {
+    IterationLog log;
+    start_iterations(&log, benchmark, timer, iterations, n, warmup + times, counted_total != NULL);
+
+    // Iterations are written out in batches, so that printing them does not stall the timed loop.
+    output_sync();
+
+    for (size_t i = 0; i < warmup + times; ++i) {
+        time_iteration(&log);
+    }
+
+    return finish_iterations(&log, warmup, times, samples, counted_total, total_time);
+}
+
+// Average the events counted over the operations of a benchmark, on every thread it ran on, into its result, and print
+// them.
+static void average_counters(BenchmarkResult *result, const CounterReading *counted_total, const char *per) {
+    double operations = (double) (result->times * result->iterations * result->threads);
+
+    result->counted = true;
+
+    for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+        result->counters[c] = counted_total->valid[c] ? (double) counted_total->values[c] / operations : NAN;
+    }
+
+    if (counted_total->valid[COUNTER_CYCLES] && counted_total->valid[COUNTER_INSTRUCTIONS] && counted_total->values[COUNTER_CYCLES] > 0) {
+        result->ipc = (double) counted_total->values[COUNTER_INSTRUCTIONS] / (double) counted_total->values[COUNTER_CYCLES];
+    }
+
+    print_average_counters(result->counters, result->ipc, per);
+}
+
+// Pick the timer a benchmark is measured with. Without a cycle counter, benchmarks timed in cycles are timed with the
+// wall clock instead, which is warned about the first time.
+static TimerSource choose_timer(const Benchmark *benchmark) {
+    static bool warned = false;
+    TimerSource timer = benchmark->timer == TIMER_DEFAULT ? benchmark_timer : benchmark->timer;
+
+    if (timer == TIMER_CYCLES && !timer_has_cycles()) {
+        if (!warned) {
+            output_printf("*** [WARNING] This processor has no cycle counter. Benchmarks timed in cycles are timed with the wall clock. ***\n\n");
+            warned = true;
+        }
+
+        timer = TIMER_WALL;
+    }
+
+    return timer;
+}
+
+// Calibrate a plain or scaled benchmark and start the log of its iterations.
+static void start_benchmark(IterationLog *log, const Benchmark *benchmark, const size_t total, const bool counting) {
+    TimerSource timer = choose_timer(benchmark);
+
+    size_t iterations = benchmark->scaled ? calibrate_benchmark(benchmark, timer, 0, NULL) : 1;
+    start_iterations(log, benchmark, timer, iterations, 0, total, counting);
+}
+
+// Run a plain or scaled benchmark, or only print and summarise it if its iterations were already timed in interleaved.
+static uint64_t __run_benchmark(const Benchmark *benchmark, const size_t warmup, const size_t times, FILE *report, size_t *records, IterationLog *interleaved) {
+    // Preallocated so that storing a sample never allocates inside the timed loop.
+    double *samples = (double *) malloc(2 * times * sizeof(double));
+    if (!samples && times > 0) {
+        output_printf("*** [WARNING] Failed to allocate space for benchmark samples. No statistics will be reported. ***\n");
+    }
+
+    in_benchmark = true;
+
+    output_printf("Running benchmark \"%s\":\n\n", benchmark->name);
+
+    IterationLog log;
+    bool counting;
+
+    if (interleaved) {
+        log = *interleaved;
+        counting = log.counted != NULL;
+    } else {
+        counting = start_counting();
+        start_benchmark(&log, benchmark, warmup + times, counting);
+    }
+
+    TimerSource timer = log.timer;
+    size_t iterations = log.iterations;
+    bool measured = log.ticks != NULL;
+
+    if (benchmark->scaled) {
+        output_printf("Calibrated to %zu operation%s per iteration.\n", iterations, iterations != 1 ? "s" : "");
+    }
+
+    if (!interleaved) {
+        // Iterations are written out in batches, so that printing them does not stall the timed loop.
+        output_sync();
+
+        for (size_t i = 0; i < warmup + times; ++i) {
+            time_iteration(&log);
+        }
+
+        if (counting) {
+            counters_close();
+        }
+    }
+
+    CounterReading counted_total;
+
+    uint64_t total_time = 0;
+    uint64_t with_wm = finish_iterations(&log, warmup, times, samples, counting ? &counted_total : NULL, &total_time);
+
+    in_benchmark = false;
+
+    output_printf("\nBenchmark complete.\n\"%s\" finished %zu iterations (and %zu warmup iterations) in %" PRIu64 " ns (%" PRIu64 " ns with warmup).\nIt took %.1f ns on average to run (%.1f ns average with warmup).\n",
+        benchmark->name,
+        times,
+        warmup,
+        total_time,
+        with_wm,
+        times > 0 ? (double) total_time / times : 0.0,
+        times + warmup > 0 ? (double) with_wm / (times + warmup) : 0.0
+    );
+
+    size_t instrument_count;
+    const InstrumentTotal *instruments = report_instruments(benchmark->name, &instrument_count);
+
+    if (samples && times > 0 && measured) {
+        BenchmarkResult result = {
+            .benchmark = benchmark,
+            .name = benchmark->name,
+            .timer = timer,
+            .warmup = warmup,
+            .times = times,
+            .iterations = iterations,
+            .threads = 1,
+            .efficiency = 1.0,
+            .unit = benchmark->scaled ? "ns/op" : "ns",
+            .samples = samples,
+            .ipc = NAN,
+            .environment = &benchmark_environment,
+            .instruments = instruments,
+            .instrument_count = instrument_count
+        };
+
+        summarise_samples(samples, times, samples + times, &result.stats);
+        result.throughput = result.stats.median > 0.0 ? 1e9 / result.stats.median : 0.0;
+        result.throughput_unit = "ops/s";
+
+        print_sample_stats(&result.stats, samples, result.unit, benchmark->scaled ? 3 : 1);
+
+        if (counting) {
+            average_counters(&result, &counted_total, benchmark->scaled ? "operation" : "iteration");
+        }
+
+        compare_with_baseline(&result);
+
+        if (report) {
+            benchmark_reporter->benchmark(report, &result, (*records)++);
+        }
+    }
+
+    free(samples);
+
+    return with_wm;
+}
+
+// The size a range benchmark is run at after the one at the given index of its sweep, or 0 after the last size.
+static size_t next_range_size(const BenchmarkRange *range, const size_t index, const size_t n) {
+    if (range->sizes) {
+        return index + 1 < range->count ? range->sizes[index + 1] : 0;
+    }
+
+    size_t multiplier = range->multiplier < 2 ? 2 : range->multiplier;
+
+    if (n >= range->max) {
+        return 0;
+    }
+
+    return n > range->max / multiplier ? range->max : n * multiplier;
+}
+
+// Print a throughput, in binary multiples of bytes per second or in items per second.
+static void print_throughput(const double throughput, const RangeUnit unit) {
+    if (unit == RANGE_BYTES) {
+        const char *prefixes[] = { "", "Ki", "Mi", "Gi", "Ti" };
+        double scaled = throughput;
+        size_t prefix = 0;
+
+        while (scaled >= 1024.0 && prefix < sizeof(prefixes) / sizeof(prefixes[0]) - 1) {
+            scaled /= 1024.0;
+            ++prefix;
+        }
+
+        output_printf("%.2f %sB/s", scaled, prefixes[prefix]);
+    } else {
+        output_printf("%.0f items/s", throughput);
+    }
+}
+
+static uint64_t __run_range_benchmark(const Benchmark *benchmark, const size_t warmup, const size_t times, FILE *report, size_t *records) {
+    const BenchmarkRange *range = &benchmark->sizes;
+
+    size_t first = range->sizes ? (range->count > 0 ? range->sizes[0] : 0) : range->min;
+
+    size_t count = 0;
+    for (size_t n = first; n != 0; n = next_range_size(range, count - 1, n)) {
+        ++count;
+    }
+
+    if (count == 0) {
+        output_printf("*** [WARNING] Range benchmark \"%s\" has no sizes to run at. ***\n", benchmark->name);
+        return 0;
+    }
+
+    // Every size is reported once the complexity has been fitted to all of them, so their samples are all kept.
+    double *samples = (double *) malloc((2 * times * count + 1) * sizeof(double));
+    BenchmarkResult *results = (BenchmarkResult *) calloc(count, sizeof(BenchmarkResult));
+    char (*names)[NAME_MAX_LENGTH + 32] = malloc(count * sizeof(*names));
+    double *sizes = (double *) malloc(2 * count * sizeof(double));
+
+    if (!samples || !results || !names || !sizes) {
+        output_printf("*** [WARNING] Failed to allocate space for benchmark samples. Range benchmark \"%s\" was not run. ***\n", benchmark->name);
+        free(samples);
+        free(results);
+        free(names);
+        free(sizes);
+        return 0;
+    }
+
+    in_benchmark = true;
+
+    TimerSource timer = choose_timer(benchmark);
+
+    output_printf("Running range benchmark \"%s\" at %zu size%s:\n", benchmark->name, count, count != 1 ? "s" : "");
+
+    bool counting = start_counting();
+    uint64_t with_wm = 0;
+    size_t n = first;
+
+    for (size_t k = 0; k < count; n = next_range_size(range, k, n), ++k) {
+        output_printf("\nAt n = %zu:\n", n);
+
+        size_t iterations = calibrate_benchmark(benchmark, timer, n, NULL);
+        output_printf("Calibrated to %zu operation%s per iteration.\n", iterations, iterations != 1 ? "s" : "");
+
+        double *size_samples = samples + 2 * times * k;
+        CounterReading counted_total;
+        uint64_t total_time = 0;
+
+        with_wm += sample_benchmark(benchmark, timer, iterations, n, warmup, times, size_samples, counting ? &counted_total : NULL, &total_time);
+
+        size_t instrument_count;
+        const InstrumentTotal *instruments = report_instruments(benchmark->name, &instrument_count);
+
+        if (times == 0) {
+            continue;
+        }
+
+        snprintf(names[k], sizeof(names[k]), "%s [n = %zu]", benchmark->name, n);
+
+        BenchmarkResult *result = results + k;
+        *result = (BenchmarkResult) {
+            .benchmark = benchmark,
+            .name = names[k],
+            .timer = timer,
+            .warmup = warmup,
+            .times = times,
+            .iterations = iterations,
+            .threads = 1,
+            .efficiency = 1.0,
+            .size = n,
+            .throughput_unit = range->unit == RANGE_BYTES ? "bytes/s" : "items/s",
+            .unit = "ns/op",
+            .samples = size_samples,
+            .ipc = NAN,
+            .environment = &benchmark_environment
+        };
+
+        // The results of every size are reported together at the end, so their totals are kept until then.
+        result->instruments = keep_instruments(instruments, &instrument_count);
+        result->instrument_count = instrument_count;
+
+        summarise_samples(size_samples, times, size_samples + times, &result->stats);
+        result->throughput = result->stats.median > 0.0 ? (double) n * 1e9 / result->stats.median : 0.0;
+
+        output_printf("Throughput ");
+        print_throughput(result->throughput, range->unit);
+        output_printf(".\n");
+
+        print_sample_stats(&result->stats, size_samples, result->unit, 3);
+
+        if (counting) {
+            average_counters(result, &counted_total, "operation");
+        }
+
+        compare_with_baseline(result);
+
+        sizes[k] = (double) n;
+        sizes[count + k] = result->stats.median;
+    }
+
+    if (counting) {
+        counters_close();
+    }
+
+    in_benchmark = false;
+
+    output_printf("\nBenchmark complete.\n\"%s\" took %" PRIu64 " ns in total (with warmup).\n", benchmark->name, with_wm);
+
+    if (times > 0) {
+        ComplexityFit fit;
+        const char *complexity = NULL;
+
+        if (fit_complexity(sizes, sizes + count, count, &fit)) {
+            complexity = complexity_name(fit.complexity);
+            output_printf("Estimated complexity %s, with a coefficient of %.3g ns and an RMS error of %.1f%%.\n", complexity, fit.coefficient, 100.0 * fit.rms);
+        } else {
+            output_printf("The complexity could not be estimated, since it needs times at two or more sizes.\n");
+        }
+
+        for (size_t k = 0; k < count; ++k) {
+            results[k].complexity = complexity;
+
+            if (report) {
+                benchmark_reporter->benchmark(report, results + k, (*records)++);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < count; ++k) {
+        free((void *) results[k].instruments);
+    }
+
+    free(samples);
+    free(results);
+    free(names);
+    free(sizes);
+
+    return with_wm;
+}
+
+// The thread count a parallel benchmark is run on after the given one: the next power of two, or the most it may use.
+static size_t next_thread_count(const size_t threads, const size_t most) {
+    return threads >= most ? most + 1u : threads * 2u < most ? threads * 2u : most;
+}
+
+static uint64_t __run_parallel_benchmark(const Benchmark *benchmark, const size_t warmup, const size_t times, FILE *report, size_t *records) {
+    // Preallocated so that storing a sample never allocates inside the timed loop.
+    double *samples = (double *) malloc(2 * times * sizeof(double));
+    if (!samples && times > 0) {
+        output_printf("*** [WARNING] Failed to allocate space for benchmark samples. No statistics will be reported. ***\n");
+    }
+
+    in_benchmark = true;
+
+    size_t most = benchmark_threads > 0 ? benchmark_threads : available_cores();
+    output_printf("Running parallel benchmark \"%s\" on up to %zu thread%s:\n\n", benchmark->name, most, most != 1 ? "s" : "");
+
+    size_t iterations = 0;
+    double single_throughput = 0.0;
+    uint64_t with_wm = 0;
+
+    // Only checks that events can be counted: the threads of each team count their own.
+    bool counting = start_counting();
+    counters_close();
+
+    for (size_t threads = 1; threads <= most; threads = next_thread_count(threads, most)) {
+        ThreadTeam *team = team_start(benchmark->parallel, threads, pin_benchmark_threads, counting);
+        if (!team) {
+            output_printf("*** [WARNING] Failed to start %zu benchmark threads. ***\n", threads);
+            break;
+        }
+
+        if (iterations == 0) {
+            iterations = calibrate_benchmark(benchmark, TIMER_WALL, 0, team);
+            output_printf("Calibrated to %zu operation%s per iteration on each thread.\n", iterations, iterations != 1 ? "s" : "");
+        }
+
+        output_printf("\nOn %zu thread%s:\n", threads, threads != 1 ? "s" : "");
+        output_sync();
+
+        CounterReading counted, counted_total;
+
+        for (size_t i = 0; i < warmup + times; ++i) {
+            uint64_t ticks = time_benchmark(benchmark, TIMER_WALL, iterations, 0, team, counting ? &counted : NULL);
+            uint64_t time_taken = timer_ticks_to_ns(TIMER_WALL, ticks);
+
+            // Samples are the time per operation across every thread, so lower is still better.
+            if (i >= warmup && samples) {
+                samples[i - warmup] = (double) time_taken / (double) (iterations * threads);
+            }
+
+            if (counting && i >= warmup) {
+                if (i == warmup) {
+                    counted_total = counted;
+                } else {
+                    counters_add(&counted_total, &counted);
+                }
+            }
+
+            if (!quiet_output) {
+                print_iteration(benchmark, TIMER_WALL, i, warmup, times, iterations * threads, ticks, time_taken);
+
+                if (counting) {
+                    print_iteration_counters(&counted);
+                }
+            }
+
+            with_wm += time_taken;
+        }
+
+        team_stop(team);
+
+        size_t instrument_count;
+        const InstrumentTotal *instruments = report_instruments(benchmark->name, &instrument_count);
+
+        if (!samples || times == 0) {
+            continue;
+        }
+
+        char name[NAME_MAX_LENGTH + 32];
+        snprintf(name, sizeof(name), "%s [%zu thread%s]", benchmark->name, threads, threads != 1 ? "s" : "");
+
+        BenchmarkResult result = {
+            .benchmark = benchmark,
+            .name = name,
+            .timer = TIMER_WALL,
+            .warmup = warmup,
+            .times = times,
+            .iterations = iterations,
+            .threads = threads,
+            .unit = "ns/op",
+            .samples = samples,
+            .ipc = NAN,
+            .environment = &benchmark_environment,
+            .instruments = instruments,
+            .instrument_count = instrument_count
+        };
+
+        summarise_samples(samples, times, samples + times, &result.stats);
+
+        double throughput = result.stats.median > 0.0 ? 1e9 / result.stats.median : 0.0;
+        if (threads == 1) {
+            single_throughput = throughput;
+        }
+
+        result.efficiency = single_throughput > 0.0 ? throughput / (single_throughput * (double) threads) : 0.0;
+        result.throughput = throughput;
+        result.throughput_unit = "ops/s";
+
+        output_printf("Throughput %.0f ops/s (%.0f ops/s per thread), %.1f%% scaling efficiency.\n", throughput, throughput / (double) threads, 100.0 * result.efficiency);
+        print_sample_stats(&result.stats, samples, result.unit, 3);
+
+        if (counting) {
+            average_counters(&result, &counted_total, "operation");
+        }
+
+        compare_with_baseline(&result);
+
+        if (report) {
+            benchmark_reporter->benchmark(report, &result, (*records)++);
+        }
+    }
+
+    in_benchmark = false;
+
+    output_printf("\nBenchmark complete.\n\"%s\" took %" PRIu64 " ns in total (with warmup).\n", benchmark->name, with_wm);
+
+    free(samples);
+
+    return with_wm;
+}
+
+// Pick out the tests to run, marking the rest as skipped. Writes the indices of the selected tests, in order, to
+// selected (which has room for n of them) and returns how many there are.
+static size_t select_tests(Test tests[], const size_t n, size_t *selected) {
+    const char *filter = test_filter ? test_filter : getenv("CATOM_FILTER");
+    const char *durations_path = shard_durations_path ? shard_durations_path : getenv("CATOM_SHARD_DURATIONS");
+
+    size_t index = shard_index;
+    size_t count = shard_count;
+    const char *shard = getenv("CATOM_SHARD");
+
+    if (count == 0 && shard && !parse_shard(shard, &index, &count)) {
+        output_printf("*** [WARNING] Ignoring CATOM_SHARD=\"%s\", which is not of the form index/count. ***\n", shard);
+    }
+
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        tests[i].skipped = filter && *filter && !filter_match(filter, tests[i].name);
+        tests[i].cached = false;
+
+        if (!tests[i].skipped) {
+            selected[k++] = i;
+        }
+    }
+
+    if (count <= 1 || index >= count) {
+        return k;
+    }
+
+    // Shards are worked out from the tests that passed the filter, so every machine has to use the same one.
+    double *costs = (double *) malloc((k + 1) * sizeof(double));
+    size_t *shards = (size_t *) malloc((k + 1) * sizeof(size_t));
+
+    BaselineEntry *durations = NULL;
+    size_t durations_size = durations_path ? load_test_durations(durations_path, &durations) : 0;
+
+    if (durations_path && durations_size == 0) {
+        output_printf("*** [WARNING] No test durations could be loaded from \"%s\". Tests will be dealt out in turn. ***\n", durations_path);
+    }
+
+    double average = 0.0;
+    for (size_t i = 0; i < durations_size; ++i) {
+        average += durations[i].value / (double) durations_size;
+    }
+
+    if (costs && shards) {
+        for (size_t i = 0; i < k; ++i) {
+            const BaselineEntry *entry = find_baseline(durations, durations_size, tests[selected[i]].name);
+            costs[i] = durations_size == 0 ? 1.0 : entry && entry->value >= 0.0 ? entry->value : average;
+        }
+    }
+
+    size_t in_shard = 0;
+
+    if (costs && shards && assign_shards(costs, k, count, shards)) {
+        for (size_t i = 0; i < k; ++i) {
+            if (shards[i] == index) {
+                selected[in_shard++] = selected[i];
+            } else {
+                tests[selected[i]].skipped = true;
+            }
+        }
+
+        output_printf("Running shard %zu / %zu.\n", index, count);
+    } else {
+        output_printf("*** [WARNING] Failed to allocate space to split the tests into shards. Running every selected test. ***\n");
+        in_shard = k;
+    }
+
+    free(costs);
+    free(shards);
+    free(durations);
+
+    return in_shard;
+}
+
+// Fingerprint everything a test depends on for the test cache, or 0 if nothing is known about it.
+static uint64_t test_fingerprint(const Test *test) {
+    uint64_t code = function_fingerprint(test->test);
+    if (code == 0 && !test->dependency_key) {
+        return 0;
+    }
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, &code, sizeof(uint64_t));
+
+    // The terminators keep the two keys from running into each other.
+    if (test_cache_key) {
+        hash_update(&state, test_cache_key, strlen(test_cache_key) + 1);
+    }
+
+    if (test->dependency_key) {
+        hash_update(&state, test->dependency_key, strlen(test->dependency_key) + 1);
+    }
+
+    uint64_t fingerprint = hash_digest(&state);
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+static uint64_t test_name_hash(const Test *test) {
+    return obj_hash(test->name, strlen(test->name));
+}
+
+// Mark the selected tests that are unchanged since they last passed as cached, and take them out of the selection.
+// The fingerprints of the tests left in it are written to fingerprints. Returns how many are left.
+static size_t skip_cached_tests(Test tests[], size_t *selected, const size_t k, CacheEntry *cache, const size_t cache_size, uint64_t *fingerprints) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < k; ++i) {
+        Test *test = tests + selected[i];
+        uint64_t fingerprint = test_fingerprint(test);
+        const CacheEntry *entry = find_cache_entry(cache, cache_size, test_name_hash(test));
+
+        if (fingerprint != 0 && entry && !entry->failed && entry->fingerprint == fingerprint) {
+            test->cached = true;
+            test->passed = true;
+        } else {
+            selected[kept] = selected[i];
+            fingerprints[kept++] = fingerprint;
+        }
+    }
+
+    if (kept < k) {
+        output_printf("Skipping %zu %s last passed.\n", k - kept, k - kept != 1 ? "tests unchanged since they" : "test unchanged since it");
+    }
+
+    return kept;
+}
+
+/**
+ * A selected test, and where it goes in the order tests are run in.
+ */
+typedef struct {
+    size_t index;         /**< Index of the test in the array being run. */
+    uint64_t fingerprint; /**< Fingerprint of the test for the test cache. */
+    int group;            /**< 0 if the test failed last time, 1 if it is new to the cache and 2 if it passed. */
+    double seconds;       /**< How long it took last time. */
+} ScheduledTest;
+
+static int compare_scheduled(const void *a, const void *b) {
+    const ScheduledTest *x = (const ScheduledTest *) a;
+    const ScheduledTest *y = (const ScheduledTest *) b;
+
+    if (x->group != y->group) {
+        return x->group < y->group ? -1 : 1;
+    }
+
+    if (x->seconds != y->seconds) {
+        return x->seconds < y->seconds ? -1 : 1;
+    }
+
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Order the selected tests so that failures show up as soon as possible: the ones that failed last time go first, then
+// the ones the cache has never seen, then the rest, fastest first within each. Returns whether the order changed.
+static bool schedule_tests(Test tests[], size_t *selected, const size_t k, uint64_t *fingerprints, CacheEntry *cache, const size_t cache_size) {
+    ScheduledTest *schedule = (ScheduledTest *) malloc((k + 1) * sizeof(ScheduledTest));
+    if (!schedule) {
+        return false;
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        const CacheEntry *entry = find_cache_entry(cache, cache_size, test_name_hash(tests + selected[i]));
+
+        schedule[i].index = selected[i];
+        schedule[i].fingerprint = fingerprints[i];
+        schedule[i].group = !entry ? 1 : entry->failed ? 0 : 2;
+        schedule[i].seconds = entry ? entry->seconds : 0.0;
+    }
+
+    qsort(schedule, k, sizeof(ScheduledTest), compare_scheduled);
+
+    bool reordered = false;
+
+    for (size_t i = 0; i < k; ++i) {
+        reordered = reordered || selected[i] != schedule[i].index;
+        selected[i] = schedule[i].index;
+        fingerprints[i] = schedule[i].fingerprint;
+    }
+
+    free(schedule);
+    return reordered;
+}
+
+// Record how the tests that just ran went in the test cache. Entries of tests that did not run are kept, so that every
+// shard and filter can share a cache.
+static void update_test_cache(const char *path, const Test tests[], const size_t *selected, const size_t k, const uint64_t *fingerprints, const CacheEntry *cache, const size_t cache_size) {
+    CacheEntry *entries = (CacheEntry *) malloc((cache_size + k + 1) * sizeof(CacheEntry));
+    if (!entries) {
+        return;
+    }
+
+    memcpy(entries, cache, cache_size * sizeof(CacheEntry));
+    size_t n = cache_size;
+
+    for (size_t i = 0; i < k; ++i) {
+        const Test *test = tests + selected[i];
+
+        // Tests can still be skipped when the run stops early.
+        if (test->skipped) {
+            continue;
+        }
+
+        uint64_t name = test_name_hash(test);
+
+        // Only the loaded entries are sorted, so they are the only ones searched.
+        CacheEntry *entry = find_cache_entry(entries, cache_size, name);
+        if (!entry) {
+            entry = entries + n++;
+            entry->name = name;
+        }
+
+        entry->fingerprint = test->passed ? fingerprints[i] : 0;
+        entry->seconds = test->time;
+        entry->failed = !test->passed;
+    }
+
+    if (!save_test_cache(path, entries, n)) {
+        output_printf("*** [WARNING] Failed to write the test cache \"%s\". ***\n", path);
+    }
+
+    free(entries);
+}
+
+// Run the selected tests of an array, using a runner for an array of tests. Returns false if the runner was not
+// called, because there was no memory to select tests in.
+static bool run_selected_tests(Test tests[], const size_t n, const size_t jobs, void (*runner)(Test tests[], const size_t n, const size_t jobs)) {
+    size_t *selected = (size_t *) malloc((n + 1) * sizeof(size_t));
+    if (!selected) {
+        return false;
+    }
+
+    size_t k = select_tests(tests, n, selected);
+
+    const char *cache_path = test_cache_path ? test_cache_path : getenv("CATOM_TEST_CACHE");
+    CacheEntry *cache = NULL;
+    size_t cache_size = 0;
+    uint64_t *fingerprints = NULL;
+
+    if (cache_path && *cache_path) {
+        fingerprints = (uint64_t *) malloc((k + 1) * sizeof(uint64_t));
+
+        if (fingerprints) {
+            cache_size = load_test_cache(cache_path, &cache);
+            k = skip_cached_tests(tests, selected, k, cache, cache_size, fingerprints);
+        }
+    }
+
+    bool reordered = fingerprints && schedule_tests(tests, selected, k, fingerprints, cache, cache_size);
+    Test *gathered = NULL;
+
+    if (k == n && !reordered) {
+        runner(tests, n, jobs);
+    } else if ((gathered = (Test *) malloc((k + 1) * sizeof(Test)))) {
+        // The runners work on whole arrays, so the selected tests are gathered into one and their results copied back.
+        for (size_t i = 0; i < k; ++i) {
+            gathered[i] = tests[selected[i]];
+        }
+
+        if (k < n) {
+            output_printf("Selected %zu of %zu test%s.\n", k, n, n != 1 ? "s" : "");
+        }
+
+        runner(gathered, k, jobs);
+
+        for (size_t i = 0; i < k; ++i) {
+            tests[selected[i]] = gathered[i];
+        }
+    }
+
+    bool ran = (k == n && !reordered) || gathered;
+
+    if (ran && fingerprints) {
+        update_test_cache(cache_path, tests, selected, k, fingerprints, cache, cache_size);
+    }
+
+    free(gathered);
+    free(cache);
+    free(fingerprints);
+    free(selected);
+    return ran;
+}
+
+// Most failures allowed before the rest of the tests are skipped, or 0 for no limit.
+static size_t failure_limit(void) {
+    const char *limit = getenv("CATOM_MAX_FAILURES");
+    return max_failures > 0 || !limit ? max_failures : (size_t) strtoull(limit, NULL, 10);
+}
+
+// Mark the tests left after a run stopped early as skipped.
+static void skip_remaining_tests(Test tests[], const size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        tests[i].skipped = true;
+        tests[i].passed = false;
+    }
+
+    if (n > 0) {
+        output_printf("Stopped after %zu failure%s, skipping the other %zu test%s.\n", failures, failures != 1 ? "s" : "", n, n != 1 ? "s" : "");
+    }
+}
+
+static void run_tests_sequentially(Test tests[], const size_t n, const size_t jobs __attribute__((unused))) {
+    failures = 0;
+
+    size_t limit = failure_limit();
+    size_t ran = 0;
+
+    output_printf("Running %zu test%s.\n\n", n, n != 1 ? "s" : "");
+    output_flush();
+
+    FILE *report = open_report(test_reporter, test_report_path);
+    if (report) {
+        test_reporter->begin_tests(report);
+    }
+
+    uint64_t start = timer_now(TIMER_WALL);
+
+    for (; ran < n && (limit == 0 || failures < limit); ++ran) {
+        if (quiet_output) {
+            output_hold();
+        }
+
+        output_printf("%s\n[%zu / %zu] ", SEP, ran + 1u, n);
+        __run_test(tests + ran);
+        output_printf("%s\n\n", SEP);
+
+        output_release(!quiet_output || !tests[ran].passed);
+
+        if (report) {
+            test_reporter->test(report, tests + ran, ran);
+        }
+    }
+
+    double time = timer_seconds_since(start);
+
+    skip_remaining_tests(tests + ran, n - ran);
+    output_printf("Tests completed in %f seconds with %zu / %zu passed (%zu failed).\n\n", time, ran - failures, ran, failures);
+    output_flush();
+
+    if (report) {
+        test_reporter->end_tests(report, ran - failures, failures, time);
+        fclose(report);
+    }
+}
+
+/**
+ * What a worker process sends back to its parent about a test.
+ */
+typedef struct {
+    Test test;                      /**< The test and its results, written once it finishes. */
+    const AssertLocation *location; /**< Last assertion the test reached, kept up to date in case it crashes. */
+} TestPayload;
+
+// State shared by the parallel runner's workers and its collector.
+typedef struct {
+    Test *tests;
+    size_t n;
+    FILE *report;
+    size_t limit;
+    size_t collected;
+} ParallelRun;
+
+static void __run_parallel_test(const size_t job, void *payload, void *context) {
+    Test *test = ((ParallelRun *) context)->tests + job;
+    TestPayload *result = (TestPayload *) payload;
+
+    __shared_location = &result->location;
+    __run_test(test);
+    __shared_location = NULL;
+
+    memcpy(&result->test, test, sizeof(Test));
+}
+
+static bool __collect_parallel_test(const size_t job, const JobStatus *status, void *payload, const char *output, const size_t length __attribute__((unused)), void *context) {
+    ParallelRun *run = (ParallelRun *) context;
+    Test *test = run->tests + job;
+    const TestPayload *result = (const TestPayload *) payload;
+
+    if (status->state == JOB_FINISHED) {
+        *test = result->test;
+    } else {
+        test->passed = false;
+    }
+
+    if (!test->passed) {
+        ++failures;
+    }
+
+    if (!quiet_output || !test->passed) {
+        output_printf("%s\n[%zu / %zu] %s", SEP, job + 1u, run->n, output);
+
+        if (status->state == JOB_LOST) {
+            tprinterr("\nTest not run. ", false);
+            output_printf("\"%s\" was not run: every worker process died.\n", test->name);
+        } else if (status->state == JOB_CRASHED) {
+            tprinterr("\nTest crashed. ", false);
+
+            if (status->signal != 0) {
+                output_printf("The worker running \"%s\" was killed by signal %d.\n", test->name, status->signal);
+            } else {
+                output_printf("The worker running \"%s\" exited with code %d.\n", test->name, status->exit_code);
+            }
+
+            // The worker was forked from this process, so the assertion's location is at the same address here.
+            const AssertLocation *location = result->location;
+
+            if (location) {
+                const char *caller = *location->function == '_' ? location->function + 2 : location->function;
+                const char *assert = *location->assert == '_' ? location->assert + 2 : location->assert;
+
+                output_printf("The last assertion it reached was %s in %s at line %d of %s.\n", assert, caller, location->line, location->file);
+            } else {
+                output_printf("It crashed before reaching any assertion.\n");
+            }
+        }
+
+        output_printf("%s\n\n", SEP);
+        output_sync();
+    }
+
+    if (run->report) {
+        test_reporter->test(run->report, test, job);
+    }
+
+    run->collected = job + 1u;
+    return run->limit == 0 || failures < run->limit;
+}
+
+#ifndef OS_WINDOWS
+// Run tests across a number of worker processes, falling back to running them in this one if they can not be started.
+static void run_tests_in_workers(Test tests[], const size_t n, const size_t workers) {
+    failures = 0;
+
+    if (workers > 1) {
+        output_printf("Running %zu test%s across %zu workers.\n\n", n, n != 1 ? "s" : "", workers);
+    } else {
+        output_printf("Running %zu test%s in a worker process.\n\n", n, n != 1 ? "s" : "");
+    }
+
+    FILE *report = open_report(test_reporter, test_report_path);
+    if (report) {
+        test_reporter->begin_tests(report);
+    }
+
+    uint64_t start = timer_now(TIMER_WALL);
+
+    ParallelRun run = { tests, n, report, failure_limit(), 0 };
+    if (!run_job_pool(n, workers, sizeof(TestPayload), __run_parallel_test, __collect_parallel_test, &run)) {
+        if (report) {
+            fclose(report);
+        }
+
+        output_printf("*** [WARNING] Failed to start worker processes. Running tests in this one. ***\n\n");
+        run_tests_sequentially(tests, n, 0);
+        return;
+    }
+
+    double time = timer_seconds_since(start);
+
+    skip_remaining_tests(tests + run.collected, n - run.collected);
+    output_printf("Tests completed in %f seconds with %zu / %zu passed (%zu failed).\n\n", time, run.collected - failures, run.collected, failures);
+    output_flush();
+
+    if (report) {
+        test_reporter->end_tests(report, run.collected - failures, failures, time);
+        fclose(report);
+    }
+}
+#endif
+
+static void run_tests_in_pool(Test tests[], const size_t n, const size_t jobs) {
+#ifdef OS_WINDOWS
+    output_printf("*** [WARNING] Parallel test runs are not supported on Windows. Running tests sequentially. ***\n\n");
+    run_tests_sequentially(tests, n, jobs);
+#else
+    size_t workers = jobs > 0 ? jobs : available_cores();
+    if (workers > n) {
+        workers = n > 0 ? n : 1u;
+    }
+
+    run_tests_in_workers(tests, n, workers);
+#endif
+}
+
+// Run tests one after another in a single worker process, which is replaced if a test crashes it.
+static void run_tests_isolated(Test tests[], const size_t n, const size_t jobs) {
+#ifdef OS_WINDOWS
+    run_tests_sequentially(tests, n, jobs);
+#else
+    (void) jobs;
+    run_tests_in_workers(tests, n, 1);
+#endif
+}
+
+// Should run_tests run tests in a worker process?
+static bool isolation_enabled(void) {
+    const char *isolation = getenv("CATOM_ISOLATION");
+    return isolate_tests && !(isolation && strcmp(isolation, "0") == 0);
+}
+
+void __run_tests(Test tests[], const size_t n) {
+    void (*runner)(Test tests[], const size_t n, const size_t jobs) = isolation_enabled() ? run_tests_isolated : run_tests_sequentially;
+
+    output_install_crash_handlers();
+    start_trace();
+
+    if (!run_selected_tests(tests, n, 0, runner)) {
+        output_printf("*** [WARNING] Failed to allocate space to select tests in. Running every test. ***\n");
+        runner(tests, n, 0);
+    }
+}
+
+void __run_tests_parallel(Test tests[], const size_t n, const size_t jobs) {
+    output_install_crash_handlers();
+    start_trace();
+
+    if (!run_selected_tests(tests, n, jobs, run_tests_in_pool)) {
+        output_printf("*** [WARNING] Failed to allocate space to select tests in. Running every test. ***\n");
+        run_tests_in_pool(tests, n, jobs);
+    }
+}
+
+// Pin the runner and raise its priority, and print what it is running on along with anything that makes the timings
+// less steady.
+static void settle_environment(void) {
+    BenchmarkEnvironment *environment = &benchmark_environment;
+
+    environment->core = environment_pin(benchmark_core);
+    environment->raised_priority = environment_raise_priority();
+
+    // The governor is the one of the processor pinned to.
+    if (environment->core >= 0) {
+        BenchmarkEnvironment pinned;
+        environment_read(&pinned, environment->core);
+
+        memcpy(environment->governor, pinned.governor, sizeof(environment->governor));
+        environment->frequency_scaling = pinned.frequency_scaling;
+    }
+
+    output_printf("Running on %s with %zu processor%s", *environment->cpu_model ? environment->cpu_model : "an unknown CPU", environment->processors, environment->processors != 1 ? "s" : "");
+
+    if (*environment->governor) {
+        output_printf(", the %s governor", environment->governor);
+    }
+
+    if (environment->turbo >= 0) {
+        output_printf(", turbo %s", environment->turbo ? "on" : "off");
+    }
+
+    if (!isnan(environment->load)) {
+        output_printf(" and a load average of %.2f", environment->load);
+    }
+
+    output_printf(".\n");
+
+    if (environment->core >= 0) {
+        output_printf("Pinned to processor %d%s.\n", environment->core, environment->raised_priority ? ", with raised priority" : "");
+    } else {
+        output_printf("*** [WARNING] Could not pin benchmarks to %s. ***\n", benchmark_core >= 0 ? "the processor asked for" : "a processor");
+    }
+
+    if (!environment->raised_priority) {
+        output_printf("The priority of benchmarks could not be raised, which usually needs privileges.\n");
+    }
+
+    if (environment->frequency_scaling) {
+        output_printf("*** [WARNING] The %s governor can change the CPU frequency while benchmarks run. Use the performance governor for steadier timings. ***\n", environment->governor);
+    }
+
+    if (environment->turbo == 1) {
+        output_printf("*** [WARNING] Turbo is on, so the CPU frequency depends on temperature and on the load of the other processors. ***\n");
+    }
+
+    if (environment->load > (double) environment->processors) {
+        output_printf("*** [WARNING] The load average is above the number of processors, so other work is competing with benchmarks. ***\n");
+    }
+
+    output_printf("\n");
+}
+
+// Shuffle an order with a Fisher-Yates shuffle driven by xorshift64, which is plenty for spreading drift around.
+static void shuffle_order(size_t *order, const size_t n, uint64_t *state) {
+    for (size_t i = n; i > 1; --i) {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+
+        size_t j = (size_t) (*state % i);
+        size_t swapped = order[i - 1];
+
+        order[i - 1] = order[j];
+        order[j] = swapped;
+    }
+}
+
+// Time the iterations of every plain and scaled benchmark in rounds, running each once per round and in a new random
+// order every round, so that drift in the machine's speed is spread over all of them instead of landing on whichever
+// ran at the time. Returns the logs of their iterations, indexed like the benchmarks, or NULL if there are fewer than
+// two of them to interleave.
+static IterationLog *interleave_benchmarks(const Benchmark benchmarks[], const size_t n, const size_t warmup, const size_t times) {
+    size_t *order = (size_t *) malloc((n > 0 ? n : 1) * sizeof(size_t));
+    IterationLog *logs = (IterationLog *) calloc(n > 0 ? n : 1, sizeof(IterationLog));
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!benchmarks[i].range && !benchmarks[i].parallel) {
+            ++count;
+        }
+    }
+
+    if (!order || !logs || count < 2) {
+        free(order);
+        free(logs);
+        return NULL;
+    }
+
+    output_printf("Interleaving the iterations of %zu benchmarks.\n\n", count);
+    output_sync();
+
+    in_benchmark = true;
+
+    bool counting = start_counting();
+    count = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!benchmarks[i].range && !benchmarks[i].parallel) {
+            start_benchmark(logs + i, benchmarks + i, warmup + times, counting);
+            order[count++] = i;
+        }
+    }
+
+    uint64_t state = timer_now(TIMER_WALL) | 1u;
+
+    for (size_t round = 0; round < warmup + times; ++round) {
+        shuffle_order(order, count, &state);
+
+        for (size_t k = 0; k < count; ++k) {
+            time_iteration(logs + order[k]);
+        }
+    }
+
+    if (counting) {
+        counters_close();
+    }
+
+    in_benchmark = false;
+
+    free(order);
+    return logs;
+}
+
+void __run_benchmarks(const Benchmark benchmarks[], const size_t n, const size_t warmup, const size_t times) {
+    output_install_crash_handlers();
+    output_printf("Running %zu benchmark%s.\n\n", n, n != 1 ? "s" : "");
+
+    regressions = 0;
+
+    start_trace();
+    environment_read(&benchmark_environment, -1);
+    IterationLog *interleaved = NULL;
+
+    if (control_environment) {
+        settle_environment();
+
+        interleaved = interleave_benchmarks(benchmarks, n, warmup, times);
+        benchmark_environment.interleaved = interleaved != NULL;
+    }
+
+    FILE *report = open_report(benchmark_reporter, benchmark_report_path);
+    if (report) {
+        benchmark_reporter->begin_benchmarks(report, &benchmark_environment);
+    }
+
+    uint64_t total = 0;
+    size_t records = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t regressed = regressions;
+
+        if (quiet_output) {
+            output_hold();
+        }
+
+        output_printf("%s\n[%zu / %zu] ", SEP, i + 1u, n);
+        if (benchmarks[i].range) {
+            total += __run_range_benchmark(benchmarks + i, warmup, times, report, &records);
+        } else if (benchmarks[i].parallel) {
+            // The threads of a team would all be stuck on the processor the runner is pinned to.
+            if (benchmark_environment.core >= 0) {
+                environment_unpin();
+            }
+
+            total += __run_parallel_benchmark(benchmarks + i, warmup, times, report, &records);
+
+            if (benchmark_environment.core >= 0) {
+                environment_pin(benchmark_environment.core);
+            }
+        } else {
+            total += __run_benchmark(benchmarks + i, warmup, times, report, &records, interleaved ? interleaved + i : NULL);
+        }
+        output_printf("%s\n\n", SEP);
+
+        output_release(!quiet_output || regressions > regressed);
+        output_sync();
+
+        flush_trace();
+    }
+
+    output_printf("Benchmarks completed in %f seconds.\n\n", (double) total / 1e9);
+
+    if (baseline_size > 0) {
+        output_printf("%zu benchmark%s regressed against the baseline.\n\n", regressions, regressions != 1 ? "s" : "");
+    }
+
+    output_flush();
+
+    free(interleaved);
+
+    if (control_environment) {
+        environment_unpin();
+        environment_lower_priority();
+    }
+
+    if (report) {
+        benchmark_reporter->end_benchmarks(report, regressions, (double) total / 1e9);
+        fclose(report);
+    }
+}
+
+// The registries of tests and benchmarks defined with the macros. ELF linkers define symbols for the start and end of
+// every section named like an identifier; they are weak so that programs without any still link. On Windows, a
+// marker is placed before and after the entries instead.
 #ifdef OS_WINDOWS
-static int __lloac_back = -1;
+static Test tests_marker __attribute__((section(".catom_tests$a"), used, aligned(__alignof__(Test))));
+static Test tests_stop[1] __attribute__((section(".catom_tests$z"), used, aligned(__alignof__(Test))));
+static Benchmark benchmarks_marker __attribute__((section(".catom_benchmarks$a"), used, aligned(__alignof__(Benchmark))));
+static Benchmark benchmarks_stop[1] __attribute__((section(".catom_benchmarks$z"), used, aligned(__alignof__(Benchmark))));
+
+#define tests_start (&tests_marker + 1)
+#define benchmarks_start (&benchmarks_marker + 1)
+#else
+extern Test __start_catom_tests[] __attribute__((weak));
+extern Test __stop_catom_tests[] __attribute__((weak));
+extern Benchmark __start_catom_benchmarks[] __attribute__((weak));
+extern Benchmark __stop_catom_benchmarks[] __attribute__((weak));
+
+#define tests_start __start_catom_tests
+#define tests_stop __stop_catom_tests
+#define benchmarks_start __start_catom_benchmarks
+#define benchmarks_stop __stop_catom_benchmarks
 #endif
 
-// Printing utilities.
-static void print_obj_hashes(const char *format, const void *obj1, const void *obj2, size_t size) {
-    if (get_verbose_print_status()) {
-        uint64_t oh1 = obj_hash(obj1, size);
-        uint64_t oh2 = obj_hash(obj2, size);
-        vbprintf(stderr, format, oh1, oh2);
+// Order entries of a registry by where they were defined, then by name for any defined on the same line.
+static int compare_definitions(const char *file_a, const int line_a, const char *name_a, const char *file_b, const int line_b, const char *name_b) {
+    int files = strcmp(file_a ? file_a : "", file_b ? file_b : "");
+    if (files != 0) {
+        return files;
+    }
+
+    if (line_a != line_b) {
+        return line_a < line_b ? -1 : 1;
+    }
+
+    return strcmp(name_a, name_b);
+}
+
+static int compare_registered_tests(const void *a, const void *b) {
+    const Test *x = (const Test *) a;
+    const Test *y = (const Test *) b;
+    return compare_definitions(x->file, x->line, x->name, y->file, y->line, y->name);
+}
+
+static int compare_registered_benchmarks(const void *a, const void *b) {
+    const Benchmark *x = (const Benchmark *) a;
+    const Benchmark *y = (const Benchmark *) b;
+    return compare_definitions(x->file, x->line, x->name, y->file, y->line, y->name);
+}
+
+// The registries are sorted into copies, which are kept for the rest of the program so that results stay in them. The
+// variables the macros name are left holding their own tests and benchmarks.
+static Test *sorted_tests = NULL;
+static Benchmark *sorted_benchmarks = NULL;
+
+Test *registered_tests(size_t *n) {
+    *n = tests_start && tests_stop > tests_start ? (size_t) (tests_stop - tests_start) : 0;
+
+    if (!sorted_tests && *n > 0 && (sorted_tests = (Test *) malloc(*n * sizeof(Test)))) {
+        memcpy(sorted_tests, tests_start, *n * sizeof(Test));
+        qsort(sorted_tests, *n, sizeof(Test), compare_registered_tests);
+    }
+
+    // Without the memory to sort them in, the registry is given as it is.
+    return sorted_tests ? sorted_tests : tests_start;
+}
+
+Benchmark *registered_benchmarks(size_t *n) {
+    *n = benchmarks_start && benchmarks_stop > benchmarks_start ? (size_t) (benchmarks_stop - benchmarks_start) : 0;
+
+    if (!sorted_benchmarks && *n > 0 && (sorted_benchmarks = (Benchmark *) malloc(*n * sizeof(Benchmark)))) {
+        memcpy(sorted_benchmarks, benchmarks_start, *n * sizeof(Benchmark));
+        qsort(sorted_benchmarks, *n, sizeof(Benchmark), compare_registered_benchmarks);
+    }
+
+    return sorted_benchmarks ? sorted_benchmarks : benchmarks_start;
+}
+
+size_t count_failures(const Test tests[], const size_t n) {
+    size_t fails = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!tests[i].passed && !tests[i].skipped) {
+            ++fails;
+        }
     }
+
+    return fails;
 }
 
-// Internal assertion function.
-static jmp_buf env;
-static size_t failures = 0;
-static bool in_benchmark = false;
-static bool in_timed = false;
+// Property tests.
 
-void reset_failures(void) {
-    failures = 0u;
-}
+/**
+ * The property a property test is checking.
+ */
+typedef struct {
+    TestFunction property; /**< Body of the test. */
+} PropertyRun;
 
-static void fail_test(void) {
-    ++failures;
-    longjmp(env, 1);
-}
+// The shrunk inputs of the last property to fail, which are replayed to report the failure.
+static uint64_t *shrunk_choices = NULL;
 
-// This is defined separately at the bottom of the file.
-static inline void fail_timed_test(void);
+// Run one case of a property, returning whether it failed.
+static bool property_fails(void *context) {
+    jmp_buf jump;
+    volatile bool failed = true;
 
-#define __test_assert__(cond) if (!(cond)) {\
-    if (Message.width == NARROW) {\
-        fwprintf(stderr, L"\n[%s] Assertion Failed. %s failed in %s at line %d:\n%s",\
-                __last_assert_caller_file,\
-                __last_assert_used,\
-                __last_assert_caller,\
-                __last_line_of_assert_caller,\
-                Message.__msg.__message\
-        );\
-    } else {\
-        fwprintf(stderr, L"\n[%s] Assertion Failed. %s failed in %s at line %d:\n%ls",\
-                __last_assert_caller_file,\
-                __last_assert_used,\
-                __last_assert_caller,\
-                __last_line_of_assert_caller,\
-                Message.__msg.__wessage\
-        );\
-    }\
-    if (in_benchmark) {\
-        fwprintf(stderr, L"\n*** [WARNING] Do not use asserts inside a benchmark or timed test! ***\n");\
-    } else if (in_timed) {\
-        fail_timed_test();\
-    } else {\
-        fail_test();\
-    }\
-}
+    property_case = &jump;
 
-// Generalised add-one-to-int-array.
-void add_one(size_t *nums, const size_t ns[], const size_t where, const size_t max) {
-    if (where < max && ++nums[where] >= ns[where]) {
-        nums[where] = 0;
-        add_one(nums, ns, where - 1, max);
+    if (setjmp(jump) == 0) {
+        ((PropertyRun *) context)->property();
+        failed = false;
     }
+
+    property_case = NULL;
+    return failed;
 }
 
-// Comparison of arrays function.
-void compare_arrays(const void *arr1, const void *arr2, const bool arr1isptp, const bool arr2isptp, const size_t size, const size_t argn, const size_t ns[], const MemoryValidator validator) {
-    size_t *current = (size_t *) alloca(argn * sizeof(size_t));
-    if (!current) {
-        fwprintf(stderr, L"*** [WARNING] Comparison of arrays failed to allocate enough memory. ***\n");
-    }
+static uint64_t pick_property_seed(void) {
+    const char *seed = getenv("CATOM_SEED");
 
-    memset(current, 0, argn * sizeof(size_t));
+    if (property_seed != 0) {
+        return property_seed;
+    }
 
-    size_t total_items = ns[0];
-    for (size_t i = 1; i < argn; ++i) {
-        total_items *= ns[i];
+    if (seed && *seed) {
+        return (uint64_t) strtoull(seed, NULL, 10);
     }
 
-    for (size_t i = 0; i < total_items; ++i) {
-        const void *i1 = get(arr1, arr1isptp, size, ns, argn, current);
-        const void *i2 = get(arr2, arr2isptp, size, ns, argn, current);
+    return timer_now(TIMER_WALL) * 0x9E3779B97F4A7C15ull + (uint64_t) time(NULL);
+}
+
+void __run_property(const TestFunction property, const size_t cases) {
+    PropertyRun run = { property };
+    uint64_t seed = pick_property_seed();
 
-        if (!validator(i1, i2, size)) {
-            __test_assert__(validator(i1, i2, size));
-        }
+    log_generated = false;
+    free(shrunk_choices);
+    shrunk_choices = NULL;
 
-        add_one(current, ns, argn - 1, argn);
-    }
-}
+    for (size_t i = 0; i < cases; ++i) {
+        // Every case gets a seed of its own, so that the seed of the run gives the same cases in the same order.
+        choices_generate(seed + i);
 
-// Comparison of arrays function.
-void compare_arrays_some(const void *arr1, const void *arr2, const bool arr1isptp, const bool arr2isptp, const size_t size, const size_t argn, const size_t ns[], const MemoryValidator validator) {
-    size_t *current = (size_t *) alloca(argn * sizeof(size_t));
-    if (!current) {
-        fwprintf(stderr, L"*** [WARNING] Comparison of arrays failed to allocate enough memory. ***\n");
-    }
+        if (!property_fails(&run)) {
+            continue;
+        }
 
-    memset(current, 0, argn * sizeof(size_t));
+        size_t n;
+        const uint64_t *made = choices_made(&n);
 
-    size_t total_items = ns[0];
-    for (size_t i = 1; i < argn; ++i) {
-        total_items *= ns[i];
-    }
+        shrunk_choices = (uint64_t *) malloc((n + 1) * sizeof(uint64_t));
+        size_t steps = 0;
 
-    size_t matches = 0;
+        if (shrunk_choices) {
+            memcpy(shrunk_choices, made, n * sizeof(uint64_t));
+            n = shrink_choices(&shrunk_choices, n, property_fails, &run, &steps);
+        } else {
+            output_printf("*** [WARNING] Failed to allocate space to shrink the failing case in. ***\n");
+            choices_generate(seed + i);
+        }
 
-    for (size_t i = 0; i < total_items; ++i) {
-        const void *i1 = get(arr1, arr1isptp, size, ns, argn, current);
-        const void *i2 = get(arr2, arr2isptp, size, ns, argn, current);
+        output_printf("\nFalsified by case %zu of %zu, shrunk %zu time%s. Rerun it with CATOM_SEED=%" PRIu64 ". Inputs:\n", i + 1, cases, steps, steps != 1 ? "s" : "", seed);
 
-        if (validator(i1, i2, size)) {
-            return;
+        // Replayed outside of a case, so that its assertion fails the test as any other would, and with the inputs
+        // printed as they are generated.
+        if (shrunk_choices) {
+            choices_replay(shrunk_choices, n);
         }
 
-        add_one(current, ns, argn - 1, argn);
+        log_generated = true;
+        property();
+        log_generated = false;
+
+        output_printf("\n*** [WARNING] The property held when its shrunk inputs were replayed, so it depends on more than them. ***\n");
+        choices_release();
+        fail_test();
     }
 
-    __test_assert__(matches > 0);
+    choices_release();
 }
 
-// Test runner utilities.
-void __set_last_file(const char *filename) {
-    strncpy(__last_assert_caller_file, filename, MAX_STR_LEN);
+static uint64_t draw_uint(const uint64_t min, const uint64_t max) {
+    return min < max ? min + choices_draw(max - min) : min;
 }
 
-void __set_last_caller(const char *caller) {
-    strncpy(__last_assert_caller, caller, MAX_STR_LEN);
-}
+// Values are drawn alternately above and below the one closest to 0 while there is room on both sides, and then from
+// whichever side has room left, so that smaller choices give values closer to 0.
+static int64_t draw_int(const int64_t min, const int64_t max) {
+    if (min >= max) {
+        return min;
+    }
 
-void __set_last_assert(const char *assert) {
-    strncpy(__last_assert_used, assert, MAX_STR_LEN);
-}
+    int64_t closest = min > 0 ? min : max < 0 ? max : 0;
+    uint64_t above = (uint64_t) max - (uint64_t) closest;
+    uint64_t below = (uint64_t) closest - (uint64_t) min;
+    uint64_t both = above < below ? above : below;
+    uint64_t choice = choices_draw(above + below);
 
-void __set_last_line(const int line) {
-#ifdef OS_WINDOWS
-    if (in_timed && __lloac_back < 0 && __last_line_of_assert_caller > 0) {
-        __lloac_back = __last_line_of_assert_caller;
+    if (choice > 2 * both) {
+        uint64_t offset = choice - both;
+        return above > below ? (int64_t) ((uint64_t) closest + offset) : (int64_t) ((uint64_t) closest - offset);
     }
-#endif
-    __last_line_of_assert_caller = line;
+
+    return choice % 2 == 1 ? (int64_t) ((uint64_t) closest + (choice + 1) / 2) : (int64_t) ((uint64_t) closest - choice / 2);
 }
 
-void use_verbose_print(const bool should_use) {
-    set_verbose_print_status(should_use);
+static double draw_double(const double min, const double max) {
+    const uint64_t steps = (uint64_t) 1 << 53;
+    return min + (max - min) * ((double) choices_draw(steps - 1) / (double) steps);
 }
 
-static void __run_test(Test *test) {
-    fwprintf(stderr, get_verbose_print_status() ? L"Running test \"%s\":\n\n" : L"Running test \"%s\":\n", test->name);
+// Draw how many elements an array has. Each element is preceded by a choice of whether there is one, so that deleting
+// both drops the element while shrinking, but lengths are still spread evenly when generating.
+static bool draw_another(const size_t i, const size_t planned) {
+    return choices_draw_planned(1, i < planned) == 1;
+}
 
-    clock_t time = clock();
+static size_t plan_length(const size_t max_n) {
+    return max_n < SIZE_MAX ? (size_t) (choices_random() % ((uint64_t) max_n + 1)) : (size_t) choices_random();
+}
 
-    if (setjmp(env) == 0) {
-        test->test();
-        tprinterr("\nTest passed. ", true);
-        test->passed = true;
-    } else {
-        tprinterr("\nTest failed. ", false);
-        test->passed = false;
+uint64_t gen_uint(const uint64_t min, const uint64_t max) {
+    uint64_t value = draw_uint(min, max);
+
+    if (log_generated) {
+        output_printf("  gen_uint(%" PRIu64 ", %" PRIu64 ") = %" PRIu64 "\n", min, max, value);
     }
 
-    time = clock() - time;
+    return value;
+}
 
-    fwprintf(stderr, L"\"%s\" terminated in %f seconds.\n",
-        test->name, (double) time / CLOCKS_PER_SEC
-    );
+int64_t gen_int(const int64_t min, const int64_t max) {
+    int64_t value = draw_int(min, max);
 
-    testfunc_freeall();
+    if (log_generated) {
+        output_printf("  gen_int(%" PRId64 ", %" PRId64 ") = %" PRId64 "\n", min, max, value);
+    }
+
+    return value;
 }
 
-static clock_t __run_benchmark(const Benchmark *benchmark, const size_t warmup, const size_t times) {
-    in_benchmark = true;
+bool gen_bool(void) {
+    bool value = choices_draw(1) == 1;
 
-    fwprintf(stderr, L"Running benchmark \"%s\":\n\n", benchmark->name);
+    if (log_generated) {
+        output_printf("  gen_bool() = %s\n", value ? "true" : "false");
+    }
 
-    clock_t total_time = 0;
-    clock_t with_wm = 0;
+    return value;
+}
 
-    for (size_t i = 0; i < warmup + times; ++i) {
-        if (i < warmup) {
-            fwprintf(stderr, L"Running warmup iteration %zu / %zu. ", i + 1, warmup);
-        } else {
-            fwprintf(stderr, L"Running benchmark iteration %zu / %zu. ", i - warmup + 1, times);
-        }
+double gen_double(const double min, const double max) {
+    double value = draw_double(min, max);
 
-        clock_t time_taken = clock();
-        benchmark->benchmark();
-        time_taken = clock() - time_taken;
+    if (log_generated) {
+        output_printf("  gen_double(%.17g, %.17g) = %.17g\n", min, max, value);
+    }
 
-        if (i >= warmup) {
-            total_time += time_taken;
-            fwprintf(stderr, L"Finished benchmark iteration %zu / %zu in %f seconds.\n", i - warmup + 1, times, (double) time_taken / CLOCKS_PER_SEC);
-        } else {
-            fwprintf(stderr, L"Finished warmup iteration %zu / %zu in %f seconds.\n", i + 1, warmup, (double) time_taken / CLOCKS_PER_SEC);
-        }
+    return value;
+}
 
-        with_wm += time_taken;
+float gen_float(const float min, const float max) {
+    float value = (float) draw_double(min, max);
+
+    if (log_generated) {
+        output_printf("  gen_float(%.9g, %.9g) = %.9g\n", (double) min, (double) max, (double) value);
     }
 
-    in_benchmark = false;
+    return value;
+}
 
-    fwprintf(stderr, L"\nBenchmark complete.\n\"%s\" finished %zu iterations (and %zu warmup iterations) in %f seconds (%f seconds with warmup).\nIt took %f seconds on average to run (%f seconds average with warmup).\n",
-        benchmark->name,
-        times,
-        warmup,
-        (double) total_time / CLOCKS_PER_SEC,
-        (double) with_wm / CLOCKS_PER_SEC,
-        (double) total_time / (times * CLOCKS_PER_SEC),
-        (double) with_wm / ((times + warmup) * CLOCKS_PER_SEC)
-    );
+// Most elements of a generated buffer or array that are printed with the inputs of a failing case.
+#define MAX_LOGGED_ELEMENTS 32
 
-    return with_wm;
-}
+uint8_t *gen_bytes(const size_t max_length, size_t *length) {
+    uint8_t *bytes = (uint8_t *) choices_alloc(max_length);
+    size_t planned = plan_length(max_length);
 
-void __run_tests(Test tests[], const size_t n) {
-    failures = 0;
+    *length = 0;
+    while (bytes && *length < max_length && draw_another(*length, planned)) {
+        bytes[(*length)++] = (uint8_t) choices_draw(UINT8_MAX);
+    }
 
-    fwprintf(stderr, L"Running %zu test%s.\n\n", n, n != 1 ? "s" : "");
+    if (log_generated) {
+        output_printf("  gen_bytes(%zu) = %zu bytes {", max_length, *length);
 
-    clock_t time;
-    time = clock();
+        for (size_t i = 0; i < *length && i < MAX_LOGGED_ELEMENTS; ++i) {
+            output_printf(" %02x", bytes[i]);
+        }
 
-    for (size_t i = 0; i < n; ++i) {
-        fwprintf(stderr, L"%s\n[%zu / %zu] ", SEP, i + 1u, n);
-        __run_test(tests + i);
-        fwprintf(stderr, L"%s\n\n", SEP);
+        output_printf(*length > MAX_LOGGED_ELEMENTS ? " ... }\n" : " }\n");
     }
 
-    time = clock() - time;
-
-    fwprintf(stderr, L"Tests completed in %f seconds with %zu / %zu passed (%zu failed).\n\n", (double) time / CLOCKS_PER_SEC, n - failures, n, failures);
+    return bytes;
 }
 
-void __run_benchmarks(const Benchmark benchmarks[], const size_t n, const size_t warmup, const size_t times) {
-    fwprintf(stderr, L"Running %zu benchmark%s.\n\n", n, n != 1 ? "s" : "");
+int64_t *gen_int_array(const size_t max_n, const int64_t min, const int64_t max, size_t *n) {
+    int64_t *array = (int64_t *) choices_alloc(max_n * sizeof(int64_t));
+    size_t planned = plan_length(max_n);
+
+    *n = 0;
+    while (array && *n < max_n && draw_another(*n, planned)) {
+        array[(*n)++] = draw_int(min, max);
+    }
 
-    clock_t total = 0;
+    if (log_generated) {
+        output_printf("  gen_int_array(%zu, %" PRId64 ", %" PRId64 ") = %zu elements {", max_n, min, max, *n);
 
-    for (size_t i = 0; i < n; ++i) {
-        fwprintf(stderr, L"%s\n[%zu / %zu] ", SEP, i + 1u, n);
-        total += __run_benchmark(benchmarks + i, warmup, times);
-        fwprintf(stderr, L"%s\n\n", SEP);
+        for (size_t i = 0; i < *n && i < MAX_LOGGED_ELEMENTS; ++i) {
+            output_printf(" %" PRId64, array[i]);
+        }
+
+        output_printf(*n > MAX_LOGGED_ELEMENTS ? " ... }\n" : " }\n");
     }
 
-    fwprintf(stderr, L"Benchmarks completed in %f seconds.\n\n", (double) total / CLOCKS_PER_SEC);
+    return array;
 }
 
-size_t count_failures(const Test tests[], const size_t n) {
-    size_t fails = 0;
-    for (size_t i = 0; i < n; ++i) {
-        if (!tests[i].passed) {
-            ++fails;
+double *gen_double_array(const size_t max_n, const double min, const double max, size_t *n) {
+    double *array = (double *) choices_alloc(max_n * sizeof(double));
+    size_t planned = plan_length(max_n);
+
+    *n = 0;
+    while (array && *n < max_n && draw_another(*n, planned)) {
+        array[(*n)++] = draw_double(min, max);
+    }
+
+    if (log_generated) {
+        output_printf("  gen_double_array(%zu, %.17g, %.17g) = %zu elements {", max_n, min, max, *n);
+
+        for (size_t i = 0; i < *n && i < MAX_LOGGED_ELEMENTS; ++i) {
+            output_printf(" %.17g", array[i]);
         }
+
+        output_printf(*n > MAX_LOGGED_ELEMENTS ? " ... }\n" : " }\n");
     }
 
-    return fails;
+    return array;
 }
 
 // Checker functions for the test suite.
 void __assert_true(const bool condition) {
-    vbprintf(stderr, "BOOL is TRUE: %d?\n", condition);
-    __test_assert__(condition);
+    __test_assert__(condition, "BOOL is TRUE: %d?\n", condition);
 }
 
 void __assert_false(const bool condition) {
-    vbprintf(stderr, "BOOL is FALSE: %d?\n", condition);
-    __test_assert__(!condition);
+    __test_assert__(!condition, "BOOL is FALSE: %d?\n", condition);
 }
 
 void __assert_uint_equals(uint64_t a, uint64_t b) {
-    vbprintf(stderr, "UINT EQ: %lu == %lu?\n", a, b);
-    __test_assert__(a == b);
+    __test_assert__(a == b, "UINT EQ: %lu == %lu?\n", a, b);
 }
 
 void __assert_uint_not_equals(uint64_t a, uint64_t b) {
-    vbprintf(stderr, "UINT NEQ: %lu != %lu?\n", a, b);
-    __test_assert__(a != b);
+    __test_assert__(a != b, "UINT NEQ: %lu != %lu?\n", a, b);
 }
 
 void __assert_sint_equals(int64_t a, int64_t b) {
-    vbprintf(stderr, "SINT EQ: %ld == %ld?\n", a, b);
-    __test_assert__(a == b);
+    __test_assert__(a == b, "SINT EQ: %ld == %ld?\n", a, b);
 }
 
 void __assert_sint_not_equals(int64_t a, int64_t b) {
-    vbprintf(stderr, "SINT NEQ: %ld != %ld?\n", a, b);
-    __test_assert__(a != b);
+    __test_assert__(a != b, "SINT NEQ: %ld != %ld?\n", a, b);
 }
 
 void __assert_float_equals(float a, float b, float epsilon) {
-    vbprintf(stderr, "FLOAT EQ: %f == %f (eps = %f)?\n", a, b, epsilon);
     float d = a - b;
-    __test_assert__(d > -epsilon && d < epsilon);
+    __test_assert__(d > -epsilon && d < epsilon, "FLOAT EQ: %f == %f (eps = %f)?\n", a, b, epsilon);
 }
 
 void __assert_float_not_equals(float a, float b, float epsilon) {
-    vbprintf(stderr, "FLOAT NEQ: %f != %f (eps = %f)?\n", a, b, epsilon);
     float d = a - b;
-    __test_assert__(d <= -epsilon || d >= epsilon);
+    __test_assert__(d <= -epsilon || d >= epsilon, "FLOAT NEQ: %f != %f (eps = %f)?\n", a, b, epsilon);
 }
 
 void __assert_double_equals(double a, double b, double epsilon) {
-    vbprintf(stderr, "DOUBLE EQ: %f == %f (eps = %f)?\n", a, b, epsilon);
     double d = a - b;
-    __test_assert__(d > -epsilon && d < epsilon);
+    __test_assert__(d > -epsilon && d < epsilon, "DOUBLE EQ: %f == %f (eps = %f)?\n", a, b, epsilon);
 }
 
 void __assert_double_not_equals(double a, double b, double epsilon) {
-    vbprintf(stderr, "DOUBLE NEQ: %f != %f (eps = %f)?\n", a, b, epsilon);
     double d = a - b;
-    __test_assert__(d <= -epsilon || d >= epsilon);
+    __test_assert__(d <= -epsilon || d >= epsilon, "DOUBLE NEQ: %f != %f (eps = %f)?\n", a, b, epsilon);
+}
+
+void __assert_float_array_near(const float *arr1, const float *arr2, const size_t n, const ToleranceMode mode, const double tolerance) {
+    double error = float_array_max_error(arr1, arr2, n, mode);
+    __test_assert__(error <= tolerance, "FLOAT ARR NEAR: max %s error %g <= %g?\n%s", tolerance_mode_name(mode), error, tolerance, describe_float_errors(arr1, arr2, n, mode, tolerance));
+}
+
+void __assert_double_array_near(const double *arr1, const double *arr2, const size_t n, const ToleranceMode mode, const double tolerance) {
+    double error = double_array_max_error(arr1, arr2, n, mode);
+    __test_assert__(error <= tolerance, "DOUBLE ARR NEAR: max %s error %g <= %g?\n%s", tolerance_mode_name(mode), error, tolerance, describe_double_errors(arr1, arr2, n, mode, tolerance));
 }
 
 void __assert_string_equals(const char *str1, const char *str2) {
-    vbprintf(stderr, "STRING EQ: \"%s\" == \"%s\"?\n", str1, str2);
-    __test_assert__(strcmp(str1, str2) == 0);
+    __test_assert__(strcmp(str1, str2) == 0, "STRING EQ: \"%s\" == \"%s\"?\n", str1, str2);
 }
 
 void __assert_string_not_equals(const char *str1, const char *str2) {
-    vbprintf(stderr, "STRING NEQ: \"%s\" != \"%s\"?\n", str1, str2);
-    __test_assert__(strcmp(str1, str2) != 0);
+    __test_assert__(strcmp(str1, str2) != 0, "STRING NEQ: \"%s\" != \"%s\"?\n", str1, str2);
 }
 
 void __assert_wide_string_equals(const wchar_t *str1, const wchar_t *str2) {
-    vbwprintf(stderr, L"WIDE STRING EQ: \"%ls\" == \"%ls\"?\n", str1, str2);
-    __test_assert__(wcscmp(str1, str2) == 0);
+    __test_wide_assert__(wcscmp(str1, str2) == 0, L"WIDE STRING EQ: \"%ls\" == \"%ls\"?\n", str1, str2);
 }
 
 void __assert_wide_string_not_equals(const wchar_t *str1, const wchar_t *str2) {
-    vbwprintf(stderr, L"WIDE STRING NEQ: \"%ls\" != \"%ls\"?\n", str1, str2);
-    __test_assert__(wcscmp(str1, str2) != 0);
+    __test_wide_assert__(wcscmp(str1, str2) != 0, L"WIDE STRING NEQ: \"%ls\" != \"%ls\"?\n", str1, str2);
 }
 
 void __assert_equals(const void *obj1, const void *obj2, const size_t size) {
-    print_obj_hashes("OBJ EQ: %"PRIx64" == %"PRIx64"?\n", obj1, obj2, size);
-    __test_assert__(memcmp(obj1, obj2, size) == 0);
+    __test_assert__(memcmp(obj1, obj2, size) == 0, "OBJ EQ: %"PRIx64" == %"PRIx64"?\n", obj_hash(obj1, size), obj_hash(obj2, size));
 }
 
 void __assert_not_equals(const void *obj1, const void *obj2, const size_t size) {
-    print_obj_hashes("OBJ NEQ: %"PRIx64" == %"PRIx64"?\n", obj1, obj2, size);
-    __test_assert__(memcmp(obj1, obj2, size) != 0);
+    __test_assert__(memcmp(obj1, obj2, size) != 0, "OBJ NEQ: %"PRIx64" == %"PRIx64"?\n", obj_hash(obj1, size), obj_hash(obj2, size));
 }
 
 void __assert_array_equals(const void *arr1, const void *arr2, const size_t n, const size_t size) {
-    print_obj_hashes("ARR EQ: %"PRIx64" == %"PRIx64"?\n", arr1, arr2, n * size);
+    // The items are contiguous, so the whole array can be compared in one go.
+    size_t offset = first_mismatch(arr1, arr2, n * size);
+    size_t index = size > 0 ? offset / size : 0;
 
-    for (size_t i = 0; i < n; ++i) {
-        __test_assert__(memcmp((uint8_t *) arr1 + (i * size), (uint8_t *) arr2 + (i * size), size) == 0);
-    }
+    __test_assert__(offset == n * size, "ARR EQ: %"PRIx64" == %"PRIx64"?\n%s", obj_hash(arr1, n * size), obj_hash(arr2, n * size), describe_mismatch(offset < n * size, 1, &index));
 }
 
 void __assert_array_not_equals(const void *arr1, const void *arr2, const size_t n, const size_t size) {
-    print_obj_hashes("ARR NEQ: %"PRIx64" == %"PRIx64"?\n", arr1, arr2, n * size);
-
-    for (size_t i = 0; i < n * size; ++i) {
-        if (memcmp((uint8_t *) arr1 + i, (uint8_t *) arr2 + i, size) != 0) {
-            return;
-        }
-    }
-
-    __test_assert__(false);
+    __test_assert__(first_mismatch(arr1, arr2, n * size) < n * size, "ARR NEQ: %"PRIx64" == %"PRIx64"?\n", obj_hash(arr1, n * size), obj_hash(arr2, n * size));
 }
 
 void __assert_deep_array_equals(const void *arr1, const void *arr2, const bool arr1isptp, const bool arr2isptp, const size_t size, const size_t argn, const size_t ns[]) {
-    vbprintf(stderr, "DEEP ARR EQ: @%zx and @%zx?\n", (size_t) arr1, (size_t) arr2);
-    compare_arrays(arr1, arr2, arr1isptp, arr2isptp, size, argn, ns, memory_is_equals);
+    size_t *where = (size_t *) alloca(argn * sizeof(size_t));
+    bool differs = deep_first_mismatch(arr1, arr2, arr1isptp, arr2isptp, size, argn, ns, where);
+
+    __test_assert__(!differs, "DEEP ARR EQ: @%zx and @%zx?\n%s", (size_t) arr1, (size_t) arr2, describe_mismatch(differs, argn, where));
 }
 
 void __assert_deep_array_not_equals(const void *arr1, const void *arr2, const bool arr1isptp, const bool arr2isptp, const size_t size, const size_t argn, const size_t ns[]) {
-    vbprintf(stderr, "DEEP ARR NEQ: @%zx and @%zx?\n", (size_t) arr1, (size_t) arr2);
-    compare_arrays_some(arr1, arr2, arr1isptp, arr2isptp, size, argn, ns, memory_is_not_equals);
+    size_t *where = (size_t *) alloca(argn * sizeof(size_t));
+
+    __test_assert__(deep_first_mismatch(arr1, arr2, arr1isptp, arr2isptp, size, argn, ns, where), "DEEP ARR NEQ: @%zx and @%zx?\n", (size_t) arr1, (size_t) arr2);
 }
 
 void __assert_not_null(const void *ptr) {
-    vbprintf(stderr, "PTR not NULL: %zu != %zu?\n", (size_t) ptr, (size_t) NULL);
-    __test_assert__(ptr);
+    __test_assert__(ptr, "PTR not NULL: %zu != %zu?\n", (size_t) ptr, (size_t) NULL);
 }
 
 void __assert_null(const void *ptr) {
-    vbprintf(stderr, "PTR is NULL: %zu == %zu?\n", (size_t) ptr, (size_t) NULL);
-    __test_assert__(!ptr);
+    __test_assert__(!ptr, "PTR is NULL: %zu == %zu?\n", (size_t) ptr, (size_t) NULL);
+}
+
+void __assert_matches_snapshot(const void *buf, const size_t size, const char *name) {
+    SnapshotCheck check;
+    check_snapshot(buf, size, name, &check);
+
+    bool matches = check.result == SNAPSHOT_CONFIRMED || check.result == SNAPSHOT_MATCHED || check.result == SNAPSHOT_UPDATED;
+    __test_assert__(matches, "SNAPSHOT \"%s\" MATCHES %zu BYTES?\n%s", name, size, describe_snapshot(&check));
+}
+
+void __assert_max_allocations(const size_t n) {
+    size_t allocations = get_allocation_stats()->allocations;
+
+    __test_assert__(allocations <= n, "ALLOCATIONS: %zu <= %zu?\n", allocations, n);
+}
+
+void __assert_max_allocated_bytes(const size_t bytes) {
+    size_t allocated = get_allocation_stats()->allocated_bytes;
+
+    __test_assert__(allocated <= bytes, "ALLOCATED BYTES: %zu <= %zu?\n", allocated, bytes);
+}
+
+void __assert_peak_memory_below(const size_t bytes) {
+    size_t peak = get_allocation_stats()->peak_bytes;
+
+    __test_assert__(peak < bytes, "PEAK BYTES: %zu < %zu?\n", peak, bytes);
 }
 
 void __assert_time_limit(const TestFunction func, double time_limit) {
-    clock_t time = clock();
+    uint64_t start = timer_now(TIMER_WALL);
     func();
-    time = clock() - time;
 
-    __test_assert__((double) time / CLOCKS_PER_SEC <= (double) time_limit);
+    double seconds = timer_seconds_since(start);
+    __test_assert__(seconds <= time_limit, "FUNCTION EXITS IN %lf SECONDS (took %lf)?\n", time_limit, seconds);
 }
 
 // Implementations of async time limit assertion.
@@ -440,77 +2616,75 @@ static TestFunction __running_testfunc__;
 
 static HANDLE test_thread = NULL;
 
+static bool __passing_tt__ = true;
+static bool __cancelled_tt__ = false;
+
 static DWORD WINAPI __testfunc_runner__(void *param __attribute__((unused))) {
+    // Assertions made on this thread belong to the timed function.
+    in_timed = true;
     __running_testfunc__();
     return 0;
 }
 
-static bool __passing_tt__ = true;
-
 static inline void fail_timed_test(void) {
+    // This runs on the timed thread itself, so it can exit cleanly instead of being terminated.
     __passing_tt__ = false;
-    TerminateThread(test_thread, -1);
+    ExitThread(1);
+}
+
+bool timed_test_cancelled(void) {
+    return ATOMIC_LOAD(&__cancelled_tt__);
 }
 
 void __assert_time_limit_async(const TestFunction func, double time_limit) {
-    // Initialise our variables and semaphores.
+    // Initialise our variables.
     __running_testfunc__ = func;
-    DWORD exit_code = -1;
-
-    // We're in a timed test here.
     __passing_tt__ = true;
-    in_timed = true;
+    ATOMIC_STORE(&__cancelled_tt__, false);
 
-    // Create our new thread and wait for the semaphore.
+    // Create our new thread and wait for it to finish.
     test_thread = CreateThread(NULL, 0, __testfunc_runner__, NULL, 0, NULL);
     DWORD test_result = WaitForSingleObject(test_thread, time_limit * 1000);
 
-    // Terminate thread and free up resources.
-    if (test_result != WAIT_OBJECT_0) {
+    // Ask the thread to stop, and only terminate it if it does not do so in time.
+    if (test_result == WAIT_TIMEOUT) {
+        ATOMIC_STORE(&__cancelled_tt__, true);
+
+        if (WaitForSingleObject(test_thread, TIMED_THREAD_GRACE * 1000) != WAIT_OBJECT_0) {
+            TerminateThread(test_thread, -1);
+        }
+    } else if (test_result != WAIT_OBJECT_0) {
         TerminateThread(test_thread, -1);
     }
 
-    GetExitCodeThread(test_thread, &exit_code);
-
     CloseHandle(test_thread);
     test_thread = NULL;
 
-    // We're no longer in a timed test.
-    in_timed = false;
-
-    // Check our result.
-    vbprintf(stderr, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
-    __set_last_assert(__func__ + 2);
-    __set_last_caller(__last_assert_caller + 6);
-
-    if (exit_code != 0) {
-        __set_last_line(__lloac_back);
-    }
-
-    __lloac_back = -1;
-
     switch (test_result) {
         case WAIT_OBJECT_0:
             // All good, check if we actually pass all asserts:
-            __test_assert__(__passing_tt__);
+            __test_assert__(__passing_tt__, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
             break;
         case WAIT_TIMEOUT:
             // Function failed to exit.
-            __test_assert__(false);
+            __test_assert__(false, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
             break;
         case WAIT_FAILED:
             // Waiting on semaphore failed.
-            fwprintf(stderr, L"*** Failed to wait on thread! ***\n");
-            __test_assert__(false);
+            output_printf("*** Failed to wait on thread! ***\n");
+            __test_assert__(false, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
             break;
         default:
             // How did you get here?
-            fwprintf(stderr, L"*** Abnormal wait return: %d. ***\n", test_result);
-            __test_assert__(false);
+            output_printf("*** Abnormal wait return: %lu. ***\n", (unsigned long) test_result);
+            __test_assert__(false, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
             break;
     }
 }
 #else
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <sys/wait.h>
@@ -534,14 +2708,336 @@ static void __alarm_handler__(int param __attribute__((unused))) {
     }
 }
 
+// A long-lived process that runs early exit timed tests, so that each one does not need a fork of its own. Its stderr
+// is captured, so that what it prints can be passed on in order with the rest of the output.
+typedef struct {
+    pid_t pid;
+    pid_t owner;
+    int requests;
+    int results;
+    FILE *capture;
+} TimedWorker;
+
+static TimedWorker timed_worker = { -1, -1, -1, -1, NULL };
+
+static jmp_buf timed_env;
+static bool in_timed_worker = false;
+
+// A timed test running on a thread of this process. It is freed by the test waiting for it, unless the thread could
+// not be stopped, in which case it is left for the thread to keep using.
+typedef struct {
+    TestFunction func;
+    pthread_t id;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    jmp_buf env;
+    bool finished;
+    bool passed;
+    bool cancelled;
+} TimedThread;
+
+static THREAD_LOCAL TimedThread *timed_thread = NULL;
+
 static inline __attribute__((noreturn)) void fail_timed_test(void) {
+    // A thread or worker reports the failure and carries on, whereas a forked child is done with.
+    if (timed_thread) {
+        longjmp(timed_thread->env, 1);
+    } else if (in_timed_worker) {
+        longjmp(timed_env, 1);
+    }
+
     raise(SIGKILL);
     __builtin_unreachable();
 }
 
-void __assert_time_limit_async(const TestFunction func, double time_limit) {
-    vbprintf(stderr, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
+static bool read_fully(const int fd, void *data, const size_t length) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t result = read(fd, (char *) data + got, length - got);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            return false;
+        }
+
+        got += (size_t) result;
+    }
+
+    return true;
+}
+
+static __attribute__((noreturn)) void timed_worker_main(const int requests, const int results) {
+    TestFunction func;
+
+    in_timed_worker = true;
+    in_timed = true;
+
+    while (read_fully(requests, &func, sizeof(TestFunction))) {
+        char passed = 1;
+
+        if (setjmp(timed_env) == 0) {
+            func();
+        } else {
+            passed = 0;
+        }
+
+        // The worker outlives the job, so whatever the function left allocated is freed before the next one.
+        testfunc_freeall();
+
+        // Everything the function printed has to be out before the parent carries on.
+        output_flush();
+        fflush(NULL);
+
+        if (write(results, &passed, 1) != 1) {
+            break;
+        }
+    }
+
+    _exit(0);
+}
+
+// Pass on everything the timed worker has printed. The worker is idle or dead, so the capture can be emptied after.
+static void collect_timed_output(void) {
+    int fd = fileno(timed_worker.capture);
+    char chunk[4096];
+    ssize_t got;
+
+    lseek(fd, 0, SEEK_SET);
+    while ((got = read(fd, chunk, sizeof(chunk))) > 0 || (got < 0 && errno == EINTR)) {
+        output_write(chunk, got > 0 ? (size_t) got : 0u);
+    }
+
+    // The worker shares the file offset, so this rewinds it too.
+    if (ftruncate(fd, 0) == 0) {
+        lseek(fd, 0, SEEK_SET);
+    }
+}
+
+// Stop using the timed worker, killing it if it might still be running a function.
+static void stop_timed_worker(const bool kill_worker) {
+    if (timed_worker.owner == getpid()) {
+        if (kill_worker) {
+            kill(timed_worker.pid, SIGKILL);
+        }
+
+        waitpid(timed_worker.pid, NULL, 0);
+        collect_timed_output();
+    }
+
+    // A worker inherited from the process this one was forked from belongs to that process, so it is left alone.
+    close(timed_worker.requests);
+    close(timed_worker.results);
+    fclose(timed_worker.capture);
+
+    timed_worker = (TimedWorker) { -1, -1, -1, -1, NULL };
+}
+
+static bool start_timed_worker(void) {
+    int requests[2], results[2];
+
+    FILE *capture = tmpfile();
+    if (!capture) {
+        return false;
+    }
+
+    if (pipe(requests) != 0) {
+        fclose(capture);
+        return false;
+    }
+
+    if (pipe(results) != 0) {
+        fclose(capture);
+        close(requests[0]);
+        close(requests[1]);
+        return false;
+    }
+
+    // Anything still sitting in a stdio buffer would otherwise be printed again by the worker.
+    output_sync();
+    fflush(NULL);
+
+    pid_t pid = fork();
+    switch (pid) {
+        case -1:
+            fclose(capture);
+            close(requests[0]);
+            close(requests[1]);
+            close(results[0]);
+            close(results[1]);
+            return false;
+        case 0:
+            output_discard();
+            dup2(fileno(capture), STDERR_FILENO);
+            close(requests[1]);
+            close(results[0]);
+            timed_worker_main(requests[0], results[1]);
+            break;
+        default:
+            close(requests[0]);
+            close(results[1]);
+            timed_worker = (TimedWorker) { pid, getpid(), requests[1], results[0], capture };
+            break;
+    }
+
+    return true;
+}
+
+bool timed_test_cancelled(void) {
+    return timed_thread && ATOMIC_LOAD(&timed_thread->cancelled);
+}
+
+static void finish_timed_thread(TimedThread *thread, const bool passed) {
+    pthread_mutex_lock(&thread->lock);
+    thread->finished = true;
+    thread->passed = passed;
+    pthread_cond_signal(&thread->done);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+static void cancel_timed_thread(void *thread) {
+    finish_timed_thread((TimedThread *) thread, false);
+}
+
+static void *timed_thread_main(void *arg) {
+    TimedThread *thread = (TimedThread *) arg;
+
+    timed_thread = thread;
+    in_timed = true;
+
+    // If the thread is cancelled at a cancellation point, it still has to report that it finished.
+    pthread_cleanup_push(cancel_timed_thread, thread);
+
+    if (setjmp(thread->env) == 0) {
+        thread->func();
+        finish_timed_thread(thread, true);
+    } else {
+        finish_timed_thread(thread, false);
+    }
+
+    pthread_cleanup_pop(0);
+    return NULL;
+}
+
+// Wait until a timed test thread has finished, or a number of seconds have passed. The thread's lock must be held.
+static void wait_for_timed_thread(TimedThread *thread, const double seconds) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    time_t whole = (time_t) seconds;
+    deadline.tv_sec += whole;
+    deadline.tv_nsec += (long) ((seconds - (double) whole) * 1e9);
+
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (!thread->finished && pthread_cond_timedwait(&thread->done, &thread->lock, &deadline) != ETIMEDOUT) {
+        // Spurious wakeup.
+    }
+}
+
+// Run a function on a thread of this process, asking it to stop if it does not finish in time.
+// Returns whether the function finished in time without failing an assertion.
+static bool run_in_timed_thread(const TestFunction func, const double time_limit) {
+    TimedThread *thread = (TimedThread *) calloc(1, sizeof(TimedThread));
+    if (!thread) {
+        output_printf("*** Failed to create timed test thread! ***\n");
+        return false;
+    }
+
+    thread->func = func;
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->done, NULL);
+
+    if (pthread_create(&thread->id, NULL, timed_thread_main, thread) != 0) {
+        output_printf("*** Failed to create timed test thread! ***\n");
+        pthread_cond_destroy(&thread->done);
+        pthread_mutex_destroy(&thread->lock);
+        free(thread);
+        return false;
+    }
+
+    pthread_mutex_lock(&thread->lock);
+    wait_for_timed_thread(thread, time_limit);
+
+    bool passed = thread->finished && thread->passed;
+
+    if (!thread->finished) {
+        // Ask the thread to stop. It can check timed_test_cancelled, and is also cancelled at the next cancellation point.
+        ATOMIC_STORE(&thread->cancelled, true);
+        pthread_cancel(thread->id);
+
+        wait_for_timed_thread(thread, TIMED_THREAD_GRACE);
+    }
+
+    bool stopped = thread->finished;
+    pthread_mutex_unlock(&thread->lock);
+
+    if (stopped) {
+        pthread_join(thread->id, NULL);
+        pthread_cond_destroy(&thread->done);
+        pthread_mutex_destroy(&thread->lock);
+        free(thread);
+    } else {
+        // The memory the test allocated is left to it as well, rather than freed while it may still be using it.
+        output_printf("*** [WARNING] The timed test thread did not stop when it was cancelled, and has been left running along with the memory it allocated. ***\n");
+        testfunc_abandonall();
+        pthread_detach(thread->id);
+    }
+
+    return passed;
+}
+
+// Run a function in the timed worker, replacing the worker if the function does not finish in time.
+// Returns whether the function finished in time without failing an assertion.
+static bool run_in_timed_worker(const TestFunction func, const double time_limit) {
+    if (timed_worker.pid >= 0 && timed_worker.owner != getpid()) {
+        stop_timed_worker(false);
+    }
+
+    if (timed_worker.pid < 0 && !start_timed_worker()) {
+        output_printf("*** Failed to create timed test worker! ***\n");
+        return false;
+    }
 
+    // A worker that has died since its last function would otherwise take this process down with SIGPIPE.
+    void (*prev_handler)(int) = signal(SIGPIPE, SIG_IGN);
+    bool sent = write(timed_worker.requests, &func, sizeof(TestFunction)) == (ssize_t) sizeof(TestFunction);
+    signal(SIGPIPE, prev_handler);
+
+    if (!sent) {
+        stop_timed_worker(true);
+        return false;
+    }
+
+    uint64_t start = timer_now(TIMER_WALL);
+    struct pollfd fds = { timed_worker.results, POLLIN, 0 };
+
+    for (;;) {
+        // Round the remaining time up to whole milliseconds, so that the limit is never cut short.
+        double remaining = 1e3 * (time_limit - timer_seconds_since(start));
+        int wait = remaining > 0.0 ? (int) remaining : 0;
+        wait += wait < remaining ? 1 : 0;
+
+        int ready = poll(&fds, 1, wait);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+
+        char passed = 0;
+        if (ready > 0 && read_fully(timed_worker.results, &passed, 1)) {
+            collect_timed_output();
+            return passed != 0;
+        }
+
+        // The time limit expired or the worker died.
+        stop_timed_worker(true);
+        return false;
+    }
+}
+
+void __assert_time_limit_async(const TestFunction func, double time_limit) {
     // Create timer initialiser.
     int child_status;
     uint32_t seconds = (uint32_t) time_limit;
@@ -554,16 +3050,25 @@ void __assert_time_limit_async(const TestFunction func, double time_limit) {
         }
     };
 
+    if (timed_test_mode == TIMED_TEST_THREAD || timed_test_mode == TIMED_TEST_POOLED) {
+        bool passed = timed_test_mode == TIMED_TEST_THREAD ? run_in_timed_thread(func, time_limit) : run_in_timed_worker(func, time_limit);
+        __test_assert__(passed, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
+        return;
+    }
+
     // We're in a timed test here.
     in_timed = true;
 
     // Fork process here, where child runs the test function, and parent monitors it.
+    output_sync();
+
     switch ((__child__ = fork())) {
         case -1:
-            fwprintf(stderr, L"*** Failed to create child process! ***\n");
-            __test_assert__(false);
+            output_printf("*** Failed to create child process! ***\n");
+            __test_assert__(false, "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
             break;
         case 0:
+            output_discard();
             __testfunc_runner__(func);
             break;
         default:
@@ -573,7 +3078,7 @@ void __assert_time_limit_async(const TestFunction func, double time_limit) {
 
                 // Set timer, run function, wait for child. If timer expires, child is killed.
                 setitimer(ITIMER_REAL, &timer_init_val, NULL);
-                waitpid(-1, &child_status, 0);
+                while (waitpid(__child__, &child_status, 0) < 0 && errno == EINTR);
                 setitimer(ITIMER_REAL, &IT_ZERO, NULL);
 
                 // Reset the child value.
@@ -586,7 +3091,7 @@ void __assert_time_limit_async(const TestFunction func, double time_limit) {
                 in_timed = false;
 
                 // Check exit code of child process.
-                __test_assert__(WIFEXITED(child_status));
+                __test_assert__(WIFEXITED(child_status), "FUNCTION EXITS IN %lf SECONDS?\n", time_limit);
             }
             break;
     }
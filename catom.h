@@ -13,7 +13,8 @@
  * Like JUnit, all output goes to stderr. Also like JUnit, all tests are guaranteed to run, provided that
  * the system does not run out of memory when allocating strings to print verbose output.
  *
- * It also provides rudimentary benchmarking capabilities, using clock_t in time.h.
+ * It also provides rudimentary benchmarking capabilities, timed with a monotonic wall clock by default. Benchmarks
+ * can instead be timed with per-thread CPU time or the processor's cycle counter, and always report nanoseconds.
  *
  * Compile-time options:
  * - If you want verbose output by default, add -D__VERBOSE__ to your compile flags when compiling this test suite.
@@ -24,6 +25,7 @@
  * - Create a static array of Test structs, which hold a pointer to the test to run, and a user-friendly
  *   identifier that shows up in logs.
  * - Use the run_tests macro to run all the tests in the array.
+ * - Alternatively, use run_registered_tests to run every test defined with the macros, without an array.
  *
  * The library then iterates through the array, running each test using the run_test function. If all assertions
  * pass, the test exits normally without a failure. If an assertion fails, control long-jumps back to run_test
@@ -38,7 +40,9 @@
  * - As in HOWTO.md, DO NOT memory allocate inside a test unless you are freeing the memory before using an
  *   assertion. The test suite WILL LEAK MEMORY if the assertion fails.
  * - The same warning applies to file operations. Close all files before making any assertions.
- * - There is no concurrency. Tests will always run sequentially in the order defined in your test array.
+ * - run_tests runs tests sequentially in the order defined in your test array, in a worker process so that a crash
+ *   only fails one test (see use_test_isolation). run_tests_parallel spreads them over several worker processes
+ *   instead, but still reports them in that order.
  * - Only one assert may fail in a test at a time.
  * - As in HOWTO.md, DO NOT USE ANY FUNCTION PREFIXED WITH __ IN YOUR TEST FILES.
  */
@@ -59,6 +63,8 @@ extern "C" {
 #include <time.h>
 #include <wchar.h>
 
+#include "libs/whatos.h"
+
 /**
  * Test functions are essentially void functions that take no arguments.
  *
@@ -73,37 +79,55 @@ typedef void (*TestFunction)(void);
  */
 typedef void (*BenchmarkFunction)(void);
 
-#define NAME_MAX_LENGTH 512
-
-// Helpers for printing assertion violations.
+/**
+ * Scaled benchmarking functions run the code being benchmarked a given number of times.
+ *
+ * The runner picks the number of iterations so that each sample takes long enough to measure reliably.
+ */
+typedef void (*ScaledBenchmarkFunction)(const size_t iterations);
 
 /**
- * Set the name of the last file that used an assert.
+ * Parallel benchmarking functions are scaled benchmarking functions that run on several threads at once.
  *
- * @param filename Name of user file.
+ * Each thread is told its index, from 0, and how many threads are running the benchmark with it.
  */
-void __set_last_file(const char *filename);
+typedef void (*ParallelBenchmarkFunction)(const size_t iterations, const size_t thread, const size_t threads);
 
 /**
- * Set the name of the last function that used an assert.
+ * Range benchmarking functions are scaled benchmarking functions that are also given the size of input to work on.
  *
- * @param caller Name of assert caller.
+ * The runner calls them at each size of a sweep, to show how their time grows with the size.
  */
-void __set_last_caller(const char *caller);
+typedef void (*RangeBenchmarkFunction)(const size_t iterations, const size_t n);
 
 /**
- * Set the last name of used assert.
+ * Benchmark hooks set up and tear down the fixture of a benchmark, outside of the time it is measured for.
  *
- * @param assert Name of last used assert.
+ * They are called around every call of the benchmark, including calibration and warmup, and are given the size the
+ * range benchmark is run at, or 0 for other benchmarks.
  */
-void __set_last_assert(const char *assert);
+typedef void (*BenchmarkHook)(const size_t n);
+
+#define NAME_MAX_LENGTH 512
+
+// Helpers for printing assertion violations.
 
 /**
- * Set the last line where an assert was used.
+ * Where an assertion is made. Every assertion has one of these built into the program, so recording it costs nothing.
+ */
+typedef struct {
+    const char *file;     /**< Name of the file the assertion is in. */
+    const char *function; /**< Name of the function the assertion is in. */
+    const char *assert;   /**< Name of the assertion's implementation function. */
+    int line;             /**< Line the assertion is on. */
+} AssertLocation;
+
+/**
+ * Set the location of the last assertion used.
  *
- * @param line Line where assert was called.
+ * @param location Location of the assertion, which must outlive the test.
  */
-void __set_last_line(const int line);
+void __set_last_location(const AssertLocation *location);
 
 /**
  * Set the verbose printing status of the test suite.
@@ -112,6 +136,40 @@ void __set_last_line(const int line);
  */
 void use_verbose_print(const bool should_use);
 
+/**
+ * Set whether the test suite only prints failing tests, regressed benchmarks and the summaries of each run.
+ *
+ * Output is buffered either way, and written out in batches rather than line by line.
+ *
+ * @param should_quiet Should the test suite print only failures and summaries?
+ */
+void use_quiet_output(const bool should_quiet);
+
+/**
+ * Set whether run_tests runs tests in a worker process (true by default), so that a test that crashes is counted as a
+ * failure, with the signal that killed it and the last assertion it reached, and the tests after it still run.
+ *
+ * The worker is forked once and runs every test in turn, and is only replaced after a crash, so this costs about one
+ * fork per run. Tests still see what the tests before them changed in memory, up to a crash, but the caller does not.
+ * Turn it off to debug tests in-process, which CATOM_ISOLATION=0 and --no-isolation also do. On Windows, tests always
+ * run in-process.
+ *
+ * @param should_isolate Should run_tests run tests in a worker process?
+ */
+void use_test_isolation(const bool should_isolate);
+
+/**
+ * Set whether testfunc_malloc, testfunc_calloc and testfunc_realloc allocate from a per-test arena.
+ *
+ * In arena mode, allocations are bumped out of large chunks and all of them are given back at once when the test
+ * ends, without per-allocation bookkeeping. testfunc_free only reclaims the most recent allocation, so leave this off
+ * for tests that rely on freed memory being returned to the heap. Only change this between tests; turning it off
+ * frees the arena's chunks.
+ *
+ * @param should_use Should the test suite allocate test memory from an arena?
+ */
+void use_arena_allocator(const bool should_use);
+
 /**
  * A triplet struct holding a test function and the test's name.
  * E.g. test: test_ints_equal | name: "test if two returned ints are equal"
@@ -120,8 +178,34 @@ typedef struct {
     TestFunction test;          /**< Pointer to test function. */
     char name[NAME_MAX_LENGTH]; /**< Name or objective of function. */
     bool passed;                /**< Has this test passed? */
+    double time;                /**< How long the test took to run, in seconds. */
+    size_t allocations;         /**< Number of testfunc_?alloc calls made by the test. */
+    size_t allocated_bytes;     /**< Total number of bytes those calls requested. */
+    size_t peak_bytes;          /**< Highest number of bytes the test had allocated at once. */
+    size_t leaked_bytes;        /**< Number of bytes still allocated when the test ended, before they were freed for it. */
+    size_t leaked_allocations;  /**< Number of allocations still live when the test ended. */
+    bool skipped;               /**< Was the test left out of the last run by the filter or shard, or after it stopped early? */
+    bool cached;                /**< Was the test passed in the last run because it was unchanged (see use_test_cache)? */
+    const char *dependency_key; /**< Anything else the test depends on, for the test cache. Changing it reruns the test. */
+    const char *file;           /**< File the test was defined in with a macro, or NULL. */
+    int line;                   /**< Line the test was defined on with a macro. */
 } Test;
 
+/**
+ * Place a test or benchmark in the registry of its kind: a section that the linker gathers every one of them in, from
+ * every object file, into a single array. Their alignment is set explicitly so that the compiler does not pad them
+ * apart, which would leave gaps in the array. PE sections are grouped by the part of their names after a $, which
+ * lets the runner mark out the start and end of the array there.
+ */
+#ifdef OS_WINDOWS
+#define __REGISTER(registry, type) __attribute__((section("." #registry "$m"), used, aligned(__alignof__(type))))
+#else
+#define __REGISTER(registry, type) __attribute__((section(#registry), used, aligned(__alignof__(type))))
+#endif
+
+#define __REGISTER_TEST __REGISTER(catom_tests, Test)
+#define __REGISTER_BENCHMARK __REGISTER(catom_benchmarks, Benchmark)
+
 /**
  * Create a template for an untimed test.
  *
@@ -130,7 +214,7 @@ typedef struct {
  */
 #define UNTIMED_TEST(test_name, description) \
     static void __ ## test_name(void);\
-    static Test test_name = { __ ## test_name, description, false };\
+    static Test test_name __REGISTER_TEST = { .test = __ ## test_name, .name = description, .passed = false, .file = __FILE__, .line = __LINE__ };\
     static void __ ## test_name(void)
 
 /**
@@ -164,31 +248,561 @@ typedef struct {
             assert_time_limit(__timed_ ## test_name, time_limit);\
         }\
     }\
-    static Test test_name = { __ ## test_name, description, false };\
+    static Test test_name __REGISTER_TEST = { .test = __ ## test_name, .name = description, .passed = false, .file = __FILE__, .line = __LINE__ };\
     static void __timed_ ## test_name(void)
 
 /**
- * A pair struct holding a benchmark function and the benchmark's name.
+ * Create a template for a property test, whose body is run on many generated cases. Draw the inputs of each case in
+ * the body with the gen_ functions, then check that the property holds for them with assertions as usual.
+ *
+ * The inputs of a case that fails are shrunk, by running the body again on simpler and simpler inputs that still fail
+ * it. The simplest ones are printed, along with the failed assertion and the seed that CATOM_SEED or
+ * use_property_seed can rerun the same cases with. Until then, a failing assertion ends its case without printing
+ * anything, so small properties can check millions of cases per second.
+ *
+ * The body must not leave anything behind for the cases after it to find, as it runs many times. Memory from the gen_
+ * functions is freed when the next case starts.
+ *
+ * @param test_name   Desired identifier for the test.
+ * @param description Description of test which will be printed out when running.
+ * @param cases       How many cases to generate.
+ */
+#define PROPERTY_TEST(test_name, description, cases) \
+    static void __property_ ## test_name(void);\
+    static void __ ## test_name(void) {\
+        __run_property(__property_ ## test_name, cases);\
+    }\
+    static Test test_name __REGISTER_TEST = { .test = __ ## test_name, .name = description, .passed = false, .file = __FILE__, .line = __LINE__ };\
+    static void __property_ ## test_name(void)
+
+/**
+ * Run a property on generated cases until one fails, then shrink and report it.
+ *
+ * @param property The body of a property test.
+ * @param cases    How many cases to generate.
+ */
+void __run_property(const TestFunction property, const size_t cases);
+
+/**
+ * Set the seed that property tests generate their cases from. By default, CATOM_SEED is used, or a new seed is picked
+ * each run.
+ *
+ * @param seed Seed to use, or 0 to pick one.
+ */
+void use_property_seed(const uint64_t seed);
+
+/**
+ * Generate an unsigned integer in a property test. It shrinks towards min.
+ *
+ * @param min Smallest value.
+ * @param max Largest value.
+ * @return A value from min to max.
+ */
+uint64_t gen_uint(const uint64_t min, const uint64_t max);
+
+/**
+ * Generate a signed integer in a property test. It shrinks towards whichever value in the range is closest to 0.
+ *
+ * @param min Smallest value.
+ * @param max Largest value.
+ * @return A value from min to max.
+ */
+int64_t gen_int(const int64_t min, const int64_t max);
+
+/**
+ * Generate a boolean in a property test. It shrinks towards false.
+ *
+ * @return true or false.
+ */
+bool gen_bool(void);
+
+/**
+ * Generate a double in a property test, with 53 bits of randomness. It shrinks towards min.
+ *
+ * @param min Smallest value.
+ * @param max Largest value.
+ * @return A value from min to max.
+ */
+double gen_double(const double min, const double max);
+
+/**
+ * Generate a float in a property test. It shrinks towards min.
+ *
+ * @param min Smallest value.
+ * @param max Largest value.
+ * @return A value from min to max.
+ */
+float gen_float(const float min, const float max);
+
+/**
+ * Generate a buffer of bytes in a property test, whose length is spread evenly up to max_length. It shrinks towards
+ * fewer bytes, and towards zeros.
+ *
+ * @param max_length Most bytes to generate.
+ * @param length     Where to write how many bytes were generated.
+ * @return The bytes, which last until the next case starts.
+ */
+uint8_t *gen_bytes(const size_t max_length, size_t *length);
+
+/**
+ * Generate an array of signed integers in a property test, as gen_int generates them. It shrinks towards fewer
+ * elements, and simpler ones.
+ *
+ * @param max_n  Most elements to generate.
+ * @param min    Smallest value of each element.
+ * @param max    Largest value of each element.
+ * @param n      Where to write how many elements were generated.
+ * @return The array, which lasts until the next case starts.
+ */
+int64_t *gen_int_array(const size_t max_n, const int64_t min, const int64_t max, size_t *n);
+
+/**
+ * Generate an array of doubles in a property test, as gen_double generates them. It shrinks towards fewer elements,
+ * and simpler ones.
+ *
+ * @param max_n  Most elements to generate.
+ * @param min    Smallest value of each element.
+ * @param max    Largest value of each element.
+ * @param n      Where to write how many elements were generated.
+ * @return The array, which lasts until the next case starts.
+ */
+double *gen_double_array(const size_t max_n, const double min, const double max, size_t *n);
+
+/**
+ * The ways an early exit timed test can be run on POSIX systems. Windows always runs them on a thread.
+ */
+typedef enum {
+    TIMED_TEST_FORK,   /**< Fork a new process for each one, which sees the memory of the test exactly as it is. */
+    TIMED_TEST_POOLED, /**< Run them in a long-lived worker process, which is only replaced after it is killed. */
+    TIMED_TEST_THREAD  /**< Run them on a thread of the test's process, sharing its memory. See timed_test_cancelled. */
+} TimedTestMode;
+
+/**
+ * Set how early exit timed tests are run (TIMED_TEST_FORK by default).
+ *
+ * TIMED_TEST_POOLED avoids a fork for every timed test, which is expensive for processes with large heaps. The worker
+ * is forked when the first timed test runs, so it does not see changes made to memory after that. Changes made by a
+ * timed test are kept for the ones after it in the same worker, until a time limit expires and the worker is replaced.
+ *
+ * @param mode How to run early exit timed tests.
+ */
+void use_timed_test_mode(const TimedTestMode mode);
+
+/**
+ * Check whether the time limit of the early exit timed test running on this thread has expired.
+ *
+ * Timed tests run on a thread cannot be killed safely, so when their time limit expires they are asked to stop
+ * instead. Long-running loops in them should poll this and return once it is true. Threads are also cancelled at the
+ * next POSIX cancellation point (such as sleep or read). A thread that has not stopped shortly after being cancelled
+ * is left running, and on Windows it is terminated.
+ *
+ * @return Has the time limit expired? This is always false outside of a timed test thread.
+ */
+bool timed_test_cancelled(void);
+
+/**
+ * The sources of time that a benchmark can be measured with.
+ */
+typedef enum {
+    TIMER_DEFAULT,    /**< Use the timer chosen with use_benchmark_timer (wall-clock time unless changed). */
+    TIMER_WALL,       /**< Monotonic wall-clock time (clock_gettime or QueryPerformanceCounter). */
+    TIMER_THREAD_CPU, /**< CPU time used by the thread running the benchmark. */
+    TIMER_CYCLES      /**< The processor's cycle counter (e.g. rdtsc), calibrated against wall-clock time. */
+} TimerSource;
+
+/**
+ * Set the timer used by benchmarks that do not choose one themselves.
+ * TIMER_CYCLES is only available on x86; elsewhere it falls back to wall-clock time, with a warning.
+ *
+ * @param source Timer to use. TIMER_DEFAULT resets it to wall-clock time.
+ */
+void use_benchmark_timer(const TimerSource source);
+
+/**
+ * Set how long one sample of a scaled benchmark should take. The runner keeps growing the number of iterations
+ * given to a BENCHMARK_N body until a single call takes at least this long.
+ *
+ * @param seconds Target duration of each sample. The default is 0.01 seconds.
+ */
+void use_benchmark_target_time(const double seconds);
+
+/**
+ * Set the largest number of threads parallel benchmarks are run on.
+ *
+ * @param threads Largest number of threads. Use 0 to use one per online processor, which is the default.
+ */
+void use_benchmark_threads(const size_t threads);
+
+/**
+ * Set whether the threads running a parallel benchmark are each pinned to a processor of their own while it runs.
+ * This is only supported on Linux and Windows, and is off by default.
+ *
+ * @param should_pin Should parallel benchmark threads be pinned?
+ */
+void use_benchmark_pinning(const bool should_pin);
+
+/**
+ * Set whether benchmarks also count hardware and kernel events: cycles, instructions, cache misses, branch misses and
+ * page faults. These are printed for each iteration and on average for each benchmark, and written to reports.
+ * Counting uses perf_event_open, so it is only supported on Linux, and counters the system does not allow are left
+ * out. Each thread of a parallel benchmark counts its own events, and they are added up. Off by default.
+ *
+ * @param should_count Should benchmarks count events?
+ */
+void use_benchmark_counters(const bool should_count);
+
+/**
+ * Write every scope and counter recorded with CATOM_SCOPE and CATOM_COUNTER to a trace in the Chrome trace event
+ * format, which chrome://tracing and Perfetto show as a timeline of each thread. Tests running in worker processes
+ * add their events to the same trace. Without a path, the CATOM_TRACE environment variable is used if it is set.
+ *
+ * @param path Path to write the trace to, or NULL to not write one.
+ */
+void use_trace_report(const char *path);
+
+/**
+ * Set whether benchmarks control the environment they run in, to make their timings steadier. The runner is pinned to
+ * one processor and its priority is raised as far as the system allows. The CPU model, governor, turbo state and load
+ * are printed, with a warning if the frequency can change while benchmarks run or other work is competing with them.
+ * Plain and scaled benchmarks are also interleaved: their iterations are run in rounds, one of each per round, in a
+ * new random order every round, so that drift in the machine's speed is spread over all of them. Range and parallel
+ * benchmarks are run after one another as usual, and parallel benchmarks are not pinned. The environment is recorded in
+ * benchmark reports either way. Off by default.
+ *
+ * @param should_control Should benchmarks control their environment?
+ * @param core           Processor to pin the runner to, or -1 for the last one it may use, which usually handles
+ *                       fewer interrupts than the first.
+ */
+void use_benchmark_environment(const bool should_control, const int core);
+
+/**
+ * What the size given to a range benchmark counts, which decides how its throughput is reported.
+ */
+typedef enum {
+    RANGE_ITEMS, /**< The size is a number of items, and throughput is reported in items per second. */
+    RANGE_BYTES  /**< The size is a number of bytes, and throughput is reported in bytes per second. */
+} RangeUnit;
+
+/**
+ * The sizes a range benchmark is run at: either an explicit list, or a geometric sweep from min to max.
+ */
+typedef struct {
+    const size_t *sizes; /**< Explicit list of sizes, or NULL for a geometric sweep. */
+    size_t count;        /**< Number of explicit sizes. */
+    size_t min;          /**< First size of the sweep. */
+    size_t max;          /**< Last size of the sweep, which is always run. */
+    size_t multiplier;   /**< Factor between one size of the sweep and the next (at least 2). */
+    RangeUnit unit;      /**< What the sizes count. */
+} BenchmarkRange;
+
+/**
+ * A struct holding a benchmark function, the benchmark's name and the timer it is measured with.
+ * Exactly one of benchmark, scaled, parallel and range is set.
  * E.g. test: benchmark_ints_equal | name: "benchmark performance of equality check for ints"
  */
 typedef struct {
-    BenchmarkFunction benchmark; /**< Pointer to benchmark function. */
-    char name[NAME_MAX_LENGTH];  /**< Benchmark name or description. */
+    BenchmarkFunction benchmark;        /**< Pointer to benchmark function. */
+    char name[NAME_MAX_LENGTH];         /**< Benchmark name or description. */
+    TimerSource timer;                  /**< Timer used to measure the benchmark. */
+    ScaledBenchmarkFunction scaled;     /**< Pointer to scaled benchmark function. */
+    ParallelBenchmarkFunction parallel; /**< Pointer to parallel benchmark function. */
+    RangeBenchmarkFunction range;       /**< Pointer to range benchmark function. */
+    BenchmarkRange sizes;               /**< Sizes the range benchmark function is run at. */
+    BenchmarkHook setup;                /**< Called before each call of the benchmark, or NULL. */
+    BenchmarkHook teardown;             /**< Called after each call of the benchmark, or NULL. */
+    const char *file;                   /**< File the benchmark was defined in with a macro, or NULL. */
+    int line;                           /**< Line the benchmark was defined on with a macro. */
 } Benchmark;
 
 /**
- * Create a template for an untimed test.
+ * Create a template for a benchmark.
  *
- * @param test_name   Desired identifier for the test.
- * @param description Description of test which will be printed out when running.
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
  */
 #define BENCHMARK(benchmark_name, description) \
     static void __ ## benchmark_name(void);\
-    static Benchmark benchmark_name = { __ ## benchmark_name, description };\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .benchmark = __ ## benchmark_name, .name = description, .timer = TIMER_DEFAULT, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(void)
+
+/**
+ * Create a template for a benchmark that is measured with a specific timer.
+ *
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
+ * @param timer_source   TimerSource to measure the benchmark with.
+ */
+#define BENCHMARK_WITH_TIMER(benchmark_name, description, timer_source) \
+    static void __ ## benchmark_name(void);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .benchmark = __ ## benchmark_name, .name = description, .timer = timer_source, .file = __FILE__, .line = __LINE__ };\
     static void __ ## benchmark_name(void)
 
 /**
- * Run an array of tests.
+ * Create a template for a scaled benchmark. The body is given the number of times to run the code being benchmarked,
+ * and should loop that many times. The runner calibrates the number of iterations before warming up so that one call
+ * takes at least the target time set with use_benchmark_target_time, and reports the time taken per operation.
+ *
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
+ * @param iterations     Name of the size_t parameter holding the number of iterations to run.
+ */
+#define BENCHMARK_N(benchmark_name, description, iterations) \
+    static void __ ## benchmark_name(const size_t iterations);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .name = description, .timer = TIMER_DEFAULT, .scaled = __ ## benchmark_name, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(const size_t iterations)
+
+/**
+ * Create a template for a parallel benchmark, which measures how throughput scales with the number of threads.
+ *
+ * The body is run on 1, 2, 4 and so on threads at once, up to the number set with use_benchmark_threads. The threads
+ * are released together from a barrier, and each is given the same number of iterations to loop, calibrated on one
+ * thread as for BENCHMARK_N. Each sample is the wall-clock time from their release until the last thread finishes.
+ * The operations per second and scaling efficiency at each thread count are reported, and each thread count is a
+ * record of its own in benchmark reports, named after the benchmark and its number of threads.
+ *
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
+ * @param iterations     Name of the size_t parameter holding the number of iterations for this thread to run.
+ * @param thread         Name of the size_t parameter holding the index of this thread.
+ * @param threads        Name of the size_t parameter holding the number of threads running the benchmark.
+ */
+#define PARALLEL_BENCHMARK(benchmark_name, description, iterations, thread, threads) \
+    static void __ ## benchmark_name(const size_t iterations, const size_t thread, const size_t threads);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .name = description, .timer = TIMER_WALL, .parallel = __ ## benchmark_name, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(const size_t iterations, const size_t thread, const size_t threads)
+
+/**
+ * Create a template for a range benchmark, which is run at each size of a geometric sweep to find how its time grows.
+ *
+ * The sizes start at range_min and are multiplied by range_multiplier until they pass range_max, which is always run
+ * as the last size. At each size, the number of iterations is calibrated as for BENCHMARK_N, and the time per
+ * operation and throughput in items or bytes per second are reported. Each size is a record of its own in benchmark
+ * reports, named after the benchmark and its size. Finally, the complexity that fits the times best (O(1), O(log n),
+ * O(n), O(n log n), O(n^2) or O(n^3)) is estimated. Sizes must be positive.
+ *
+ * @param benchmark_name   Desired identifier for the benchmark.
+ * @param description      Description of benchmark which will be printed out when running.
+ * @param iterations       Name of the size_t parameter holding the number of iterations to run.
+ * @param n                Name of the size_t parameter holding the size to run at.
+ * @param range_unit       RangeUnit saying whether the size counts items or bytes.
+ * @param range_min        First size.
+ * @param range_max        Last size.
+ * @param range_multiplier Factor between one size and the next. Anything below 2 is taken as 2.
+ */
+#define BENCHMARK_RANGE(benchmark_name, description, iterations, n, range_unit, range_min, range_max, range_multiplier) \
+    static void __ ## benchmark_name(const size_t iterations, const size_t n);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .name = description, .timer = TIMER_DEFAULT, .range = __ ## benchmark_name, .sizes = { .min = range_min, .max = range_max, .multiplier = range_multiplier, .unit = range_unit }, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(const size_t iterations, const size_t n)
+
+/**
+ * Create a template for a range benchmark that is run at an explicit list of sizes, in the order given. Otherwise it
+ * is the same as BENCHMARK_RANGE.
+ *
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
+ * @param iterations     Name of the size_t parameter holding the number of iterations to run.
+ * @param n              Name of the size_t parameter holding the size to run at.
+ * @param range_unit     RangeUnit saying whether the size counts items or bytes.
+ * @param ...            The sizes to run at.
+ */
+#define BENCHMARK_SIZES(benchmark_name, description, iterations, n, range_unit, ...) \
+    static void __ ## benchmark_name(const size_t iterations, const size_t n);\
+    static const size_t __ ## benchmark_name ## _sizes[] = { __VA_ARGS__ };\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .name = description, .timer = TIMER_DEFAULT, .range = __ ## benchmark_name, .sizes = { .sizes = __ ## benchmark_name ## _sizes, .count = sizeof(__ ## benchmark_name ## _sizes) / sizeof(size_t), .unit = range_unit }, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(const size_t iterations, const size_t n)
+
+/**
+ * Create a template for a benchmark with a fixture. The setup hook is called before each call of the benchmark and
+ * the teardown hook after it, and neither is timed or counted, so the benchmark measures only what its body does.
+ *
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
+ * @param setup_hook     BenchmarkHook to call before each call, or NULL.
+ * @param teardown_hook  BenchmarkHook to call after each call, or NULL.
+ */
+#define BENCHMARK_FIXTURE(benchmark_name, description, setup_hook, teardown_hook) \
+    static void __ ## benchmark_name(void);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .benchmark = __ ## benchmark_name, .name = description, .timer = TIMER_DEFAULT, .setup = setup_hook, .teardown = teardown_hook, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(void)
+
+/**
+ * Create a template for a scaled benchmark with a fixture, which is set up and torn down around each call as for
+ * BENCHMARK_FIXTURE, rather than around each iteration. Otherwise it is the same as BENCHMARK_N.
+ *
+ * @param benchmark_name Desired identifier for the benchmark.
+ * @param description    Description of benchmark which will be printed out when running.
+ * @param iterations     Name of the size_t parameter holding the number of iterations to run.
+ * @param setup_hook     BenchmarkHook to call before each call, or NULL.
+ * @param teardown_hook  BenchmarkHook to call after each call, or NULL.
+ */
+#define BENCHMARK_N_FIXTURE(benchmark_name, description, iterations, setup_hook, teardown_hook) \
+    static void __ ## benchmark_name(const size_t iterations);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .name = description, .timer = TIMER_DEFAULT, .scaled = __ ## benchmark_name, .setup = setup_hook, .teardown = teardown_hook, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(const size_t iterations)
+
+/**
+ * Create a template for a range benchmark with a fixture, whose hooks are given the size to set up for, e.g. to fill
+ * an input of that size. Otherwise it is the same as BENCHMARK_RANGE.
+ *
+ * @param benchmark_name   Desired identifier for the benchmark.
+ * @param description      Description of benchmark which will be printed out when running.
+ * @param iterations       Name of the size_t parameter holding the number of iterations to run.
+ * @param n                Name of the size_t parameter holding the size to run at.
+ * @param range_unit       RangeUnit saying whether the size counts items or bytes.
+ * @param range_min        First size.
+ * @param range_max        Last size.
+ * @param range_multiplier Factor between one size and the next. Anything below 2 is taken as 2.
+ * @param setup_hook       BenchmarkHook to call before each call, or NULL.
+ * @param teardown_hook    BenchmarkHook to call after each call, or NULL.
+ */
+#define BENCHMARK_RANGE_FIXTURE(benchmark_name, description, iterations, n, range_unit, range_min, range_max, range_multiplier, setup_hook, teardown_hook) \
+    static void __ ## benchmark_name(const size_t iterations, const size_t n);\
+    static Benchmark benchmark_name __REGISTER_BENCHMARK = { .name = description, .timer = TIMER_DEFAULT, .range = __ ## benchmark_name, .sizes = { .min = range_min, .max = range_max, .multiplier = range_multiplier, .unit = range_unit }, .setup = setup_hook, .teardown = teardown_hook, .file = __FILE__, .line = __LINE__ };\
+    static void __ ## benchmark_name(const size_t iterations, const size_t n)
+
+/**
+ * Stop timing the benchmark being run, e.g. to reset its state between iterations. Hardware events are still counted
+ * while timing is paused. Has no effect outside of a benchmark, when timing is already paused, or in parallel
+ * benchmarks, whose threads are timed together. Pausing costs two reads of the timer, so it is best kept out of loops
+ * over short operations.
+ */
+void benchmark_pause_timing(void);
+
+/**
+ * Carry on timing the benchmark being run after benchmark_pause_timing. A benchmark that returns while paused is
+ * taken to have resumed as it returned.
+ */
+void benchmark_resume_timing(void);
+
+/**
+ * Make the compiler assume that a value is read and may have been changed, so that the code computing it is not
+ * optimized away and the value is not kept from one iteration to the next. Needs GCC or Clang.
+ *
+ * @param value Variable holding the value.
+ */
+#define catom_do_not_optimize(value) __asm__ __volatile__("" : "+r,m"(value) : : "memory")
+
+/**
+ * Make the compiler assume that all memory is read and may have been written, so that stores before it are not
+ * optimized away. Needs GCC or Clang.
+ */
+#define catom_clobber_memory() __asm__ __volatile__("" : : : "memory")
+
+/**
+ * Where and when a scope timed with CATOM_SCOPE was entered.
+ */
+typedef struct {
+    const char *name; /**< Name of the scope. */
+    uint64_t start;   /**< Wall-clock time it was entered at, in nanoseconds. */
+} ScopeMark;
+
+ScopeMark __begin_scope(const char *name);
+void __end_scope(ScopeMark *mark);
+void __add_to_counter(const char *name, const uint64_t amount);
+
+#define __CATOM_SCOPE_VARIABLE(line) __catom_scope_ ## line
+#define __CATOM_SCOPE_AT(line) __CATOM_SCOPE_VARIABLE(line)
+
+#ifdef CATOM_NO_INSTRUMENTATION
+#define CATOM_SCOPE(name) ((void) 0)
+#define CATOM_COUNTER(name, amount) ((void) 0)
+#else
+/**
+ * Time the rest of the enclosing block as a scope, e.g. one phase of a benchmark. How many times each scope was left
+ * and how long was spent in it are printed after each test and benchmark, and written to benchmark reports. Each is
+ * also an event in the trace set with use_trace_report. Recording takes two reads of the timer and no locks, so scopes
+ * can be used on every thread, but a scope inside a loop over short operations still slows it down. Scopes left by a
+ * failing assertion are not recorded. Define CATOM_NO_INSTRUMENTATION to compile every scope and counter out.
+ *
+ * @param name Name of the scope, which must be a string that outlives the run, such as a literal.
+ */
+#define CATOM_SCOPE(name) ScopeMark __CATOM_SCOPE_AT(__LINE__) __attribute__((cleanup(__end_scope))) = __begin_scope(name)
+
+/**
+ * Add an amount to a counter, e.g. the number of bytes a benchmark has parsed. Counters are added up and reported
+ * along with scopes.
+ *
+ * @param name   Name of the counter, which must be a string that outlives the run, such as a literal.
+ * @param amount Amount to add to it.
+ */
+#define CATOM_COUNTER(name, amount) __add_to_counter(name, (uint64_t) (amount))
+#endif
+
+/**
+ * Only run the tests whose names pass a filter. The filter is a comma-separated list of glob patterns, where * matches
+ * any run of characters and ? any one character. Patterns starting with '-' exclude the tests they match, so
+ * "parser*,-*slow*" runs the parser tests that are not slow. Without a filter, the CATOM_FILTER environment variable is
+ * used if it is set.
+ *
+ * @param filter The filter, or NULL to run every test.
+ */
+void use_test_filter(const char *filter);
+
+/**
+ * Only run one shard of the tests, so that a suite can be split between several machines. Every machine computes the
+ * same split, from the tests that pass the filter: without durations they are dealt out in turn, and with durations
+ * (see use_shard_durations) each shard gets roughly the same total time. Without a shard, the CATOM_SHARD environment
+ * variable is used if it is set, in the form "index/count".
+ *
+ * @param index Index of the shard to run, from 0 to count - 1.
+ * @param count Number of shards. Use 0 (or 1) to run every test.
+ */
+void use_test_shard(const size_t index, const size_t count);
+
+/**
+ * Balance shards by how long each test took in a test report from a previous run (in either format). Tests missing
+ * from the report are taken to take as long as the average test in it. Without a report, the CATOM_SHARD_DURATIONS
+ * environment variable is used if it is set. Every machine must use the same report to get the same split.
+ *
+ * @param path Path of the test report, or NULL to deal tests out in turn.
+ */
+void use_shard_durations(const char *path);
+
+/**
+ * Skip tests that are unchanged since they last passed, keeping a cache of their fingerprints in a file. A test's
+ * fingerprint covers the machine code of its function and of every function it calls, found through the program's
+ * symbol table (so build with symbols), along with the read-only data that code refers to, the key given here and the
+ * test's own dependency_key. Tests that failed, or that the code fingerprint is not available for (it needs Linux)
+ * and that have no dependency_key, always run. Without a path, the CATOM_TEST_CACHE environment variable is used.
+ *
+ * Read-only data is hashed whole when it has a symbol of its own, like a const array, as are string literals. Of other
+ * read-only data, which has no size, like floating point constants, only the first 16 bytes are hashed, so a longer
+ * array the compiler copies a local array from is only partly covered. Words that lead into code, like the entries of
+ * jump tables, are left out, since they change whenever the code moves. Read-only data is not hashed at all on ARM.
+ *
+ * The code fingerprint cannot see anything a test reaches only through function pointers, files or the initial values
+ * of writable globals: use the key (e.g. a hash of your data files) or dependency_key for those.
+ *
+ * @param path Cache file, or NULL to run every test.
+ * @param key  Key that every test depends on, or NULL.
+ */
+void use_test_cache(const char *path, const char *key);
+
+/**
+ * Stop running tests once a number of them have failed, marking the rest as skipped, so that a failure is reported as
+ * soon as it is found. When the test cache is in use, tests are also run in an order that finds failures sooner: the
+ * ones that failed last time first, then new ones, then the rest, fastest first. Without a limit, the
+ * CATOM_MAX_FAILURES environment variable is used.
+ *
+ * @param failures_allowed Failures to stop after, 1 to stop at the first, or 0 to run every test.
+ */
+void use_max_failures(const size_t failures_allowed);
+
+/**
+ * Read test selection options from the command line: --filter=FILTER, --shard=INDEX/COUNT,
+ * --shard-durations=PATH and --max-failures=COUNT, which are the same as use_test_filter, use_test_shard,
+ * use_shard_durations and use_max_failures, --fail-fast, which is --max-failures=1, --no-isolation, which turns
+ * off use_test_isolation, and --seed=SEED, which is the same as use_property_seed. Other arguments are ignored. The
+ * strings are not copied, so they must outlive the test run, as argv does.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments, starting with the program name.
+ */
+void use_command_line(const int argc, char **argv);
+
+/**
+ * Run an array of tests. Tests left out by the filter or shard, or after too many failures, are marked as skipped, and
+ * tests found unchanged in the test cache are marked as cached and passed.
  *
  * @param tests Array of tests to run.
  * @param n     How many tests are in that array.
@@ -200,6 +814,60 @@ void __run_tests(Test tests[], const size_t n);
     __run_tests(tests, n);\
 }
 
+/**
+ * Run an array of tests across a pool of worker processes.
+ *
+ * Each worker is a forked copy of the test process that picks up the next unstarted test whenever it is free,
+ * so crashes are isolated exactly as they are in run_tests. Everything a test prints to stderr is captured
+ * and printed by the parent in the order of the array, along with whether it passed.
+ *
+ * A test that crashes its worker is counted as a failure, and a new worker takes over the remaining tests.
+ * Tests can not share state with each other or with the caller, as each worker has its own copy of memory.
+ * On Windows, this falls back to running the tests sequentially.
+ *
+ * @param tests Array of tests to run.
+ * @param n     How many tests are in that array.
+ * @param jobs  How many worker processes to use. Use 0 to use one per online processor.
+ */
+void __run_tests_parallel(Test tests[], const size_t n, const size_t jobs);
+#define run_tests_parallel(tests, n, jobs) {\
+    setlocale(LC_ALL, "");\
+    fwprintf(stderr, L"--- TESTS: %s ---\n\n", __FILE__);\
+    __run_tests_parallel(tests, n, jobs);\
+}
+
+/**
+ * Get every test defined with UNTIMED_TEST or TIMED_TEST in the program, from all of its object files, without
+ * listing them in an array. The compiler and linker may place them in any order, so the first call copies them into an
+ * array sorted by the name of the file they were defined in and then by line, which is the order they were defined in
+ * within each file. Later calls give the same array, with the results of the tests run from it. Tests in static
+ * libraries are only found if their object files are linked in for some other reason.
+ *
+ * @param  n Set to the number of tests.
+ * @return   The sorted registry of tests, which is kept for the rest of the program.
+ */
+Test *registered_tests(size_t *n);
+
+/**
+ * Run every test defined in the program. See registered_tests.
+ */
+#define run_registered_tests() {\
+    size_t __registered_n;\
+    Test *__registered = registered_tests(&__registered_n);\
+    run_tests(__registered, __registered_n);\
+}
+
+/**
+ * Run every test defined in the program across a pool of worker processes. See registered_tests and run_tests_parallel.
+ *
+ * @param jobs How many worker processes to use. Use 0 to use one per online processor.
+ */
+#define run_registered_tests_parallel(jobs) {\
+    size_t __registered_n;\
+    Test *__registered = registered_tests(&__registered_n);\
+    run_tests_parallel(__registered, __registered_n, jobs);\
+}
+
 /**
  * Run an array of benchmarks with the given settings.
  *
@@ -215,13 +883,78 @@ void __run_benchmarks(const Benchmark benchmarks[], const size_t n, const size_t
     __run_benchmarks(benchmarks, n, warmup, times);\
 }
 
+/**
+ * Get every benchmark defined with the benchmark macros in the program, in the same way as registered_tests.
+ *
+ * @param  n Set to the number of benchmarks.
+ * @return   The registry of benchmarks.
+ */
+Benchmark *registered_benchmarks(size_t *n);
+
+/**
+ * Run every benchmark defined in the program with the given settings. See registered_benchmarks.
+ *
+ * @param warmup Number of warmup iterations for each benchmark.
+ * @param times  Number of real iterations for each benchmark.
+ */
+#define run_registered_benchmarks(warmup, times) {\
+    size_t __registered_n;\
+    Benchmark *__registered = registered_benchmarks(&__registered_n);\
+    run_benchmarks(__registered, __registered_n, warmup, times);\
+}
+
+/**
+ * Machine-readable formats that test and benchmark results can be written in.
+ */
+typedef enum {
+    REPORT_NONE, /**< Do not write a report. */
+    REPORT_JSON, /**< A single JSON document per run. */
+    REPORT_CSV   /**< One CSV row per test or benchmark, with a header row. */
+} ReportFormat;
+
+/**
+ * Write a report of every test run by run_tests or run_tests_parallel to a file, in addition to the usual output.
+ * The file is overwritten by every run.
+ *
+ * @param format Format of the report. REPORT_NONE stops writing reports.
+ * @param path   Path of the file to write the report to.
+ */
+void use_test_report(const ReportFormat format, const char *path);
+
+/**
+ * Write a report of every benchmark run by run_benchmarks to a file, in addition to the usual output.
+ * The report contains every measured sample along with its statistics. The file is overwritten by every run.
+ *
+ * @param format Format of the report. REPORT_NONE stops writing reports.
+ * @param path   Path of the file to write the report to.
+ */
+void use_benchmark_report(const ReportFormat format, const char *path);
+
+/**
+ * Compare benchmarks against a benchmark report from a previous run (in either format).
+ * A benchmark has regressed if its median is slower than the median recorded in the baseline by more than the threshold.
+ * Benchmarks missing from the baseline are not compared.
+ *
+ * @param path      Path of the baseline report. NULL stops comparing against a baseline.
+ * @param threshold Largest allowed relative slowdown, e.g. 0.05 for 5%.
+ */
+void use_benchmark_baseline(const char *path, const double threshold);
+
+/**
+ * Count the number of benchmarks that regressed against the baseline in the last call to run_benchmarks.
+ * Add this to the exit code of your test program to fail the run when a benchmark slows down.
+ *
+ * @return Number of regressed benchmarks.
+ */
+size_t count_regressions(void);
+
 /**
  * Reset the number of recorded test failures.
  */
 void reset_failures(void);
 
 /**
- * Count the number of test failures in an array of tests .
+ * Count the number of test failures in an array of tests. Skipped tests have not failed.
  * Can only be called *after* running tests on an array of tests.
  *
  * @param  tests Array of tests that have been executed.
@@ -243,11 +976,8 @@ size_t count_failures(const Test tests[], const size_t n);
 
 // The general assert template for this test suite.
 #define __gen_assert__(name, ...) {\
-    const char *__fn_name = #name;\
-    __set_last_file(__FILE__);\
-    __set_last_caller(*__func__ == '_' ? __func__ + 2 : __func__);\
-    __set_last_line(__LINE__);\
-    __set_last_assert(__fn_name + 2);\
+    static const AssertLocation __location = { __FILE__, __func__, #name, __LINE__ };\
+    __set_last_location(&__location);\
     name(__VA_ARGS__);\
 }
 
@@ -351,6 +1081,46 @@ void __assert_double_equals(double a, double b, double epsilon);
 #define assert_double_not_equals(a, b, epsilon) __gen_assert__(__assert_double_not_equals, a, b, epsilon)
 void __assert_double_not_equals(double a, double b, double epsilon);
 
+/**
+ * How the difference between two floating point numbers is measured by the approximate array assertions.
+ *
+ * Two NaNs are always taken to be equal, as are two infinities of the same sign. Any other NaN or infinity makes the
+ * error infinite.
+ */
+typedef enum {
+    TOLERANCE_ABSOLUTE, /**< The error is abs(a - b). */
+    TOLERANCE_RELATIVE, /**< The error is abs(a - b) / max(abs(a), abs(b)), so 1e-6 allows a difference in the 6th digit. */
+    TOLERANCE_ULP       /**< The error is the number of representable numbers between a and b (units in the last place). */
+} ToleranceMode;
+
+/**
+ * Assert that two arrays of floats are approximately equal, by checking that the largest error between their items is
+ * at most a tolerance. The whole array is checked in a single vectorised pass. On failure, the worst item and
+ * statistics of the errors are reported.
+ *
+ * @param arr1      Pointer to the first array of floats.
+ * @param arr2      Pointer to the second array of floats.
+ * @param n         Number of items in each array.
+ * @param mode      How the error between two items is measured.
+ * @param tolerance Largest error (inclusive) allowed for any item.
+ */
+#define assert_float_array_near(arr1, arr2, n, mode, tolerance) __gen_assert__(__assert_float_array_near, arr1, arr2, n, mode, tolerance)
+void __assert_float_array_near(const float *arr1, const float *arr2, const size_t n, const ToleranceMode mode, const double tolerance);
+
+/**
+ * Assert that two arrays of doubles are approximately equal, by checking that the largest error between their items is
+ * at most a tolerance. The whole array is checked in a single vectorised pass. On failure, the worst item and
+ * statistics of the errors are reported.
+ *
+ * @param arr1      Pointer to the first array of doubles.
+ * @param arr2      Pointer to the second array of doubles.
+ * @param n         Number of items in each array.
+ * @param mode      How the error between two items is measured.
+ * @param tolerance Largest error (inclusive) allowed for any item.
+ */
+#define assert_double_array_near(arr1, arr2, n, mode, tolerance) __gen_assert__(__assert_double_array_near, arr1, arr2, n, mode, tolerance)
+void __assert_double_array_near(const double *arr1, const double *arr2, const size_t n, const ToleranceMode mode, const double tolerance);
+
 /**
  * Assert that two (null-terminated) strings are equal (contain the same characters).
  *
@@ -513,6 +1283,61 @@ void __assert_not_null(const void *ptr);
 #define assert_null(ptr) __gen_assert__(__assert_null, ptr)
 void __assert_null(const void *ptr);
 
+/**
+ * Assert that the running test has made at most a given number of allocations so far.
+ * Every call to testfunc_malloc, testfunc_calloc and testfunc_realloc counts as one allocation.
+ *
+ * @param n Maximum number of allocations.
+ */
+#define assert_max_allocations(n) __gen_assert__(__assert_max_allocations, n)
+void __assert_max_allocations(const size_t n);
+
+/**
+ * Assert that the running test has requested at most a given number of bytes in total so far.
+ *
+ * @param bytes Maximum number of bytes allocated over the whole test.
+ */
+#define assert_max_allocated_bytes(bytes) __gen_assert__(__assert_max_allocated_bytes, bytes)
+void __assert_max_allocated_bytes(const size_t bytes);
+
+/**
+ * Assert that the memory the running test has had allocated at once has so far stayed below a given number of bytes.
+ *
+ * @param bytes Number of bytes the peak must stay below.
+ */
+#define assert_peak_memory_below(bytes) __gen_assert__(__assert_peak_memory_below, bytes)
+void __assert_peak_memory_below(const size_t bytes);
+
+/**
+ * Assert that a buffer matches its golden snapshot, a file called name.snap in the snapshot directory.
+ *
+ * The snapshot is memory-mapped rather than read into heap memory, so it can be as large as needed. An index in the
+ * snapshot directory records the hash of each snapshot, so a snapshot that has not changed since it last matched is
+ * confirmed from the buffer's hash without reading it at all.
+ *
+ * @param buf  Pointer to the buffer to check.
+ * @param size Size of the buffer in bytes.
+ * @param name Name of the snapshot. It becomes part of a file name, so it should be unique to the test. Slashes in it
+ *             put the snapshot in subdirectories, which are created as needed.
+ */
+#define assert_matches_snapshot(buf, size, name) __gen_assert__(__assert_matches_snapshot, buf, size, name)
+void __assert_matches_snapshot(const void *buf, const size_t size, const char *name);
+
+/**
+ * Set the directory golden snapshots are kept in ("snapshots" by default).
+ *
+ * @param path Path to the directory, relative to the working directory of the tests.
+ */
+void use_snapshot_directory(const char *path);
+
+/**
+ * Set whether snapshot assertions record the buffer as the new snapshot, instead of failing, when their snapshot is
+ * missing or different. Use this to create snapshots or to accept a deliberate change in output.
+ *
+ * @param should_update Should missing and mismatched snapshots be rewritten?
+ */
+void use_snapshot_update(const bool should_update);
+
 /**
  * Assert that a function exits in under a given amount of time.
  *
@@ -536,6 +1361,87 @@ void __assert_time_limit(const TestFunction func, double time_limit);
 #define assert_time_limit_async(func, time_limit) __gen_assert__(__assert_time_limit_async, func, time_limit)
 void __assert_time_limit_async(const TestFunction func, double time_limit);
 
+/*
+ * With CATOM_INLINE_ASSERTS defined before this header is included, the simplest assertions check their condition
+ * where they are used, and only call into the library to report a failure or to print in verbose mode. This lets the
+ * compiler fold them into tight loops, as in benchmarks or tests built with the release library. Their arguments are
+ * still only evaluated once, after the location of the assertion is set.
+ */
+#ifdef CATOM_INLINE_ASSERTS
+// Inline assertions set the thread-local location of the last assertion themselves. This is the THREAD_LOCAL of
+// libs/threads.h, spelled out so that including this header does not pull in pthread.h or windows.h.
+extern __thread const AssertLocation *__last_location;
+extern const AssertLocation **__shared_location;
+extern bool __use_verbose_printing;
+
+// The same as __set_last_location, without the call.
+static inline void __set_last_location_inline(const AssertLocation *location) {
+    __last_location = location;
+
+    if (__shared_location) {
+        __atomic_store_n(__shared_location, location, __ATOMIC_RELEASE);
+    }
+}
+
+// The inline assert templates, for one, two and three arguments of a type, which the check refers to as __a, __b and
+// __c.
+#define __gen_inline_assert1__(name, type, check, a) {\
+    static const AssertLocation __location = { __FILE__, __func__, #name, __LINE__ };\
+    __set_last_location_inline(&__location);\
+    type const __a = (a);\
+    if (__builtin_expect(!(check) || __use_verbose_printing, 0)) {\
+        name(__a);\
+    }\
+}
+
+#define __gen_inline_assert2__(name, type, check, a, b) {\
+    static const AssertLocation __location = { __FILE__, __func__, #name, __LINE__ };\
+    __set_last_location_inline(&__location);\
+    type const __a = (a);\
+    type const __b = (b);\
+    if (__builtin_expect(!(check) || __use_verbose_printing, 0)) {\
+        name(__a, __b);\
+    }\
+}
+
+#define __gen_inline_assert3__(name, type, check, a, b, c) {\
+    static const AssertLocation __location = { __FILE__, __func__, #name, __LINE__ };\
+    __set_last_location_inline(&__location);\
+    type const __a = (a);\
+    type const __b = (b);\
+    type const __c = (c);\
+    if (__builtin_expect(!(check) || __use_verbose_printing, 0)) {\
+        name(__a, __b, __c);\
+    }\
+}
+
+#undef assert_true
+#undef assert_false
+#undef assert_uint_equals
+#undef assert_uint_not_equals
+#undef assert_sint_equals
+#undef assert_sint_not_equals
+#undef assert_float_equals
+#undef assert_float_not_equals
+#undef assert_double_equals
+#undef assert_double_not_equals
+#undef assert_not_null
+#undef assert_null
+
+#define assert_true(condition) __gen_inline_assert1__(__assert_true, bool, __a, condition)
+#define assert_false(condition) __gen_inline_assert1__(__assert_false, bool, !__a, condition)
+#define assert_uint_equals(a, b) __gen_inline_assert2__(__assert_uint_equals, uint64_t, __a == __b, a, b)
+#define assert_uint_not_equals(a, b) __gen_inline_assert2__(__assert_uint_not_equals, uint64_t, __a != __b, a, b)
+#define assert_sint_equals(a, b) __gen_inline_assert2__(__assert_sint_equals, int64_t, __a == __b, a, b)
+#define assert_sint_not_equals(a, b) __gen_inline_assert2__(__assert_sint_not_equals, int64_t, __a != __b, a, b)
+#define assert_float_equals(a, b, epsilon) __gen_inline_assert3__(__assert_float_equals, float, (float) (__a - __b) > -__c && (float) (__a - __b) < __c, a, b, epsilon)
+#define assert_float_not_equals(a, b, epsilon) __gen_inline_assert3__(__assert_float_not_equals, float, (float) (__a - __b) <= -__c || (float) (__a - __b) >= __c, a, b, epsilon)
+#define assert_double_equals(a, b, epsilon) __gen_inline_assert3__(__assert_double_equals, double, __a - __b > -__c && __a - __b < __c, a, b, epsilon)
+#define assert_double_not_equals(a, b, epsilon) __gen_inline_assert3__(__assert_double_not_equals, double, __a - __b <= -__c || __a - __b >= __c, a, b, epsilon)
+#define assert_not_null(ptr) __gen_inline_assert1__(__assert_not_null, const void *, __a != NULL, ptr)
+#define assert_null(ptr) __gen_inline_assert1__(__assert_null, const void *, __a == NULL, ptr)
+#endif
+
 /**
  * A safe memory allocation function that allows a lightly garbage collected allocation of heap memory.
  * This allows the use of heap memory inside a test function with asserts where asserts can occur before memory is freed.
@@ -565,7 +1471,8 @@ void *testfunc_calloc(const size_t n, const size_t size);
 /**
  * A safe memory reallocation function that allows a lightly garbage collected allocation of heap memory.
  * This allows the use of heap memory inside a test function with asserts where asserts can occur before memory is freed.
- * Use a NULL pointer for the ptr argument to make this function act like testfunc_malloc.
+ * Use a NULL pointer for the ptr argument to make this function act like testfunc_malloc, and 0 bytes to make it act like
+ * testfunc_free.
  *
  * WARNING: Do not free the allocated memory using free. Use testfunc_free to do so if you need to.
  *
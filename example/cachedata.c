@@ -0,0 +1,9 @@
+#include "cachedata.h"
+
+// These have the same names as globals in testcatom.c, and cache_global starts with a different value there.
+static volatile int cache_sink = 0;
+static volatile int cache_global = 2;
+
+void reads_other_cache_global(void) {
+    cache_sink = cache_global;
+}
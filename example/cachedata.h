@@ -0,0 +1,7 @@
+#ifndef __CACHEDATA_H__
+#define __CACHEDATA_H__
+
+// Reads a global that has the same name as one in testcatom.c, but starts with a different value.
+void reads_other_cache_global(void);
+
+#endif  // __CACHEDATA_H__
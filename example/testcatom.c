@@ -0,0 +1,895 @@
+#include "../catom.h"
+#include "../libs/arena.h"
+#include "../libs/arrcmp.h"
+#include "../libs/fpcmp.h"
+#include "../libs/hashing.h"
+#include "../libs/memalloc.h"
+#include "../libs/output.h"
+#include "../libs/property.h"
+#include "../libs/report.h"
+#include "../libs/selection.h"
+#include "../libs/snapshot.h"
+#include "../libs/stats.h"
+#include "../libs/testcache.h"
+#include "../libs/workpool.h"
+#include "cachedata.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifndef OS_WINDOWS
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// These tests check the behaviour of the suite itself, down to the modules in libs/ that its runners are built on.
+// Unlike testexample, every one of them should pass.
+
+// Hashing.
+
+UNTIMED_TEST(test_hash_known_answers, "Hashes match the published XXH64 values") {
+    const char *long_input = "Nobody inspects the spammish repetition";
+
+    assert_uint_equals(obj_hash("", 0), 0xEF46DB3751D8E999ull);
+    assert_uint_equals(obj_hash("a", 1), 0xD24EC4F1A98C6E5Bull);
+    assert_uint_equals(obj_hash("abc", 3), 0x44BC2CF5AD770999ull);
+    assert_uint_equals(obj_hash(long_input, strlen(long_input)), 0xFBCEA83C8A378BF1ull);
+}
+
+#define HASH_BYTES 200
+
+UNTIMED_TEST(test_hash_streaming, "Hashing in pieces gives the same hash as hashing everything at once") {
+    unsigned char data[HASH_BYTES];
+    for (size_t i = 0; i < HASH_BYTES; ++i) {
+        data[i] = (unsigned char) (i * 37u + 11u);
+    }
+
+    const size_t pieces[] = { 1, 3, 7, 31, 32, 33, 64, HASH_BYTES };
+
+    for (size_t length = 0; length <= HASH_BYTES; length += 13) {
+        uint64_t expected = obj_hash(data, length);
+
+        for (size_t p = 0; p < sizeof(pieces) / sizeof(size_t); ++p) {
+            HashState state;
+            hash_init(&state);
+
+            // Taking a digest part of the way through must not disturb the rest of the hash.
+            for (size_t done = 0; done < length; done += pieces[p]) {
+                hash_update(&state, data + done, length - done < pieces[p] ? length - done : pieces[p]);
+                hash_digest(&state);
+            }
+
+            assert_uint_equals(hash_digest(&state), expected);
+        }
+    }
+}
+
+// Test cache fingerprints.
+
+static volatile int cache_sink = 0;
+static volatile int cache_index = 0;
+static volatile int cache_global_a = 1;
+static volatile int cache_global_b = 1;
+static volatile int cache_global = 1;
+static const int cache_table_a[4] = { 1, 2, 3, 4 };
+static const int cache_table_a_copy[4] = { 1, 2, 3, 4 };
+static const int cache_table_b[4] = { 1, 2, 3, 5 };
+
+static void reads_global_a(void) {
+    cache_sink = cache_global_a;
+}
+
+static void reads_global_a_again(void) {
+    cache_sink = cache_global_a;
+}
+
+static void reads_global_b(void) {
+    cache_sink = cache_global_b;
+}
+
+static void reads_cache_global(void) {
+    cache_sink = cache_global;
+}
+
+static void reads_table_a(void) {
+    cache_sink = cache_table_a[cache_index];
+}
+
+static void reads_table_a_copy(void) {
+    cache_sink = cache_table_a_copy[cache_index];
+}
+
+static void reads_table_b(void) {
+    cache_sink = cache_table_b[cache_index];
+}
+
+UNTIMED_TEST(test_fingerprint_writable_data, "Fingerprints tell apart the globals that code writes and reads") {
+    uint64_t a = function_fingerprint(reads_global_a);
+
+    // Fingerprints are only taken from ELF symbol tables.
+    if (a != 0) {
+        assert_uint_equals(a, function_fingerprint(reads_global_a_again));
+        assert_uint_not_equals(a, function_fingerprint(reads_global_b));
+
+        // A global with the same name in another file changes the fingerprint by starting with a different value,
+        // but giving a global new values as the program runs does not.
+        uint64_t starts_one = function_fingerprint(reads_cache_global);
+        assert_uint_not_equals(starts_one, function_fingerprint(reads_other_cache_global));
+
+        cache_global = 2;
+        assert_uint_equals(starts_one, function_fingerprint(reads_cache_global));
+    }
+}
+
+UNTIMED_TEST(test_fingerprint_constant_data, "Fingerprints follow the contents of the constants that code reads") {
+    uint64_t a = function_fingerprint(reads_table_a);
+
+    if (a != 0) {
+        assert_uint_equals(a, function_fingerprint(reads_table_a_copy));
+        assert_uint_not_equals(a, function_fingerprint(reads_table_b));
+    }
+}
+
+// Buffered output.
+
+#ifndef OS_WINDOWS
+// Run a function in a child whose stderr goes to a pipe, and read back as much of what it wrote as fits. Returns how
+// the child ended.
+static int capture_child(void (*child)(void), char *captured, const size_t capacity) {
+    int pipes[2];
+    if (pipe(pipes) != 0) {
+        return -1;
+    }
+
+    output_flush();
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        output_discard();
+        close(pipes[0]);
+        dup2(pipes[1], STDERR_FILENO);
+        child();
+        _exit(0);
+    }
+
+    close(pipes[1]);
+
+    // The rest is read and dropped, so that the child never blocks on a full pipe.
+    size_t got = 0;
+    ssize_t result;
+    char rest[256];
+
+    while ((result = got + 1 < capacity ? read(pipes[0], captured + got, capacity - got - 1) : read(pipes[0], rest, sizeof(rest))) > 0) {
+        got += got + 1 < capacity ? (size_t) result : 0u;
+    }
+
+    captured[got] = '\0';
+    close(pipes[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return status;
+}
+
+static void crash_after_printing(void) {
+    output_install_crash_handlers();
+    output_printf("written before the crash\n");
+    raise(SIGSEGV);
+}
+
+UNTIMED_TEST(test_output_crash_flush, "Buffered output is written out on a crash, which then goes on as before") {
+    char captured[256];
+    int status = capture_child(crash_after_printing, captured, sizeof(captured));
+
+    assert_true(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    assert_string_equals(captured, "written before the crash\n");
+}
+#endif
+
+// The worker pool.
+
+#ifndef OS_WINDOWS
+#define POOL_JOBS 3
+
+// How each job of a pool went, as its collector saw it.
+typedef struct {
+    JobStatus statuses[POOL_JOBS];
+    size_t collected;
+    struct rlimit files;
+} PoolRun;
+
+static void finish_or_exit(const size_t job, void *payload __attribute__((unused)), void *context __attribute__((unused))) {
+    if (job == 1) {
+        // Give the parent time to collect the first job.
+        usleep(100000);
+        _exit(3);
+    }
+}
+
+static bool collect_and_starve(const size_t job, const JobStatus *status, void *payload __attribute__((unused)), const char *output __attribute__((unused)), const size_t length __attribute__((unused)), void *context) {
+    PoolRun *run = (PoolRun *) context;
+    run->statuses[job] = *status;
+    run->collected = job + 1u;
+
+    // Without any files to capture its output in, no worker can be started in place of one that dies.
+    if (job == 0) {
+        struct rlimit none = { 0, run->files.rlim_max };
+        setrlimit(RLIMIT_NOFILE, &none);
+    }
+
+    return true;
+}
+
+UNTIMED_TEST(test_pool_lost_jobs, "Jobs left when every worker has died are reported as lost, not crashed") {
+    PoolRun run;
+    memset(&run, 0, sizeof(PoolRun));
+    assert_true(getrlimit(RLIMIT_NOFILE, &run.files) == 0);
+
+    bool started = run_job_pool(POOL_JOBS, 1, 1, finish_or_exit, collect_and_starve, &run);
+    setrlimit(RLIMIT_NOFILE, &run.files);
+
+    assert_true(started);
+    assert_uint_equals(run.collected, POOL_JOBS);
+    assert_uint_equals(run.statuses[0].state, JOB_FINISHED);
+    assert_uint_equals(run.statuses[1].state, JOB_CRASHED);
+    assert_sint_equals(run.statuses[1].exit_code, 3);
+    assert_uint_equals(run.statuses[2].state, JOB_LOST);
+}
+
+static void finish_or_hang(const size_t job, void *payload __attribute__((unused)), void *context __attribute__((unused))) {
+    // Give the other worker time to take a job that hangs.
+    usleep(job == 0 ? 100000 : 10000000);
+}
+
+static bool collect_and_stop(const size_t job, const JobStatus *status, void *payload __attribute__((unused)), const char *output __attribute__((unused)), const size_t length __attribute__((unused)), void *context) {
+    PoolRun *run = (PoolRun *) context;
+    run->statuses[job] = *status;
+    run->collected = job + 1u;
+
+    return false;
+}
+
+UNTIMED_TEST(test_pool_stop, "Stopping a pool kills the workers still running a job instead of waiting for them") {
+    PoolRun run;
+    memset(&run, 0, sizeof(PoolRun));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool started = run_job_pool(POOL_JOBS, 2, 1, finish_or_hang, collect_and_stop, &run);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    assert_true(started);
+    assert_uint_equals(run.collected, 1);
+    assert_uint_equals(run.statuses[0].state, JOB_FINISHED);
+    assert_true(end.tv_sec - start.tv_sec < 5);
+}
+#endif
+
+// Test isolation.
+
+#ifndef OS_WINDOWS
+UNTIMED_TEST(isolated_crash, "Crashes after an assertion") {
+    assert_true(true);
+    raise(SIGSEGV);
+}
+
+TIMED_TEST(isolated_timeout, "Runs past its time limit", 0.05, true) {
+    sleep(2);
+}
+
+UNTIMED_TEST(isolated_pass, "Runs after a crash") {
+    assert_true(true);
+}
+
+static void run_isolated_tests(void) {
+    Test tests[] = { isolated_crash, isolated_timeout, isolated_pass };
+
+    use_test_isolation(true);
+    run_tests(tests, sizeof(tests) / sizeof(Test));
+    output_flush();
+
+    _exit((int) count_failures(tests, sizeof(tests) / sizeof(Test)));
+}
+
+UNTIMED_TEST(test_isolation, "Isolated tests that crash or time out fail without stopping the run") {
+    char captured[16384];
+    int status = capture_child(run_isolated_tests, captured, sizeof(captured));
+
+    assert_true(WIFEXITED(status));
+    assert_sint_equals(WEXITSTATUS(status), 2);
+
+    char killed[64];
+    snprintf(killed, sizeof(killed), "was killed by signal %d.", SIGSEGV);
+    assert_true(strstr(captured, killed) != NULL);
+    assert_true(strstr(captured, "The last assertion it reached was assert_true in isolated_crash") != NULL);
+    assert_true(strstr(captured, "FUNCTION EXITS IN") != NULL);
+    assert_true(strstr(captured, "Test passed. \"Runs after a crash\"") != NULL);
+}
+#endif
+
+// Snapshots.
+
+#ifndef OS_WINDOWS
+UNTIMED_TEST(test_snapshot_index, "Snapshots are confirmed from the index only while their files are unchanged") {
+    char directory[] = "/tmp/catom-snapshots-XXXXXX";
+    assert_true(mkdtemp(directory) != NULL);
+
+    set_snapshot_directory(directory);
+    SnapshotCheck check;
+
+    set_snapshot_update(true);
+    check_snapshot("first", 5, "index_test", &check);
+    assert_uint_equals(check.result, SNAPSHOT_UPDATED);
+
+    set_snapshot_update(false);
+    check_snapshot("first", 5, "index_test", &check);
+    assert_uint_equals(check.result, SNAPSHOT_CONFIRMED);
+
+    // Rewrite the file with as many bytes within the same second, as a quick edit would.
+    struct stat before;
+    assert_true(stat(check.path, &before) == 0);
+
+    FILE *file = fopen(check.path, "wb");
+    assert_true(file != NULL);
+    fputs("other", file);
+    fclose(file);
+
+    struct timespec times[2] = { before.st_atim, before.st_mtim };
+    times[1].tv_nsec = (times[1].tv_nsec + 1) % 1000000000L;
+    assert_true(utimensat(AT_FDCWD, check.path, times, 0) == 0);
+
+    check_snapshot("first", 5, "index_test", &check);
+    assert_uint_equals(check.result, SNAPSHOT_MISMATCHED);
+    assert_uint_equals(check.mismatch, 0);
+
+    check_snapshot("other", 5, "index_test", &check);
+    assert_uint_equals(check.result, SNAPSHOT_MATCHED);
+
+    // Names with slashes are written into directories of their own.
+    SnapshotCheck nested;
+    set_snapshot_update(true);
+    check_snapshot("nested", 6, "group/deeper/index_test", &nested);
+    assert_uint_equals(nested.result, SNAPSHOT_UPDATED);
+    set_snapshot_update(false);
+
+    // Every snapshot was recorded by appending to the index. Loading it again keeps the last line for each of them,
+    // and compacts it to one line each.
+    set_snapshot_directory(directory);
+    check_snapshot("other", 5, "index_test", &check);
+    assert_uint_equals(check.result, SNAPSHOT_CONFIRMED);
+    check_snapshot("nested", 6, "group/deeper/index_test", &nested);
+    assert_uint_equals(nested.result, SNAPSHOT_CONFIRMED);
+
+    char index[SNAPSHOT_PATH_LENGTH + 16];
+    snprintf(index, sizeof(index), "%s/%s", directory, SNAPSHOT_INDEX_NAME);
+
+    FILE *lines = fopen(index, "r");
+    assert_true(lines != NULL);
+
+    size_t line_count = 0;
+    for (int c = fgetc(lines); c != EOF; c = fgetc(lines)) {
+        line_count += c == '\n';
+    }
+
+    fclose(lines);
+    assert_uint_equals(line_count, 3);
+
+    char group[SNAPSHOT_PATH_LENGTH + 16];
+    remove(nested.path);
+    snprintf(group, sizeof(group), "%s/group/deeper", directory);
+    rmdir(group);
+    snprintf(group, sizeof(group), "%s/group", directory);
+    rmdir(group);
+    remove(check.path);
+    remove(index);
+    rmdir(directory);
+}
+#endif
+
+// The registry.
+
+UNTIMED_TEST(test_registry_order, "Registered tests are in the order they were defined in") {
+    size_t n;
+    Test *registered = registered_tests(&n);
+
+    // Every test in this program is defined in this file, and this one is not the first.
+    assert_true(n > 1);
+    assert_string_equals(test_registry_order.name, "Registered tests are in the order they were defined in");
+    for (size_t i = 1; i < n; ++i) {
+        assert_string_equals(registered[i - 1].file, registered[i].file);
+        assert_true(registered[i - 1].line < registered[i].line);
+    }
+}
+
+// Test selection.
+
+UNTIMED_TEST(test_glob_match, "Globs match any run of characters with * and any one character with ?") {
+    assert_true(glob_match("*", ""));
+    assert_true(glob_match("*", "anything"));
+    assert_true(glob_match("**", "anything"));
+    assert_true(glob_match("", ""));
+    assert_true(!glob_match("", "a"));
+    assert_true(glob_match("?", "a"));
+    assert_true(!glob_match("?", ""));
+    assert_true(!glob_match("?", "ab"));
+    assert_true(glob_match("a?c", "abc"));
+    assert_true(glob_match("*c", "abcabc"));
+    assert_true(glob_match("a*b*c", "aXbYbZc"));
+    assert_true(!glob_match("a*b*c", "aXbYbZ"));
+    assert_true(glob_match("*?", "a"));
+    assert_true(!glob_match("*?", ""));
+    assert_true(glob_match("parser*", "parser"));
+    assert_true(!glob_match("parser", "parser test"));
+}
+
+UNTIMED_TEST(test_filter_match, "Filters pass names that match an including pattern and no excluding one") {
+    assert_true(filter_match("", "anything"));
+    assert_true(filter_match("parser*", "parser numbers"));
+    assert_true(!filter_match("parser*", "lexer numbers"));
+    assert_true(filter_match("parser*,lexer*", "lexer numbers"));
+
+    // Names that match an excluding pattern never pass, wherever it is in the list.
+    assert_true(!filter_match("parser*,-*slow*", "parser slow path"));
+    assert_true(!filter_match("-*slow*,parser*", "parser slow path"));
+    assert_true(filter_match("parser*,-*slow*", "parser fast path"));
+
+    // With only excluding patterns, everything else passes.
+    assert_true(filter_match("-*slow*", "lexer numbers"));
+    assert_true(!filter_match("-*slow*", "lexer slow path"));
+
+    // Empty patterns, even negated ones, are ignored.
+    assert_true(filter_match(",-,", "anything"));
+    assert_true(filter_match("parser*,,-", "parser numbers"));
+}
+
+#define SHARD_JOBS 8
+#define SHARDS 3
+
+UNTIMED_TEST(test_shard_assignment, "Shards cover every job once and balance what they cost") {
+    const double costs[SHARD_JOBS] = { 1, 8, 3, 6, 2, 7, 4, 5 };
+    size_t shards[SHARD_JOBS];
+    double loads[SHARDS] = { 0 };
+
+    assert_true(assign_shards(costs, SHARD_JOBS, SHARDS, shards));
+
+    double total = 0;
+    for (size_t job = 0; job < SHARD_JOBS; ++job) {
+        assert_true(shards[job] < SHARDS);
+        loads[shards[job]] += costs[job];
+        total += costs[job];
+    }
+
+    // Each job is in exactly one shard, so together the shards cost as much as all the jobs. The greedy split of
+    // these comes to 13, 12 and 11.
+    assert_double_equals(loads[0] + loads[1] + loads[2], total, 1e-9);
+    assert_double_equals(loads[0], 13, 1e-9);
+    assert_double_equals(loads[1], 12, 1e-9);
+    assert_double_equals(loads[2], 11, 1e-9);
+
+    // Jobs that all cost the same are dealt out in turn.
+    const double same[SHARD_JOBS] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+    assert_true(assign_shards(same, SHARD_JOBS, SHARDS, shards));
+
+    for (size_t job = 0; job < SHARD_JOBS; ++job) {
+        assert_uint_equals(shards[job], job % SHARDS);
+    }
+
+    // A single shard takes everything.
+    assert_true(assign_shards(costs, SHARD_JOBS, 1, shards));
+
+    for (size_t job = 0; job < SHARD_JOBS; ++job) {
+        assert_uint_equals(shards[job], 0);
+    }
+}
+
+// Property tests.
+
+// A list of up to 8 numbers, which fails once any of them is 10 or more.
+static bool has_large_number(void *context __attribute__((unused))) {
+    size_t n = (size_t) choices_draw(8);
+    bool large = false;
+
+    for (size_t i = 0; i < n; ++i) {
+        large = choices_draw(1000) >= 10 || large;
+    }
+
+    return large;
+}
+
+UNTIMED_TEST(test_shrinking, "Failing cases shrink to the simplest choices that still fail") {
+    uint64_t choices[] = { 5, 3, 700, 20, 999, 1 };
+    uint64_t *shrunk = choices;
+    size_t steps;
+
+    size_t n = shrink_choices(&shrunk, sizeof(choices) / sizeof(uint64_t), has_large_number, NULL, &steps);
+
+    // A list of one number, which is the smallest one that fails.
+    assert_uint_equals(n, 2);
+    assert_uint_equals(shrunk[0], 1);
+    assert_uint_equals(shrunk[1], 10);
+    assert_true(steps > 0);
+}
+
+// Reports and baselines.
+
+// Write a report of benchmarks with awkward names, then load it back as a baseline.
+static size_t reload_baseline(const ReportFormat format, const char **names, const size_t n, BaselineEntry **out) {
+    char path[] = "/tmp/catom-baseline-XXXXXX";
+    FILE *report = NULL;
+
+#ifdef OS_WINDOWS
+    report = tmpnam(path) ? fopen(path, "wb") : NULL;
+#else
+    int fd = mkstemp(path);
+    report = fd >= 0 ? fdopen(fd, "wb") : NULL;
+#endif
+
+    if (!report) {
+        return 0;
+    }
+
+    const Reporter *reporter = get_reporter(format);
+    BenchmarkEnvironment environment;
+    memset(&environment, 0, sizeof(BenchmarkEnvironment));
+
+    // Instruments hold names of their own, which must not be taken for the benchmark's.
+    InstrumentTotal instrument = { .name = "median", .kind = INSTRUMENT_COUNTER, .count = 1, .total = 7, .min = 7, .max = 7 };
+
+    reporter->begin_benchmarks(report, &environment);
+    for (size_t i = 0; i < n; ++i) {
+        BenchmarkResult result;
+        memset(&result, 0, sizeof(BenchmarkResult));
+
+        result.name = names[i];
+        result.unit = "ns";
+        result.stats.median = 10.0 * (double) (i + 1u);
+        result.environment = &environment;
+        result.instruments = &instrument;
+        result.instrument_count = 1;
+
+        reporter->benchmark(report, &result, i);
+    }
+    reporter->end_benchmarks(report, 0, 1.0);
+    fclose(report);
+
+    size_t loaded = load_baseline(path, out);
+    remove(path);
+
+    return loaded;
+}
+
+UNTIMED_TEST(test_baseline_parsing, "Baselines load back the names and medians their reports were written with") {
+    const char *names[] = { "plain", "with, a comma", "with \"quotes\"", "with a\nline break", "\"median\": 99" };
+    const size_t n = sizeof(names) / sizeof(const char *);
+    const ReportFormat formats[] = { REPORT_JSON, REPORT_CSV };
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(ReportFormat); ++f) {
+        BaselineEntry *entries = NULL;
+        assert_uint_equals(reload_baseline(formats[f], names, n, &entries), n);
+
+        for (size_t i = 0; i < n; ++i) {
+            const BaselineEntry *entry = find_baseline(entries, n, names[i]);
+
+            assert_true(entry != NULL);
+            assert_double_equals(entry->value, 10.0 * (double) (i + 1u), 1e-9);
+        }
+
+        free(entries);
+    }
+}
+
+// Statistics.
+
+UNTIMED_TEST(test_sample_stats, "Summaries of fixed samples have the expected percentiles, spread and interval") {
+    const double samples[10] = { 7, 3, 10, 1, 5, 9, 2, 8, 4, 6 };
+    double scratch[10];
+    SampleStats stats;
+
+    summarise_samples(samples, 10, scratch, &stats);
+    assert_uint_equals(stats.n, 10);
+    assert_double_equals(stats.min, 1, 1e-9);
+    assert_double_equals(stats.max, 10, 1e-9);
+    assert_double_equals(stats.median, 5.5, 1e-9);
+    assert_double_equals(stats.p90, 9.1, 1e-9);
+    assert_double_equals(stats.p99, 9.91, 1e-9);
+    assert_double_equals(stats.mean, 5.5, 1e-9);
+    assert_double_equals(stats.stddev, 3.0276503540974917, 1e-9);
+    assert_double_equals(stats.mad, 2.5, 1e-9);
+    assert_uint_equals(stats.outliers, 0);
+    assert_double_equals(stats.inlier_mean, 5.5, 1e-9);
+    assert_double_equals(stats.ci_low, 3.3342998822551633, 1e-9);
+    assert_double_equals(stats.ci_high, 7.665700117744837, 1e-9);
+
+    // The samples are left in the order they were given.
+    assert_double_equals(samples[0], 7, 1e-9);
+}
+
+UNTIMED_TEST(test_sample_outliers, "Samples far from the median by its absolute deviation are outliers") {
+    const double samples[8] = { 9, 10, 11, 10, 9, 11, 10, 100 };
+    double scratch[8];
+    SampleStats stats;
+
+    summarise_samples(samples, 8, scratch, &stats);
+    assert_double_equals(stats.median, 10, 1e-9);
+    assert_double_equals(stats.mad, 1, 1e-9);
+    assert_uint_equals(stats.outliers, 1);
+    assert_double_equals(stats.inlier_mean, 10, 1e-9);
+    assert_true(is_outlier(&stats, 100));
+    assert_true(is_outlier(&stats, 16));
+    assert_true(!is_outlier(&stats, 13));
+}
+
+UNTIMED_TEST(test_degenerate_samples, "A single sample or samples that are all the same have no spread or outliers") {
+    double scratch[5];
+    SampleStats stats;
+
+    const double one[1] = { 4 };
+    summarise_samples(one, 1, scratch, &stats);
+    assert_uint_equals(stats.n, 1);
+    assert_double_equals(stats.min, 4, 1e-9);
+    assert_double_equals(stats.median, 4, 1e-9);
+    assert_double_equals(stats.p99, 4, 1e-9);
+    assert_double_equals(stats.max, 4, 1e-9);
+    assert_double_equals(stats.stddev, 0, 1e-9);
+    assert_double_equals(stats.mad, 0, 1e-9);
+    assert_uint_equals(stats.outliers, 0);
+    assert_double_equals(stats.ci_low, 4, 1e-9);
+    assert_double_equals(stats.ci_high, 4, 1e-9);
+
+    const double same[5] = { 3, 3, 3, 3, 3 };
+    summarise_samples(same, 5, scratch, &stats);
+    assert_double_equals(stats.median, 3, 1e-9);
+    assert_double_equals(stats.p90, 3, 1e-9);
+    assert_double_equals(stats.stddev, 0, 1e-9);
+    assert_double_equals(stats.mad, 0, 1e-9);
+    assert_uint_equals(stats.outliers, 0);
+    assert_double_equals(stats.inlier_mean, 3, 1e-9);
+    assert_double_equals(stats.ci_low, 3, 1e-9);
+    assert_double_equals(stats.ci_high, 3, 1e-9);
+
+    // With no spread, nothing counts as an outlier.
+    assert_true(!is_outlier(&stats, 1000));
+}
+
+#define FIT_SIZES 5
+
+UNTIMED_TEST(test_fit_complexity, "Times that grow exactly with a complexity are fitted to it") {
+    const double sizes[FIT_SIZES] = { 2, 4, 8, 16, 32 };
+    double times[FIT_SIZES];
+    ComplexityFit fit;
+
+    for (size_t i = 0; i < FIT_SIZES; ++i) {
+        times[i] = 3.0 * sizes[i] * sizes[i];
+    }
+
+    assert_true(fit_complexity(sizes, times, FIT_SIZES, &fit));
+    assert_uint_equals(fit.complexity, COMPLEXITY_N_SQUARED);
+    assert_double_equals(fit.coefficient, 3, 1e-9);
+    assert_double_equals(fit.rms, 0, 1e-9);
+
+    for (size_t i = 0; i < FIT_SIZES; ++i) {
+        times[i] = 5.0 * sizes[i] * log2(sizes[i]);
+    }
+
+    assert_true(fit_complexity(sizes, times, FIT_SIZES, &fit));
+    assert_uint_equals(fit.complexity, COMPLEXITY_N_LOG_N);
+    assert_double_equals(fit.coefficient, 5, 1e-9);
+
+    for (size_t i = 0; i < FIT_SIZES; ++i) {
+        times[i] = 7.0;
+    }
+
+    assert_true(fit_complexity(sizes, times, FIT_SIZES, &fit));
+    assert_uint_equals(fit.complexity, COMPLEXITY_1);
+    assert_double_equals(fit.coefficient, 7, 1e-9);
+
+    // A single size, or times that are not positive, cannot be fitted.
+    const double one_size[FIT_SIZES] = { 8, 8, 8, 8, 8 };
+    assert_true(!fit_complexity(one_size, times, FIT_SIZES, &fit));
+    assert_true(!fit_complexity(sizes, times, 1, &fit));
+
+    times[2] = 0.0;
+    assert_true(!fit_complexity(sizes, times, FIT_SIZES, &fit));
+}
+
+// Allocation tracking.
+
+UNTIMED_TEST(test_allocation_table, "Freeing allocations in any order leaves the rest of them tracked") {
+    enum { COUNT = 4096 };
+    static void *pointers[COUNT];
+
+    size_t live = get_allocation_stats()->live_allocations;
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        pointers[i] = testfunc_malloc(1 + i % 64);
+        assert_true(pointers[i] != NULL);
+    }
+
+    assert_uint_equals(get_allocation_stats()->live_allocations, live + COUNT);
+
+    // Free every other one in a scattered order, which moves entries of the hash table back over the freed ones.
+    size_t freed = 0;
+    for (size_t k = 0, i = 0; k < COUNT; ++k, i = (i + 2749) % COUNT) {
+        if (i % 2 == 0) {
+            testfunc_free(pointers[i]);
+            pointers[i] = NULL;
+            ++freed;
+        }
+    }
+
+    assert_uint_equals(get_allocation_stats()->live_allocations, live + COUNT - freed);
+
+    // Every allocation that is left can still be found, and grown.
+    for (size_t i = 1; i < COUNT; i += 2) {
+        pointers[i] = testfunc_realloc(pointers[i], 128);
+        assert_true(pointers[i] != NULL);
+    }
+
+    for (size_t i = 1; i < COUNT; i += 2) {
+        testfunc_free(pointers[i]);
+    }
+
+    assert_uint_equals(get_allocation_stats()->live_allocations, live);
+}
+
+#define ARENA_ALLOCATIONS 64
+
+UNTIMED_TEST(test_arena_owns, "The arena owns the starts of its live allocations and nothing else") {
+    unsigned char *allocations[ARENA_ALLOCATIONS];
+
+    // Enough of these to take up several chunks.
+    for (size_t i = 0; i < ARENA_ALLOCATIONS; ++i) {
+        allocations[i] = (unsigned char *) arena_alloc(ARENA_CHUNK_SIZE / 8);
+        assert_true(allocations[i] != NULL);
+        memset(allocations[i], 0, ARENA_CHUNK_SIZE / 8);
+    }
+
+    for (size_t i = 0; i < ARENA_ALLOCATIONS; ++i) {
+        assert_true(arena_owns(allocations[i]));
+        assert_true(!arena_owns(allocations[i] + 1));
+        assert_true(!arena_owns(allocations[i] + ARENA_ALIGNMENT));
+        assert_true(!arena_owns(allocations[i] + 2 * ARENA_ALIGNMENT));
+        assert_uint_equals(arena_allocation_size(allocations[i]), ARENA_CHUNK_SIZE / 8);
+    }
+
+    // Pointers into the middle of an allocation are never freed, not even by way of a copied header.
+    size_t bytes = 0;
+    memcpy(allocations[0] + 2 * ARENA_ALIGNMENT, allocations[1] - 2 * ARENA_ALIGNMENT, 2 * ARENA_ALIGNMENT);
+    assert_true(!arena_owns(allocations[0] + 4 * ARENA_ALIGNMENT));
+    assert_true(!arena_free(allocations[0] + 4 * ARENA_ALIGNMENT, &bytes));
+    assert_true(arena_owns(allocations[0]));
+
+    assert_true(arena_free(allocations[0], &bytes));
+    assert_uint_equals(bytes, ARENA_CHUNK_SIZE / 8);
+    assert_true(!arena_owns(allocations[0]));
+    assert_true(!arena_free(allocations[0], &bytes));
+
+    int on_stack = 0;
+    assert_true(!arena_owns(&on_stack));
+
+    // A reset forgets every allocation, even where a new allocation still holds the old headers.
+    arena_reset();
+    assert_true(!arena_owns(allocations[1]));
+
+    unsigned char *again = (unsigned char *) arena_alloc(ARENA_CHUNK_SIZE / 4);
+    assert_true(again == allocations[0]);
+    assert_true(arena_owns(again));
+    assert_true(!arena_owns(allocations[1]));
+
+    arena_release();
+}
+
+UNTIMED_TEST(test_realloc_to_zero, "Reallocating to no bytes frees the allocation once") {
+    size_t live = get_allocation_stats()->live_allocations;
+
+    void *pointer = testfunc_malloc(32);
+    assert_true(pointer != NULL);
+    assert_true(testfunc_realloc(pointer, 0) == NULL);
+
+    // Had it stayed tracked, it would be freed again when the test ends.
+    assert_uint_equals(get_allocation_stats()->live_allocations, live);
+}
+
+// Vectorised comparisons.
+
+static size_t first_mismatch_scalar(const unsigned char *a, const unsigned char *b, const size_t n) {
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) {
+        ++i;
+    }
+
+    return i;
+}
+
+UNTIMED_TEST(test_first_mismatch, "The first mismatch of two buffers is found at every length and offset") {
+    unsigned char a[300];
+    unsigned char b[300];
+
+    for (size_t i = 0; i < sizeof(a); ++i) {
+        a[i] = (unsigned char) (i * 31u + 7u);
+    }
+
+    // Misaligned starts as well, as the kernels read whole vectors.
+    for (size_t start = 0; start < 4; ++start) {
+        for (size_t n = 0; n + start <= sizeof(a); n += 7) {
+            for (size_t at = 0; at <= n; ++at) {
+                memcpy(b, a, sizeof(a));
+
+                if (at < n) {
+                    b[start + at] ^= 0x80u;
+                }
+
+                assert_uint_equals(first_mismatch(a + start, b + start, n), first_mismatch_scalar(a + start, b + start, n));
+                assert_true(memory_is_equals(a + start, b + start, n) == (at == n));
+            }
+        }
+    }
+}
+
+UNTIMED_TEST(test_max_error, "Vectorised floating point errors match the scalar statistics") {
+    enum { COUNT = 259 };
+    float fa[COUNT], fb[COUNT];
+    double da[COUNT], db[COUNT];
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        da[i] = sin((double) i) * 100.0;
+        db[i] = da[i] + cos((double) i * 3.0) * 1e-3 * (double) (i % 17);
+        fa[i] = (float) da[i];
+        fb[i] = (float) db[i];
+    }
+
+    const ToleranceMode modes[] = { TOLERANCE_ABSOLUTE, TOLERANCE_RELATIVE, TOLERANCE_ULP };
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(ToleranceMode); ++m) {
+        // Every length up to a few vectors past the widest, so that each kernel's tail is run too.
+        for (size_t n = 0; n <= COUNT; n += n < 40 ? 1 : 73) {
+            ErrorStats stats;
+
+            double_array_error_stats(da, db, n, modes[m], 0.0, &stats);
+            assert_double_equals(double_array_max_error(da, db, n, modes[m]), stats.max_error, 1e-12 * (1.0 + stats.max_error));
+
+            float_array_error_stats(fa, fb, n, modes[m], 0.0, &stats);
+            assert_double_equals(float_array_max_error(fa, fb, n, modes[m]), stats.max_error, 1e-6 * (1.0 + stats.max_error));
+        }
+    }
+}
+
+int main(void) {
+    Test TESTS[] = {
+        test_registry_order,
+        test_hash_known_answers,
+        test_hash_streaming,
+        test_glob_match,
+        test_filter_match,
+        test_shard_assignment,
+        test_fingerprint_writable_data,
+        test_fingerprint_constant_data,
+        test_shrinking,
+        test_baseline_parsing,
+        test_sample_stats,
+        test_sample_outliers,
+        test_degenerate_samples,
+        test_fit_complexity,
+        test_allocation_table,
+        test_arena_owns,
+        test_realloc_to_zero,
+        test_first_mismatch,
+        test_max_error,
+#ifndef OS_WINDOWS
+        test_output_crash_flush,
+        test_pool_lost_jobs,
+        test_pool_stop,
+        test_isolation,
+        test_snapshot_index
+#endif
+    };
+
+    run_tests(TESTS, sizeof(TESTS) / sizeof(Test));
+
+    return count_failures(TESTS, sizeof(TESTS) / sizeof(Test));
+}
@@ -20,19 +20,25 @@ UNTIMED_TEST(test_failing, "This test will always fail") {
     assert_true(false);
 }
 
-BENCHMARK(benchmark_fma, "Performance check for fma") {
-    for (int i = 0; i < 1000; ++i) {
+BENCHMARK_N(benchmark_fma, "Performance check for fma", iterations) {
+    for (size_t i = 0; i < iterations; ++i) {
         float a = 16.5f;
         float b = 18.5f;
         float c = 2.0f;
 
         float t = exm_fma(a, b, c);
+        catom_do_not_optimize(t);
     }
 }
 
+BENCHMARK_WITH_TIMER(benchmark_fma_cycles, "Performance check for fma in cycles", TIMER_CYCLES) {
+    float t = exm_fma(16.5f, 18.5f, 2.0f);
+    catom_do_not_optimize(t);
+}
+
 int main(void) {
     Test TESTS[] = { test_fma_correct_result, test_fma_negatives, test_failing };
-    const Benchmark BENCHMARKS[] = { benchmark_fma };
+    const Benchmark BENCHMARKS[] = { benchmark_fma, benchmark_fma_cycles };
 
     run_tests(TESTS, sizeof(TESTS) / sizeof(Test));
     run_benchmarks(BENCHMARKS, sizeof(BENCHMARKS) / sizeof(Benchmark), 5, 5);
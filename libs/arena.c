@@ -0,0 +1,254 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * What precedes every allocation, padded so that the allocation itself stays aligned.
+ */
+typedef struct {
+    size_t bytes;    /**< Number of bytes requested. */
+    uintptr_t check; /**< Mixes the address of the allocation with the reset it was made in, or 0 once given back. */
+} AllocationHeader;
+
+#define HEADER_SIZE (((sizeof(AllocationHeader) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT)
+
+// Mixed into the check of every live allocation, so that data that happens to look like a header is not taken as one.
+#define LIVE_MAGIC ((uintptr_t) 0x9E3779B97F4A7C15ull)
+
+// Chunk bookkeeping is padded the same way.
+#define CHUNK_HEADER_SIZE (((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT)
+
+static ArenaChunk *first = NULL;
+static ArenaChunk *current = NULL;
+
+// Every chunk, sorted by address, to find the one a pointer is in.
+static ArenaChunk **chunks = NULL;
+static size_t chunk_count = 0;
+static size_t chunk_capacity = 0;
+
+// Number of resets so far. Chunks last used in an earlier one hold no live allocations.
+static size_t generation = 0;
+
+// Most recent allocation, which can still be grown or rolled back in place.
+static unsigned char *last = NULL;
+
+static unsigned char *chunk_data(const ArenaChunk *chunk) {
+    return (unsigned char *) chunk + CHUNK_HEADER_SIZE;
+}
+
+static size_t round_up(const size_t bytes) {
+    return (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+static AllocationHeader read_header(const void *ptr) {
+    AllocationHeader header;
+    memcpy(&header, (const unsigned char *) ptr - HEADER_SIZE, sizeof(AllocationHeader));
+
+    return header;
+}
+
+static void write_header(void *ptr, const size_t bytes, const uintptr_t check) {
+    AllocationHeader header = { bytes, check };
+    memcpy((unsigned char *) ptr - HEADER_SIZE, &header, sizeof(AllocationHeader));
+}
+
+static uintptr_t live_check(const void *ptr) {
+    return (uintptr_t) ptr ^ LIVE_MAGIC ^ (uintptr_t) generation;
+}
+
+static size_t allocation_size(const void *ptr) {
+    return read_header(ptr).bytes;
+}
+
+// Start using a chunk in the current reset.
+static void use_chunk(ArenaChunk *chunk) {
+    chunk->used = 0;
+    chunk->generation = generation;
+}
+
+// Count the chunks that start at or before an address. The last of them is the only one that can hold it.
+static size_t chunks_up_to(const void *ptr) {
+    size_t low = 0;
+    size_t high = chunk_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if ((uintptr_t) chunks[middle] <= (uintptr_t) ptr) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static ArenaChunk *new_chunk(const size_t size) {
+    if (chunk_count == chunk_capacity) {
+        size_t capacity = chunk_capacity > 0 ? chunk_capacity * 2 : 16;
+
+        ArenaChunk **grown = (ArenaChunk **) realloc(chunks, capacity * sizeof(ArenaChunk *));
+        if (!grown) {
+            return NULL;
+        }
+
+        chunks = grown;
+        chunk_capacity = capacity;
+    }
+
+    ArenaChunk *chunk = (ArenaChunk *) malloc(CHUNK_HEADER_SIZE + size);
+    if (!chunk) {
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->size = size;
+    use_chunk(chunk);
+
+    size_t i = chunks_up_to(chunk);
+    memmove(chunks + i + 1, chunks + i, (chunk_count - i) * sizeof(ArenaChunk *));
+    chunks[i] = chunk;
+    ++chunk_count;
+
+    return chunk;
+}
+
+void *arena_alloc(const size_t bytes) {
+    size_t needed = HEADER_SIZE + round_up(bytes);
+
+    if (needed < bytes) {
+        return NULL;
+    }
+
+    // Skip ahead through chunks kept from before the last reset until one has room.
+    while (current && current->size - current->used < needed && current->next) {
+        current = current->next;
+        use_chunk(current);
+    }
+
+    if (!current || current->size - current->used < needed) {
+        ArenaChunk *chunk = new_chunk(needed > ARENA_CHUNK_SIZE ? needed : ARENA_CHUNK_SIZE);
+        if (!chunk) {
+            return NULL;
+        }
+
+        if (current) {
+            chunk->next = current->next;
+            current->next = chunk;
+        } else {
+            first = chunk;
+        }
+
+        current = chunk;
+    }
+
+    last = chunk_data(current) + current->used + HEADER_SIZE;
+    write_header(last, bytes, live_check(last));
+
+    current->used += needed;
+
+    return last;
+}
+
+void *arena_realloc(void *ptr, const size_t bytes) {
+    if (!ptr) {
+        return arena_alloc(bytes);
+    }
+
+    size_t old_bytes = allocation_size(ptr);
+
+    if (ptr == last) {
+        size_t start = (size_t) (last - chunk_data(current)) - HEADER_SIZE;
+        size_t needed = HEADER_SIZE + round_up(bytes);
+
+        if (needed >= bytes && current->size - start >= needed) {
+            write_header(last, bytes, live_check(last));
+            current->used = start + needed;
+
+            return ptr;
+        }
+    }
+
+    void *mem = arena_alloc(bytes);
+    if (mem) {
+        memcpy(mem, ptr, old_bytes < bytes ? old_bytes : bytes);
+    }
+
+    return mem;
+}
+
+bool arena_free(void *ptr, size_t *bytes) {
+    if (!ptr || !arena_owns(ptr)) {
+        return false;
+    }
+
+    *bytes = allocation_size(ptr);
+
+    if (ptr == last) {
+        current->used = (size_t) (last - chunk_data(current)) - HEADER_SIZE;
+        last = NULL;
+    } else {
+        write_header(ptr, *bytes, 0);
+    }
+
+    return true;
+}
+
+bool arena_owns(const void *ptr) {
+    size_t i = chunks_up_to(ptr);
+    if (i == 0 || chunks[i - 1]->generation != generation) {
+        return false;
+    }
+
+    // Allocations start a header past a multiple of the alignment into their chunk, within what has been handed out.
+    const ArenaChunk *chunk = chunks[i - 1];
+    uintptr_t offset = (uintptr_t) ptr - (uintptr_t) chunk_data(chunk);
+
+    if ((uintptr_t) ptr < (uintptr_t) chunk_data(chunk) || offset < HEADER_SIZE || offset >= chunk->used || offset % ARENA_ALIGNMENT != 0) {
+        return false;
+    }
+
+    return read_header(ptr).check == live_check(ptr);
+}
+
+size_t arena_allocation_size(const void *ptr) {
+    return allocation_size(ptr);
+}
+
+void arena_reset(void) {
+    ++generation;
+    current = first;
+    last = NULL;
+
+    if (current) {
+        use_chunk(current);
+    }
+}
+
+void arena_abandon(void) {
+    // Whatever still uses the chunks may still look them up, so the list of them is forgotten too rather than freed.
+    first = NULL;
+    current = NULL;
+    last = NULL;
+    chunks = NULL;
+    chunk_count = 0;
+    chunk_capacity = 0;
+}
+
+void arena_release(void) {
+    while (first) {
+        ArenaChunk *next = first->next;
+        free(first);
+        first = next;
+    }
+
+    free(chunks);
+    chunks = NULL;
+    chunk_count = 0;
+    chunk_capacity = 0;
+    current = NULL;
+    last = NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Alignment of every arena allocation.
+#define ARENA_ALIGNMENT 16
+
+// Size of the chunks the arena carves allocations out of. Larger allocations get a chunk of their own.
+#define ARENA_CHUNK_SIZE ((size_t) 64 * 1024)
+
+/**
+ * A chunk of memory that allocations are bumped out of. Chunks are kept in a list and reused after a reset.
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk *next; /**< Next chunk in the arena. */
+    size_t size;             /**< Number of usable bytes in the chunk. */
+    size_t used;             /**< Number of bytes handed out since the last reset. */
+    size_t generation;       /**< Reset the chunk was last used in. Its used bytes mean nothing in any other. */
+} ArenaChunk;
+
+// Allocate bytes from the arena, aligned to ARENA_ALIGNMENT. Returns NULL if no chunk could be allocated.
+void *arena_alloc(const size_t bytes);
+
+// Resize an arena allocation, growing it in place if it is the most recent one. Returns NULL on failure.
+void *arena_realloc(void *ptr, const size_t bytes);
+
+// Give back an arena allocation, storing its size in *bytes. Only the most recent allocation is actually reclaimed
+// before the next reset. Returns false if the pointer is not a live arena allocation.
+bool arena_free(void *ptr, size_t *bytes);
+
+// Was the pointer handed out by the arena since the last reset, and not given back since? Pointers into the middle of
+// an allocation are not. Takes time logarithmic in the number of chunks.
+bool arena_owns(const void *ptr);
+
+// Number of bytes requested for a live arena allocation.
+size_t arena_allocation_size(const void *ptr);
+
+// Forget every allocation in O(1), keeping the chunks for reuse.
+void arena_reset(void);
+
+// Free every chunk of the arena.
+void arena_release(void);
+
+// Forget every chunk of the arena without freeing them, so that whatever still uses them can keep doing so.
+void arena_abandon(void);
+
+#endif  // __ARENA_H__
@@ -1,9 +1,19 @@
 #include "arrcmp.h"
+#include "genarrays.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <wchar.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ARRCMP_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ARRCMP_NEON
+#endif
+
 bool memory_is_equals(const void *m1, const void *m2, const size_t n) {
     return memcmp(m1, m2, n) == 0;
 }
@@ -11,3 +21,221 @@ bool memory_is_equals(const void *m1, const void *m2, const size_t n) {
 bool memory_is_not_equals(const void *m1, const void *m2, const size_t n) {
     return !memory_is_equals(m1, m2, n);
 }
+
+// Compare one byte at a time from a given offset, for tails too short for a vector.
+static size_t mismatch_from(const uint8_t *a, const uint8_t *b, size_t i, const size_t n) {
+    while (i < n && a[i] == b[i]) {
+        ++i;
+    }
+
+    return i;
+}
+
+#ifdef ARRCMP_X86
+#if defined(__SSE2__)
+static size_t first_mismatch_sse2(const uint8_t *a, const uint8_t *b, const size_t n) {
+    size_t i = 0;
+
+    // Check four vectors at a time, and only look at them separately once one of them differs.
+    for (; i + 64 <= n; i += 64) {
+        __m128i equal = _mm_and_si128(
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)), _mm_loadu_si128((const __m128i *) (b + i))),
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i + 16)), _mm_loadu_si128((const __m128i *) (b + i + 16)))
+            ),
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i + 32)), _mm_loadu_si128((const __m128i *) (b + i + 32))),
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i + 48)), _mm_loadu_si128((const __m128i *) (b + i + 48)))
+            )
+        );
+
+        if (_mm_movemask_epi8(equal) != 0xFFFF) {
+            break;
+        }
+    }
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+        unsigned int equal = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+
+        if (equal != 0xFFFFu) {
+            return i + (size_t) __builtin_ctz(~equal);
+        }
+    }
+
+    return mismatch_from(a, b, i, n);
+}
+#endif
+
+// Compiled for AVX2 on its own, so that the rest of the library can still run on CPUs without it.
+static __attribute__((target("avx2"))) size_t first_mismatch_avx2(const uint8_t *a, const uint8_t *b, const size_t n) {
+    size_t i = 0;
+
+    for (; i + 128 <= n; i += 128) {
+        __m256i equal = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i)), _mm256_loadu_si256((const __m256i *) (b + i))),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i + 32)), _mm256_loadu_si256((const __m256i *) (b + i + 32)))
+            ),
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i + 64)), _mm256_loadu_si256((const __m256i *) (b + i + 64))),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i + 96)), _mm256_loadu_si256((const __m256i *) (b + i + 96)))
+            )
+        );
+
+        if ((unsigned int) _mm256_movemask_epi8(equal) != 0xFFFFFFFFu) {
+            break;
+        }
+    }
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+        unsigned int equal = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+
+        if (equal != 0xFFFFFFFFu) {
+            return i + (size_t) __builtin_ctz(~equal);
+        }
+    }
+
+    return mismatch_from(a, b, i, n);
+}
+#endif
+
+#ifdef ARRCMP_NEON
+static size_t first_mismatch_neon(const uint8_t *a, const uint8_t *b, const size_t n) {
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        uint8x16_t equal = vandq_u8(
+            vandq_u8(vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i)), vceqq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16))),
+            vandq_u8(vceqq_u8(vld1q_u8(a + i + 32), vld1q_u8(b + i + 32)), vceqq_u8(vld1q_u8(a + i + 48), vld1q_u8(b + i + 48)))
+        );
+
+        if (vminvq_u8(equal) != 0xFFu) {
+            break;
+        }
+    }
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t equal = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+        if (vminvq_u8(equal) != 0xFFu) {
+            break;
+        }
+    }
+
+    return mismatch_from(a, b, i, n);
+}
+#endif
+
+// Below this many bytes, setting up a vector compare costs more than it saves.
+#define VECTOR_THRESHOLD 32
+
+// Find the first differing byte in a short piece of memory.
+static size_t locate_mismatch(const uint8_t *a, const uint8_t *b, const size_t n) {
+    if (n < VECTOR_THRESHOLD) {
+        return mismatch_from(a, b, 0, n);
+    }
+
+#if defined(ARRCMP_X86)
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) {
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    if (has_avx2) {
+        return first_mismatch_avx2(a, b, n);
+    }
+#if defined(__SSE2__)
+    return first_mismatch_sse2(a, b, n);
+#endif
+#elif defined(ARRCMP_NEON)
+    return first_mismatch_neon(a, b, n);
+#endif
+
+    // Without vectors, skip over equal words and only then look for the byte.
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t x, y;
+        memcpy(&x, a + i, sizeof(uint64_t));
+        memcpy(&y, b + i, sizeof(uint64_t));
+
+        if (x != y) {
+            break;
+        }
+    }
+
+    return mismatch_from(a, b, i, n);
+}
+
+// Size of the blocks that memory is skipped over in.
+#define BLOCK_SIZE 4096
+
+size_t first_mismatch(const void *m1, const void *m2, const size_t n) {
+    const uint8_t *a = (const uint8_t *) m1;
+    const uint8_t *b = (const uint8_t *) m2;
+
+    // The C library's memcmp is the fastest way to skip over equal memory, so equal blocks are left to it and the
+    // differing byte is only looked for in the block that contains it.
+    size_t i = 0;
+    while (n - i > BLOCK_SIZE && memcmp(a + i, b + i, BLOCK_SIZE) == 0) {
+        i += BLOCK_SIZE;
+    }
+
+    size_t block = n - i < BLOCK_SIZE ? n - i : BLOCK_SIZE;
+
+    return i + locate_mismatch(a + i, b + i, block);
+}
+
+bool deep_first_mismatch(const void *arr1, const void *arr2, const bool arr1isptp, const bool arr2isptp, const size_t size, const size_t argn, const size_t ns[], size_t *where) {
+    size_t total_items = ns[0];
+    for (size_t i = 1; i < argn; ++i) {
+        total_items *= ns[i];
+    }
+
+    memset(where, 0, argn * sizeof(size_t));
+
+    if (total_items == 0 || size == 0) {
+        return false;
+    }
+
+    if (!arr1isptp && !arr2isptp) {
+        // Flat arrays are contiguous in row-major order, so they can be compared in one go.
+        size_t index = first_mismatch(arr1, arr2, total_items * size) / size;
+        if (index == total_items) {
+            return false;
+        }
+
+        for (size_t i = argn - 1; i < argn; --i) {
+            where[i] = index % ns[i];
+            index /= ns[i];
+        }
+
+        return true;
+    }
+
+    // Only items in the innermost dimension are guaranteed to be next to each other, so compare row by row.
+    size_t row_items = ns[argn - 1];
+    size_t rows = total_items / row_items;
+
+    for (size_t row = 0; row < rows; ++row) {
+        const void *row1 = get(arr1, arr1isptp, size, ns, argn, where);
+        const void *row2 = get(arr2, arr2isptp, size, ns, argn, where);
+
+        size_t item = first_mismatch(row1, row2, row_items * size) / size;
+        if (item < row_items) {
+            where[argn - 1] = item;
+            return true;
+        }
+
+        // Move on to the next row, carrying into outer dimensions.
+        for (size_t i = argn - 2; i < argn && ++where[i] >= ns[i]; --i) {
+            where[i] = 0;
+        }
+    }
+
+    return false;
+}
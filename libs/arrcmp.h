@@ -11,4 +11,12 @@ bool memory_is_equals(const void *m1, const void *m2, const size_t n);
 
 bool memory_is_not_equals(const void *m1, const void *m2, const size_t n);
 
+// Offset of the first byte that differs between two pieces of memory, or n if they are equal.
+size_t first_mismatch(const void *m1, const void *m2, const size_t n);
+
+// Find the first item that differs between two n-dimensional arrays, comparing a whole row of items at once.
+// Returns false if the arrays are equal. Otherwise, the index of the item in each dimension is stored in where, which
+// must have room for argn indices.
+bool deep_first_mismatch(const void *arr1, const void *arr2, const bool arr1isptp, const bool arr2isptp, const size_t size, const size_t argn, const size_t ns[], size_t *where);
+
 #endif  // __ARRCMP_H__
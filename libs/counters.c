@@ -0,0 +1,156 @@
+#include "counters.h"
+#include "whatos.h"
+
+#include <string.h>
+
+static const char *const NAMES[COUNTER_COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses", "page_faults" };
+
+const char *counter_name(const CounterKind kind) {
+    return kind < COUNTER_COUNT ? NAMES[kind] : "unknown";
+}
+
+void counters_difference(const CounterReading *before, const CounterReading *after, CounterReading *out) {
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        out->valid[i] = before->valid[i] && after->valid[i];
+        out->values[i] = out->valid[i] && after->values[i] > before->values[i] ? after->values[i] - before->values[i] : 0;
+    }
+}
+
+void counters_add(CounterReading *total, const CounterReading *reading) {
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        total->valid[i] = total->valid[i] && reading->valid[i];
+        total->values[i] = total->valid[i] ? total->values[i] + reading->values[i] : 0;
+    }
+}
+
+// The calling thread's counters, for counters_open, counters_close and counters_read.
+static CounterGroup own = COUNTER_GROUP_INIT;
+
+bool counters_open(void) {
+    return counter_group_open(&own);
+}
+
+void counters_close(void) {
+    counter_group_close(&own);
+}
+
+void counters_read(CounterReading *out) {
+    counter_group_read(&own, out);
+}
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The events as the kernel knows them.
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} EVENTS[COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+};
+
+// The counters of a group are all scheduled together and read with a single system call. Members are in the order
+// they were opened in, which skips any that could not be.
+static int open_event(const CounterKind kind, const int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = EVENTS[kind].type;
+    attr.config = EVENTS[kind].config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool counter_group_open(CounterGroup *group) {
+    if (group->leader != -1) {
+        return true;
+    }
+
+    group->member_count = 0;
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        int fd = open_event((CounterKind) i, group->leader);
+
+        if (fd != -1) {
+            group->leader = group->leader == -1 ? fd : group->leader;
+            group->fds[group->member_count] = fd;
+            group->members[group->member_count++] = (CounterKind) i;
+        }
+    }
+
+    if (group->leader == -1) {
+        return false;
+    }
+
+    ioctl(group->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    return true;
+}
+
+void counter_group_close(CounterGroup *group) {
+    for (size_t i = 0; i < group->member_count; ++i) {
+        close(group->fds[i]);
+    }
+
+    group->leader = -1;
+    group->member_count = 0;
+}
+
+void counter_group_read(const CounterGroup *group, CounterReading *out) {
+    // Laid out as the kernel writes a group with both times: the number of members, the times, then each value.
+    uint64_t data[3 + COUNTER_COUNT];
+
+    memset(out, 0, sizeof(CounterReading));
+
+    if (group->leader == -1 || read(group->leader, data, sizeof(data)) < (ssize_t) (3 * sizeof(uint64_t))) {
+        return;
+    }
+
+    uint64_t enabled = data[1];
+    uint64_t running = data[2];
+
+    if (running == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < group->member_count && i < data[0]; ++i) {
+        uint64_t value = data[3 + i];
+
+        // The group shared the processor's counters with others for part of the time, so estimate the full count.
+        if (running < enabled) {
+            value = (uint64_t) ((double) value * ((double) enabled / (double) running));
+        }
+
+        out->values[group->members[i]] = value;
+        out->valid[group->members[i]] = true;
+    }
+}
+#else
+bool counter_group_open(CounterGroup *group) {
+    (void) group;
+    return false;
+}
+
+void counter_group_close(CounterGroup *group) {
+    // Nothing was opened.
+    (void) group;
+}
+
+void counter_group_read(const CounterGroup *group, CounterReading *out) {
+    (void) group;
+    memset(out, 0, sizeof(CounterReading));
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef __COUNTERS_H__
+#define __COUNTERS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware and kernel events counted around benchmark iterations.
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_PAGE_FAULTS,
+    COUNTER_COUNT
+} CounterKind;
+
+/**
+ * A reading of every counter that could be opened.
+ */
+typedef struct {
+    uint64_t values[COUNTER_COUNT]; /**< Value of each counter. */
+    bool valid[COUNTER_COUNT];      /**< Could the counter be opened? Values of the others are 0. */
+} CounterReading;
+
+/**
+ * The counters open on one thread.
+ */
+typedef struct {
+    int leader;                         /**< Group leader, or -1 if nothing is open. */
+    int fds[COUNTER_COUNT];             /**< Every open counter, the leader first. */
+    CounterKind members[COUNTER_COUNT]; /**< What each open counter counts. */
+    size_t member_count;                /**< Number of open counters. */
+} CounterGroup;
+
+// A group with nothing open.
+#define COUNTER_GROUP_INIT { .leader = -1 }
+
+// Start counting events on the calling thread, through perf_event_open on Linux. Counters that the processor, kernel
+// or permissions do not allow are left out. Returns false, doing nothing, if none of them could be opened.
+bool counters_open(void);
+
+// Stop counting events.
+void counters_close(void);
+
+// Read every open counter. Counters that were not scheduled the whole time are scaled up to make up for it.
+void counters_read(CounterReading *out);
+
+// As counters_open, counters_close and counters_read, for a group of the caller's own. Threads that count their own
+// events, such as the threads of a parallel benchmark, each open a group.
+bool counter_group_open(CounterGroup *group);
+void counter_group_close(CounterGroup *group);
+void counter_group_read(const CounterGroup *group, CounterReading *out);
+
+// Get the events counted between two readings.
+void counters_difference(const CounterReading *before, const CounterReading *after, CounterReading *out);
+
+// Add the events of a reading to a running total. A counter is only valid in the total if every reading had it, so a
+// total should start out with every counter valid.
+void counters_add(CounterReading *total, const CounterReading *reading);
+
+// Short machine-readable name of a counter.
+const char *counter_name(const CounterKind kind);
+
+#endif  // __COUNTERS_H__
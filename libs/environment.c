@@ -0,0 +1,284 @@
+// Needed for thread affinity on Linux.
+#define _GNU_SOURCE
+
+#include "environment.h"
+#include "whatos.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OS_WINDOWS
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Copy the first line of a file into out, without its newline. Returns false if the file could not be read.
+static bool read_line(const char *path, char *out, const size_t capacity) __attribute__((unused));
+static bool read_line(const char *path, char *out, const size_t capacity) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    bool read = fgets(out, (int) capacity, file) != NULL;
+    fclose(file);
+
+    if (read) {
+        out[strcspn(out, "\r\n")] = '\0';
+    }
+
+    return read;
+}
+
+// Copy a string into a buffer of its own, cutting it short if it does not fit.
+static void copy_name(char *out, const char *name) {
+    snprintf(out, ENVIRONMENT_NAME_LENGTH, "%s", name);
+}
+
+#if defined(__linux__)
+// Find the name of the processor in /proc/cpuinfo. x86 calls it the model name; other architectures have their own.
+static void read_cpu_model(char *out) {
+    const char *keys[] = { "model name", "Hardware", "cpu model", "Processor" };
+    char line[512];
+
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (!file) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) && !*out) {
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+            const char *colon = strchr(line, ':');
+
+            if (colon && strncmp(line, keys[i], strlen(keys[i])) == 0) {
+                colon += strspn(colon + 1, " \t") + 1;
+                copy_name(out, colon);
+                out[strcspn(out, "\r\n")] = '\0';
+                break;
+            }
+        }
+    }
+
+    fclose(file);
+}
+
+// Is turbo or boost on? intel_pstate says whether it is off, and acpi-cpufreq and amd-pstate whether it is on.
+static int read_turbo(void) {
+    char value[16];
+
+    if (read_line("/sys/devices/system/cpu/intel_pstate/no_turbo", value, sizeof(value))) {
+        return atoi(value) == 0;
+    }
+
+    if (read_line("/sys/devices/system/cpu/cpufreq/boost", value, sizeof(value))) {
+        return atoi(value) != 0;
+    }
+
+    return -1;
+}
+#endif
+
+void environment_read(BenchmarkEnvironment *environment, const int core) {
+    memset(environment, 0, sizeof(BenchmarkEnvironment));
+
+    environment->turbo = -1;
+    environment->load = NAN;
+    environment->core = -1;
+
+#if defined(OS_WINDOWS)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    environment->processors = info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1u;
+
+    const char *identifier = getenv("PROCESSOR_IDENTIFIER");
+    if (identifier) {
+        copy_name(environment->cpu_model, identifier);
+    }
+
+    (void) core;
+#else
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    environment->processors = processors > 0 ? (size_t) processors : 1u;
+
+    double load[1];
+    if (getloadavg(load, 1) == 1) {
+        environment->load = load[0];
+    }
+
+#if defined(__linux__)
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", core >= 0 ? core : 0);
+
+    read_cpu_model(environment->cpu_model);
+    read_line(path, environment->governor, sizeof(environment->governor));
+    environment->turbo = read_turbo();
+
+    // Only the performance governor holds the highest frequency, and userspace holds whatever it was set to.
+    environment->frequency_scaling = *environment->governor && strcmp(environment->governor, "performance") != 0 && strcmp(environment->governor, "userspace") != 0;
+#else
+    (void) core;
+#endif
+#endif
+}
+
+#if defined(OS_WINDOWS)
+static DWORD_PTR old_affinity = 0;
+static DWORD old_priority = 0;
+
+int environment_pin(const int core) {
+    DWORD_PTR process, system;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process, &system) || process == 0) {
+        return -1;
+    }
+
+    // Pick the requested processor out of the allowed ones, or the highest of them.
+    int chosen = -1;
+    for (int cpu = 0; cpu < (int) (sizeof(DWORD_PTR) * 8); ++cpu) {
+        if ((process >> cpu) & 1) {
+            chosen = cpu;
+
+            if (cpu == core) {
+                break;
+            }
+        }
+    }
+
+    if (core >= 0 && chosen != core) {
+        return -1;
+    }
+
+    DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << chosen);
+    if (previous == 0) {
+        return -1;
+    }
+
+    if (old_affinity == 0) {
+        old_affinity = previous;
+    }
+
+    return chosen;
+}
+
+void environment_unpin(void) {
+    if (old_affinity != 0) {
+        SetThreadAffinityMask(GetCurrentThread(), old_affinity);
+        old_affinity = 0;
+    }
+}
+
+bool environment_raise_priority(void) {
+    if (old_priority != 0) {
+        return true;
+    }
+
+    DWORD priority = GetPriorityClass(GetCurrentProcess());
+
+    // Realtime priority can starve the system of the processor, so high is as far as it goes.
+    if (priority == 0 || !SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS)) {
+        return false;
+    }
+
+    old_priority = priority;
+    return true;
+}
+
+void environment_lower_priority(void) {
+    if (old_priority != 0) {
+        SetPriorityClass(GetCurrentProcess(), old_priority);
+        old_priority = 0;
+    }
+}
+#else
+#ifdef __linux__
+static cpu_set_t old_affinity;
+static bool pinned = false;
+
+int environment_pin(const int core) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return -1;
+    }
+
+    // Pinning again keeps the processors allowed before the first time.
+    if (pinned) {
+        allowed = old_affinity;
+    }
+
+    int chosen = -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && (core < 0 || cpu == core)) {
+            chosen = cpu;
+        }
+    }
+
+    if (chosen < 0) {
+        return -1;
+    }
+
+    cpu_set_t only;
+    CPU_ZERO(&only);
+    CPU_SET(chosen, &only);
+
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &only) != 0) {
+        return -1;
+    }
+
+    old_affinity = allowed;
+    pinned = true;
+
+    return chosen;
+}
+
+void environment_unpin(void) {
+    if (pinned) {
+        sched_setaffinity(0, sizeof(cpu_set_t), &old_affinity);
+        pinned = false;
+    }
+}
+#else
+int environment_pin(const int core __attribute__((unused))) {
+    return -1;
+}
+
+void environment_unpin(void) {
+    // Nothing was pinned.
+}
+#endif
+
+static int old_priority = 0;
+static bool raised = false;
+
+bool environment_raise_priority(void) {
+    if (raised) {
+        return true;
+    }
+
+    int priority = getpriority(PRIO_PROCESS, 0);
+
+    // Try the highest priority first. Without privileges, the limit on how far it may be raised is usually 0.
+    for (int target = -20; target < priority && !raised; ++target) {
+        raised = setpriority(PRIO_PROCESS, 0, target) == 0;
+    }
+
+    if (raised) {
+        old_priority = priority;
+    }
+
+    return raised;
+}
+
+void environment_lower_priority(void) {
+    if (raised) {
+        setpriority(PRIO_PROCESS, 0, old_priority);
+        raised = false;
+    }
+}
+#endif
@@ -0,0 +1,44 @@
+#ifndef __ENVIRONMENT_H__
+#define __ENVIRONMENT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest CPU model and governor names that are kept.
+#define ENVIRONMENT_NAME_LENGTH 128
+
+/**
+ * What a benchmark run was measured on, and what was done to keep its timings steady.
+ */
+typedef struct {
+    char cpu_model[ENVIRONMENT_NAME_LENGTH]; /**< Name of the processor, or "" if it is not known. */
+    char governor[ENVIRONMENT_NAME_LENGTH];  /**< Frequency governor of the processor used, or "" if it is not known. */
+    size_t processors;                       /**< Number of online processors. */
+    int turbo;                               /**< 1 if turbo or boost clocks are on, 0 if they are off, -1 if unknown. */
+    bool frequency_scaling;                  /**< Can the governor change the frequency while benchmarks run? */
+    double load;                             /**< Load average over the last minute, or NAN if it is not known. */
+    int core;                                /**< Processor the runner was pinned to, or -1 if it was not pinned. */
+    bool raised_priority;                    /**< Was the priority of the runner raised? */
+    bool interleaved;                        /**< Were benchmarks interleaved across their iterations? */
+} BenchmarkEnvironment;
+
+// Read the processor, governor, turbo state and load of the machine. The core is the one whose governor is read, or
+// -1 for the first. Leaves what could not be found out as unknown, e.g. on other platforms or in virtual machines.
+void environment_read(BenchmarkEnvironment *environment, const int core);
+
+// Pin the calling thread to a processor it is allowed to run on, where that is supported. A negative core picks the
+// last one, which usually handles fewer interrupts than the first. Returns the processor pinned to, or -1 if it could
+// not be pinned. The processors it was allowed to use before are kept for environment_unpin.
+int environment_pin(const int core);
+
+// Let the calling thread run on every processor it was allowed to use before environment_pin again.
+void environment_unpin(void);
+
+// Raise the scheduling priority of the process as far as it is allowed to, keeping the old one for
+// environment_lower_priority. Returns whether it was raised at all; raising it usually needs privileges.
+bool environment_raise_priority(void);
+
+// Put the scheduling priority of the process back to what it was before environment_raise_priority.
+void environment_lower_priority(void);
+
+#endif  // __ENVIRONMENT_H__
@@ -0,0 +1,400 @@
+#include "fpcmp.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FPCMP_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FPCMP_NEON
+#endif
+
+// Map the bits of a float onto integers that are ordered the same way as the floats are.
+static int64_t float_order(const float f) {
+    int32_t bits;
+    memcpy(&bits, &f, sizeof(float));
+
+    return bits < 0 ? (int64_t) INT32_MIN - bits : bits;
+}
+
+static int64_t double_order(const double d) {
+    int64_t bits;
+    memcpy(&bits, &d, sizeof(double));
+
+    return bits < 0 ? INT64_MIN - bits : bits;
+}
+
+static uint64_t order_distance(const int64_t x, const int64_t y) {
+    return x >= y ? (uint64_t) x - (uint64_t) y : (uint64_t) y - (uint64_t) x;
+}
+
+static double float_error(const float a, const float b, const ToleranceMode mode) {
+    if (a == b || (isnan(a) && isnan(b))) {
+        return 0.0;
+    }
+
+    if (isnan(a) || isnan(b) || isinf(a) || isinf(b)) {
+        return INFINITY;
+    }
+
+    switch (mode) {
+        case TOLERANCE_RELATIVE:
+            return fabsf(a - b) / fmaxf(fmaxf(fabsf(a), fabsf(b)), FLT_MIN);
+        case TOLERANCE_ULP:
+            return (double) order_distance(float_order(a), float_order(b));
+        default:
+            return fabsf(a - b);
+    }
+}
+
+static double double_error(const double a, const double b, const ToleranceMode mode) {
+    if (a == b || (isnan(a) && isnan(b))) {
+        return 0.0;
+    }
+
+    if (isnan(a) || isnan(b) || isinf(a) || isinf(b)) {
+        return INFINITY;
+    }
+
+    switch (mode) {
+        case TOLERANCE_RELATIVE:
+            return fabs(a - b) / fmax(fmax(fabs(a), fabs(b)), DBL_MIN);
+        case TOLERANCE_ULP:
+            return (double) order_distance(double_order(a), double_order(b));
+        default:
+            return fabs(a - b);
+    }
+}
+
+/*
+ * The vectorised kernels below measure the absolute or relative error of as many items as fit in whole vectors, and
+ * store how many that was in *done. They return NAN if any error came out as NaN, which happens when NaNs or equal
+ * infinities are compared, so that the scalar code can decide what those items are worth.
+ */
+
+#ifdef FPCMP_X86
+static bool has_avx(void) {
+    static int avx = -1;
+    if (avx < 0) {
+        __builtin_cpu_init();
+        avx = __builtin_cpu_supports("avx") ? 1 : 0;
+    }
+
+    return avx;
+}
+
+static double lanes_max(const double *lanes, const size_t n) {
+    double max = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        max = lanes[i] > max ? lanes[i] : max;
+    }
+
+    return max;
+}
+
+#if defined(__SSE2__)
+static double float_max_error_sse2(const float *a, const float *b, const size_t n, const bool relative, size_t *done) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 smallest = _mm_set1_ps(FLT_MIN);
+
+    __m128 max = _mm_setzero_ps();
+    __m128 unordered = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        __m128 y = _mm_loadu_ps(b + i);
+        __m128 error = _mm_andnot_ps(sign, _mm_sub_ps(x, y));
+
+        if (relative) {
+            error = _mm_div_ps(error, _mm_max_ps(_mm_max_ps(_mm_andnot_ps(sign, x), _mm_andnot_ps(sign, y)), smallest));
+        }
+
+        unordered = _mm_or_ps(unordered, _mm_cmpunord_ps(error, error));
+        max = _mm_max_ps(max, error);
+    }
+
+    *done = i;
+
+    if (_mm_movemask_ps(unordered) != 0) {
+        return NAN;
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, max);
+
+    double wide[4] = { lanes[0], lanes[1], lanes[2], lanes[3] };
+    return lanes_max(wide, 4);
+}
+
+static double double_max_error_sse2(const double *a, const double *b, const size_t n, const bool relative, size_t *done) {
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d smallest = _mm_set1_pd(DBL_MIN);
+
+    __m128d max = _mm_setzero_pd();
+    __m128d unordered = _mm_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = _mm_loadu_pd(b + i);
+        __m128d error = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+
+        if (relative) {
+            error = _mm_div_pd(error, _mm_max_pd(_mm_max_pd(_mm_andnot_pd(sign, x), _mm_andnot_pd(sign, y)), smallest));
+        }
+
+        unordered = _mm_or_pd(unordered, _mm_cmpunord_pd(error, error));
+        max = _mm_max_pd(max, error);
+    }
+
+    *done = i;
+
+    if (_mm_movemask_pd(unordered) != 0) {
+        return NAN;
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, max);
+
+    return lanes_max(lanes, 2);
+}
+#endif
+
+// Compiled for AVX on its own, so that the rest of the library can still run on CPUs without it.
+static __attribute__((target("avx"))) double float_max_error_avx(const float *a, const float *b, const size_t n, const bool relative, size_t *done) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 smallest = _mm256_set1_ps(FLT_MIN);
+
+    __m256 max = _mm256_setzero_ps();
+    __m256 unordered = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(a + i);
+        __m256 y = _mm256_loadu_ps(b + i);
+        __m256 error = _mm256_andnot_ps(sign, _mm256_sub_ps(x, y));
+
+        if (relative) {
+            error = _mm256_div_ps(error, _mm256_max_ps(_mm256_max_ps(_mm256_andnot_ps(sign, x), _mm256_andnot_ps(sign, y)), smallest));
+        }
+
+        unordered = _mm256_or_ps(unordered, _mm256_cmp_ps(error, error, _CMP_UNORD_Q));
+        max = _mm256_max_ps(max, error);
+    }
+
+    *done = i;
+
+    if (_mm256_movemask_ps(unordered) != 0) {
+        return NAN;
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, max);
+
+    double wide[8];
+    for (size_t j = 0; j < 8; ++j) {
+        wide[j] = lanes[j];
+    }
+
+    return lanes_max(wide, 8);
+}
+
+static __attribute__((target("avx"))) double double_max_error_avx(const double *a, const double *b, const size_t n, const bool relative, size_t *done) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d smallest = _mm256_set1_pd(DBL_MIN);
+
+    __m256d max = _mm256_setzero_pd();
+    __m256d unordered = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = _mm256_loadu_pd(b + i);
+        __m256d error = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+
+        if (relative) {
+            error = _mm256_div_pd(error, _mm256_max_pd(_mm256_max_pd(_mm256_andnot_pd(sign, x), _mm256_andnot_pd(sign, y)), smallest));
+        }
+
+        unordered = _mm256_or_pd(unordered, _mm256_cmp_pd(error, error, _CMP_UNORD_Q));
+        max = _mm256_max_pd(max, error);
+    }
+
+    *done = i;
+
+    if (_mm256_movemask_pd(unordered) != 0) {
+        return NAN;
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, max);
+
+    return lanes_max(lanes, 4);
+}
+#endif
+
+#ifdef FPCMP_NEON
+// NEON's maximum propagates NaNs, so there is no need to track them separately.
+static double float_max_error_neon(const float *a, const float *b, const size_t n, const bool relative, size_t *done) {
+    const float32x4_t smallest = vdupq_n_f32(FLT_MIN);
+    float32x4_t max = vdupq_n_f32(0.0f);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t x = vld1q_f32(a + i);
+        float32x4_t y = vld1q_f32(b + i);
+        float32x4_t error = vabdq_f32(x, y);
+
+        if (relative) {
+            error = vdivq_f32(error, vmaxq_f32(vmaxq_f32(vabsq_f32(x), vabsq_f32(y)), smallest));
+        }
+
+        max = vmaxq_f32(max, error);
+    }
+
+    *done = i;
+
+    return vmaxvq_f32(max);
+}
+
+static double double_max_error_neon(const double *a, const double *b, const size_t n, const bool relative, size_t *done) {
+    const float64x2_t smallest = vdupq_n_f64(DBL_MIN);
+    float64x2_t max = vdupq_n_f64(0.0);
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        float64x2_t x = vld1q_f64(a + i);
+        float64x2_t y = vld1q_f64(b + i);
+        float64x2_t error = vabdq_f64(x, y);
+
+        if (relative) {
+            error = vdivq_f64(error, vmaxq_f64(vmaxq_f64(vabsq_f64(x), vabsq_f64(y)), smallest));
+        }
+
+        max = vmaxq_f64(max, error);
+    }
+
+    *done = i;
+
+    return vmaxvq_f64(max);
+}
+#endif
+
+double float_array_max_error(const float *a, const float *b, const size_t n, const ToleranceMode mode) {
+    double max = 0.0;
+    size_t i = 0;
+
+    // ULP distances need integer arithmetic on the bits, which is left to the scalar loop.
+    if (mode != TOLERANCE_ULP) {
+        bool relative = mode == TOLERANCE_RELATIVE;
+
+#if defined(FPCMP_X86)
+        if (has_avx()) {
+            max = float_max_error_avx(a, b, n, relative, &i);
+        }
+#if defined(__SSE2__)
+        else {
+            max = float_max_error_sse2(a, b, n, relative, &i);
+        }
+#endif
+#elif defined(FPCMP_NEON)
+        max = float_max_error_neon(a, b, n, relative, &i);
+#endif
+
+        if (isnan(max)) {
+            max = 0.0;
+            i = 0;
+        }
+    }
+
+    for (; i < n; ++i) {
+        double error = float_error(a[i], b[i], mode);
+        max = error > max ? error : max;
+    }
+
+    return max;
+}
+
+double double_array_max_error(const double *a, const double *b, const size_t n, const ToleranceMode mode) {
+    double max = 0.0;
+    size_t i = 0;
+
+    if (mode != TOLERANCE_ULP) {
+        bool relative = mode == TOLERANCE_RELATIVE;
+
+#if defined(FPCMP_X86)
+        if (has_avx()) {
+            max = double_max_error_avx(a, b, n, relative, &i);
+        }
+#if defined(__SSE2__)
+        else {
+            max = double_max_error_sse2(a, b, n, relative, &i);
+        }
+#endif
+#elif defined(FPCMP_NEON)
+        max = double_max_error_neon(a, b, n, relative, &i);
+#endif
+
+        if (isnan(max)) {
+            max = 0.0;
+            i = 0;
+        }
+    }
+
+    for (; i < n; ++i) {
+        double error = double_error(a[i], b[i], mode);
+        max = error > max ? error : max;
+    }
+
+    return max;
+}
+
+// Add one item's error to the statistics.
+static void add_error(ErrorStats *out, const double error, const size_t index, const double tolerance) {
+    if (error > out->max_error) {
+        out->max_error = error;
+        out->worst = index;
+    }
+
+    if (error > tolerance) {
+        ++out->exceeding;
+    }
+
+    out->mean_error += error;
+}
+
+void float_array_error_stats(const float *a, const float *b, const size_t n, const ToleranceMode mode, const double tolerance, ErrorStats *out) {
+    memset(out, 0, sizeof(ErrorStats));
+
+    for (size_t i = 0; i < n; ++i) {
+        add_error(out, float_error(a[i], b[i], mode), i, tolerance);
+    }
+
+    out->mean_error = n > 0 ? out->mean_error / (double) n : 0.0;
+}
+
+void double_array_error_stats(const double *a, const double *b, const size_t n, const ToleranceMode mode, const double tolerance, ErrorStats *out) {
+    memset(out, 0, sizeof(ErrorStats));
+
+    for (size_t i = 0; i < n; ++i) {
+        add_error(out, double_error(a[i], b[i], mode), i, tolerance);
+    }
+
+    out->mean_error = n > 0 ? out->mean_error / (double) n : 0.0;
+}
+
+const char *tolerance_mode_name(const ToleranceMode mode) {
+    switch (mode) {
+        case TOLERANCE_RELATIVE:
+            return "relative";
+        case TOLERANCE_ULP:
+            return "ULP";
+        default:
+            return "absolute";
+    }
+}
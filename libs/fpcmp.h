@@ -0,0 +1,33 @@
+#ifndef __FPCMP_H__
+#define __FPCMP_H__
+
+#include "../catom.h"
+
+#include <stddef.h>
+
+/**
+ * Statistics of the errors between the items of two floating point arrays.
+ */
+typedef struct {
+    double max_error;  /**< Largest error of any item. */
+    double mean_error; /**< Mean error over all items. */
+    size_t worst;      /**< Index of the first item with the largest error. */
+    size_t exceeding;  /**< Number of items with an error above the tolerance. */
+} ErrorStats;
+
+// Largest error between the items of two float arrays, found in one vectorised pass where possible.
+double float_array_max_error(const float *a, const float *b, const size_t n, const ToleranceMode mode);
+
+// Largest error between the items of two double arrays, found in one vectorised pass where possible.
+double double_array_max_error(const double *a, const double *b, const size_t n, const ToleranceMode mode);
+
+// Full statistics of the errors between two float arrays. Slower, as it is meant for reporting failures.
+void float_array_error_stats(const float *a, const float *b, const size_t n, const ToleranceMode mode, const double tolerance, ErrorStats *out);
+
+// Full statistics of the errors between two double arrays. Slower, as it is meant for reporting failures.
+void double_array_error_stats(const double *a, const double *b, const size_t n, const ToleranceMode mode, const double tolerance, ErrorStats *out);
+
+// Name of a tolerance mode, for messages.
+const char *tolerance_mode_name(const ToleranceMode mode);
+
+#endif  // __FPCMP_H__
@@ -1,19 +1,164 @@
 #include "hashing.h"
 
-uint64_t obj_hash(const void *obj, const size_t total_length) {
-    uint64_t result = 0u;
+#include <string.h>
+
+// The primes of XXH64.
+#define PRIME_1 0x9E3779B185EBCA87ull
+#define PRIME_2 0xC2B2AE3D27D4EB4Full
+#define PRIME_3 0x165667B19E3779F9ull
+#define PRIME_4 0x85EBCA77C2B2AE63ull
+#define PRIME_5 0x27D4EB2F165667C5ull
+
+#define STRIPE_LENGTH 32
+
+static uint64_t rotl(const uint64_t x, const int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Read little-endian words regardless of alignment or the byte order of the machine.
+static uint64_t read64(const uint8_t *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t word;
+    memcpy(&word, p, sizeof(uint64_t));
+
+    return word;
+#else
+    return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24)
+        | ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) | ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+#endif
+}
+
+static uint32_t read32(const uint8_t *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32_t word;
+    memcpy(&word, p, sizeof(uint32_t));
+
+    return word;
+#else
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+#endif
+}
+
+static uint64_t hash_round(uint64_t lane, const uint64_t input) {
+    lane += input * PRIME_2;
+    lane = rotl(lane, 31);
+
+    return lane * PRIME_1;
+}
+
+static uint64_t merge_lane(uint64_t hash, const uint64_t lane) {
+    hash ^= hash_round(0, lane);
+
+    return hash * PRIME_1 + PRIME_4;
+}
+
+// Add whole stripes to the lanes. Returns the number of bytes consumed.
+static size_t consume_stripes(uint64_t lanes[4], const uint8_t *data, const size_t length) {
+    size_t i = 0;
+
+    for (; i + STRIPE_LENGTH <= length; i += STRIPE_LENGTH) {
+        lanes[0] = hash_round(lanes[0], read64(data + i));
+        lanes[1] = hash_round(lanes[1], read64(data + i + 8));
+        lanes[2] = hash_round(lanes[2], read64(data + i + 16));
+        lanes[3] = hash_round(lanes[3], read64(data + i + 24));
+    }
+
+    return i;
+}
+
+void hash_init(HashState *state) {
+    memset(state, 0, sizeof(HashState));
+
+    state->lanes[0] = PRIME_1 + PRIME_2;
+    state->lanes[1] = PRIME_2;
+    state->lanes[2] = 0;
+    state->lanes[3] = 0 - PRIME_1;
+}
+
+void hash_update(HashState *state, const void *data, const size_t length) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    size_t remaining = length;
 
-    if (obj) {
-        result = 1u;
-        uint64_t multiplier = 1u;
+    state->total_length += length;
 
-        for (size_t i = 0; i < total_length; ++i) {
-            uint8_t cur = ((uint8_t *) obj)[i];
-            result += ((uint64_t) cur) * multiplier;
+    // Top up a partial stripe from an earlier update first.
+    if (state->buffered > 0) {
+        size_t fill = STRIPE_LENGTH - state->buffered < remaining ? STRIPE_LENGTH - state->buffered : remaining;
 
-            multiplier *= HASH_CONSTANT;
+        memcpy(state->buffer + state->buffered, bytes, fill);
+        state->buffered += fill;
+        bytes += fill;
+        remaining -= fill;
+
+        if (state->buffered < STRIPE_LENGTH) {
+            return;
         }
+
+        consume_stripes(state->lanes, state->buffer, STRIPE_LENGTH);
+        state->buffered = 0;
     }
 
-    return result;
+    size_t consumed = consume_stripes(state->lanes, bytes, remaining);
+
+    memcpy(state->buffer, bytes + consumed, remaining - consumed);
+    state->buffered = remaining - consumed;
+}
+
+uint64_t hash_digest(const HashState *state) {
+    uint64_t hash;
+
+    if (state->total_length >= STRIPE_LENGTH) {
+        const uint64_t *lanes = state->lanes;
+
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (size_t i = 0; i < 4; ++i) {
+            hash = merge_lane(hash, lanes[i]);
+        }
+    } else {
+        hash = PRIME_5;
+    }
+
+    hash += state->total_length;
+
+    // Mix in whatever did not make up a whole stripe.
+    const uint8_t *p = state->buffer;
+    size_t remaining = state->buffered;
+
+    for (; remaining >= 8; p += 8, remaining -= 8) {
+        hash ^= hash_round(0, read64(p));
+        hash = rotl(hash, 27) * PRIME_1 + PRIME_4;
+    }
+
+    if (remaining >= 4) {
+        hash ^= (uint64_t) read32(p) * PRIME_1;
+        hash = rotl(hash, 23) * PRIME_2 + PRIME_3;
+        p += 4;
+        remaining -= 4;
+    }
+
+    for (; remaining > 0; ++p, --remaining) {
+        hash ^= (uint64_t) *p * PRIME_5;
+        hash = rotl(hash, 11) * PRIME_1;
+    }
+
+    // Final avalanche.
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+uint64_t obj_hash(const void *obj, const size_t total_length) {
+    if (!obj) {
+        return 0u;
+    }
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, obj, total_length);
+
+    return hash_digest(&state);
 }
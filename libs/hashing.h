@@ -4,10 +4,27 @@
 #include <stddef.h>
 #include <stdint.h>
 
-// Constant used for the hashing process.
-#define HASH_CONSTANT ((uint64_t) 524287ul)
+/**
+ * State of a hash being computed incrementally, so that objects too large or too scattered to hash in one call can be
+ * fed in piece by piece. The result is the same as hashing all the pieces at once with obj_hash.
+ */
+typedef struct {
+    uint64_t total_length; /**< Number of bytes hashed so far. */
+    uint64_t lanes[4];     /**< Accumulators of each 8-byte lane of a 32-byte stripe. */
+    uint8_t buffer[32];    /**< Bytes waiting for a full stripe. */
+    size_t buffered;       /**< Number of bytes in the buffer. */
+} HashState;
 
-// Get the 64-bit hash of an object.
+// Start a new hash.
+void hash_init(HashState *state);
+
+// Add bytes to a hash.
+void hash_update(HashState *state, const void *data, const size_t length);
+
+// Get the hash of every byte added so far. More bytes can still be added afterwards.
+uint64_t hash_digest(const HashState *state);
+
+// Get the 64-bit hash of an object, or 0 for a NULL pointer. This is XXH64 with a seed of 0.
 uint64_t obj_hash(const void *obj, const size_t total_length);
 
 #endif  // __HASHING_H__
@@ -0,0 +1,395 @@
+#include "instrument.h"
+#include "threads.h"
+#include "whatos.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef OS_WINDOWS
+#include <unistd.h>
+#endif
+
+/**
+ * One scope or counter recorded for the trace.
+ */
+typedef struct {
+    const char *context; /**< Name of the test or benchmark it was recorded in. */
+    const char *name;    /**< Name of the scope or counter. */
+    InstrumentKind kind; /**< Whether it is a scope or a counter. */
+    uint64_t start;      /**< Wall-clock time it started at. */
+    uint64_t value;      /**< Nanoseconds spent in the scope, or the amount added to the counter. */
+} TraceEvent;
+
+/**
+ * Everything one thread recorded. Only that thread writes to it, so recording needs no locks; it is only read when
+ * no thread is recording. Once the thread exits, the next thread to start recording takes it over, totals and all.
+ */
+typedef struct ThreadRecord {
+    struct ThreadRecord *next;               /**< Record of the thread that started recording before this one. */
+    size_t thread;                           /**< Number of the thread in the trace, kept when it is taken over. */
+    bool retired;                            /**< Has the thread recording into it exited? */
+    InstrumentTotal totals[MAX_INSTRUMENTS]; /**< Totals, in a hash table keyed by their context and name. */
+    size_t used;                             /**< Number of the totals in use. */
+    size_t lost;                             /**< Recordings that did not fit in the totals. */
+    TraceEvent *events;                      /**< Events kept for the trace. */
+    size_t event_count;                      /**< Number of events kept for the trace. */
+    size_t event_capacity;                   /**< Number of events there is room for. */
+    size_t dropped;                          /**< Events left out of the trace. */
+} ThreadRecord;
+
+// The records of every thread that has recorded anything, newest first, some of them taken over since.
+static ThreadRecord *records = NULL;
+static size_t thread_count = 0;
+static THREAD_LOCAL ThreadRecord *own_record = NULL;
+
+// Key whose destructor retires a thread's record when it exits.
+#ifdef OS_WINDOWS
+static DWORD exit_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t exit_key;
+#endif
+
+static Lock exit_key_lock = LOCK_INIT;
+static bool exit_key_made = false;
+
+static const char *current_context = "";
+static bool tracing = false;
+
+static ThreadRecord *get_record(void);
+
+void instrument_context(const char *context) {
+    current_context = context;
+
+    // The runner's own record is made now, rather than inside the first scope it times.
+    get_record();
+}
+
+void instrument_tracing(const bool should_trace) {
+    tracing = should_trace;
+}
+
+// Let another thread take over the record of a thread that is exiting.
+#ifdef OS_WINDOWS
+static VOID WINAPI retire_record(PVOID record) {
+#else
+static void retire_record(void *record) {
+#endif
+    ATOMIC_STORE(&((ThreadRecord *) record)->retired, true);
+}
+
+// Make a record the calling thread's own, and have it retired when the thread exits.
+static ThreadRecord *own(ThreadRecord *record) {
+    lock_acquire(&exit_key_lock);
+
+    if (!exit_key_made) {
+#ifdef OS_WINDOWS
+        exit_key = FlsAlloc(retire_record);
+        exit_key_made = exit_key != FLS_OUT_OF_INDEXES;
+#else
+        exit_key_made = pthread_key_create(&exit_key, retire_record) == 0;
+#endif
+    }
+
+    lock_release(&exit_key_lock);
+
+    // Without the key, the record is just never taken over.
+    if (exit_key_made) {
+#ifdef OS_WINDOWS
+        FlsSetValue(exit_key, record);
+#else
+        pthread_setspecific(exit_key, record);
+#endif
+    }
+
+    own_record = record;
+    return record;
+}
+
+// Get the calling thread's record, taking over one whose thread exited or making one the first time. Records are
+// pushed without a lock, so that threads can start recording while others are. Since they are reused, there are only
+// ever as many as the most threads that recorded at once, rather than one for every timed test or benchmark thread.
+static ThreadRecord *get_record(void) {
+    if (own_record) {
+        return own_record;
+    }
+
+    for (ThreadRecord *record = ATOMIC_LOAD(&records); record; record = record->next) {
+        bool retired = true;
+
+        if (ATOMIC_LOAD(&record->retired) && ATOMIC_COMPARE_EXCHANGE(&record->retired, &retired, false)) {
+            return own(record);
+        }
+    }
+
+    ThreadRecord *record = (ThreadRecord *) calloc(1, sizeof(ThreadRecord));
+    if (!record) {
+        return NULL;
+    }
+
+    record->thread = ATOMIC_ADD(&thread_count, 1);
+    record->next = ATOMIC_LOAD(&records);
+
+    while (!ATOMIC_COMPARE_EXCHANGE(&records, &record->next, record)) {
+        // Someone else pushed theirs first; next now holds theirs.
+    }
+
+    return own(record);
+}
+
+// Find the totals of a scope or counter in a record, adding them if they are not there yet.
+static InstrumentTotal *find_total(ThreadRecord *record, const InstrumentKind kind, const char *name, const char *context, const uint64_t start) {
+    uint64_t hash = ((uint64_t) (uintptr_t) name ^ ((uint64_t) (uintptr_t) context << 1) ^ (uint64_t) kind) * 0x9E3779B97F4A7C15ull;
+    size_t slot = (size_t) (hash >> 32) & (MAX_INSTRUMENTS - 1);
+
+    for (size_t probe = 0; probe < MAX_INSTRUMENTS; ++probe, slot = (slot + 1) & (MAX_INSTRUMENTS - 1)) {
+        InstrumentTotal *total = record->totals + slot;
+
+        if (!total->name) {
+            if (record->used * 4 >= MAX_INSTRUMENTS * 3) {
+                // Kept from filling up, so that a search for a missing name stops soon.
+                return NULL;
+            }
+
+            *total = (InstrumentTotal) { context, name, kind, 0, 0, UINT64_MAX, 0, start };
+            ++record->used;
+            return total;
+        }
+
+        if (total->name == name && total->context == context && total->kind == kind) {
+            return total;
+        }
+    }
+
+    return NULL;
+}
+
+void instrument_record(const InstrumentKind kind, const char *name, const uint64_t start, const uint64_t value) {
+    ThreadRecord *record = get_record();
+    const char *context = current_context;
+
+    if (!record) {
+        return;
+    }
+
+    InstrumentTotal *total = find_total(record, kind, name, context, start);
+
+    if (total) {
+        total->first = total->count == 0 ? start : total->first;
+        ++total->count;
+        total->total += value;
+        total->min = value < total->min ? value : total->min;
+        total->max = value > total->max ? value : total->max;
+    } else {
+        ++record->lost;
+    }
+
+    if (!tracing) {
+        return;
+    }
+
+    if (record->event_count == record->event_capacity) {
+        size_t capacity = record->event_capacity > 0 ? record->event_capacity * 2 : 1024;
+        TraceEvent *grown = capacity <= MAX_TRACE_EVENTS ? (TraceEvent *) realloc(record->events, capacity * sizeof(TraceEvent)) : NULL;
+
+        if (!grown) {
+            ++record->dropped;
+            return;
+        }
+
+        record->events = grown;
+        record->event_capacity = capacity;
+    }
+
+    record->events[record->event_count++] = (TraceEvent) { context, name, kind, start, value };
+}
+
+// Do two names of a context, scope or counter name the same one? The same string may be at different addresses in
+// different translation units.
+static bool same_name(const char *a, const char *b) {
+    return a == b || strcmp(a, b) == 0;
+}
+
+size_t instrument_totals(const char *context, InstrumentTotal *out, const size_t capacity, size_t *lost) {
+    size_t n = 0;
+    *lost = 0;
+
+    for (ThreadRecord *record = ATOMIC_LOAD(&records); record; record = record->next) {
+        *lost += record->lost;
+
+        for (size_t slot = 0; slot < MAX_INSTRUMENTS; ++slot) {
+            const InstrumentTotal *total = record->totals + slot;
+
+            if (!total->name || total->count == 0 || !same_name(total->context, context)) {
+                continue;
+            }
+
+            size_t i = 0;
+            while (i < n && !(out[i].kind == total->kind && same_name(out[i].name, total->name))) {
+                ++i;
+            }
+
+            if (i == n) {
+                if (n == capacity) {
+                    *lost += total->count;
+                    continue;
+                }
+
+                out[n++] = *total;
+                continue;
+            }
+
+            out[i].count += total->count;
+            out[i].total += total->total;
+            out[i].min = total->min < out[i].min ? total->min : out[i].min;
+            out[i].max = total->max > out[i].max ? total->max : out[i].max;
+            out[i].first = total->first < out[i].first ? total->first : out[i].first;
+        }
+    }
+
+    // Insertion sort, since there are only ever a few.
+    for (size_t i = 1; i < n; ++i) {
+        InstrumentTotal moved = out[i];
+        size_t j = i;
+
+        for (; j > 0 && out[j - 1].first > moved.first; --j) {
+            out[j] = out[j - 1];
+        }
+
+        out[j] = moved;
+    }
+
+    return n;
+}
+
+void instrument_clear(const char *context) {
+    for (ThreadRecord *record = ATOMIC_LOAD(&records); record; record = record->next) {
+        bool live = false;
+
+        // Cleared totals keep their names, so that the ones after them in the table can still be found.
+        for (size_t slot = 0; slot < MAX_INSTRUMENTS; ++slot) {
+            InstrumentTotal *total = record->totals + slot;
+
+            if (total->name && same_name(total->context, context)) {
+                total->count = 0;
+                total->total = 0;
+                total->min = UINT64_MAX;
+                total->max = 0;
+            }
+
+            live = live || (total->name && total->count > 0);
+        }
+
+        // Once nothing else is waiting to be added up, the table can be emptied for good.
+        if (!live) {
+            memset(record->totals, 0, sizeof(record->totals));
+            record->used = 0;
+            record->lost = 0;
+        }
+    }
+}
+
+// Append a string to a growing buffer, escaped as a JSON string if it is quoted. Returns false if it could not grow.
+static bool append(char **text, size_t *length, size_t *capacity, const char *str, const bool quoted) {
+    size_t needed = *length + 2 * strlen(str) + 8;
+
+    if (needed > *capacity) {
+        size_t grown = *capacity * 2 > needed ? *capacity * 2 : needed;
+        char *resized = (char *) realloc(*text, grown);
+
+        if (!resized) {
+            return false;
+        }
+
+        *text = resized;
+        *capacity = grown;
+    }
+
+    if (quoted) {
+        (*text)[(*length)++] = '"';
+    }
+
+    for (const unsigned char *c = (const unsigned char *) str; *c; ++c) {
+        if (quoted && (*c == '"' || *c == '\\')) {
+            (*text)[(*length)++] = '\\';
+        }
+
+        // Control characters would need six characters each, so they are left out instead.
+        if (!quoted || *c >= 0x20) {
+            (*text)[(*length)++] = (char) *c;
+        }
+    }
+
+    if (quoted) {
+        (*text)[(*length)++] = '"';
+    }
+
+    (*text)[*length] = '\0';
+    return true;
+}
+
+// Append a whole file's contents in one write, so that other processes appending to it do not split them up.
+static bool append_to_file(const char *path, const char *mode, const char *text, const size_t length) {
+    FILE *file = fopen(path, mode);
+    if (!file) {
+        return false;
+    }
+
+    setvbuf(file, NULL, _IONBF, 0);
+    bool written = fwrite(text, 1, length, file) == length;
+
+    return fclose(file) == 0 && written;
+}
+
+bool instrument_start_trace(const char *path) {
+    // The closing bracket is optional in the trace event format, which is what lets events be appended at any time.
+    return append_to_file(path, "w", "[\n", 2);
+}
+
+bool instrument_flush_trace(const char *path, size_t *dropped) {
+#ifdef OS_WINDOWS
+    unsigned long pid = (unsigned long) GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long) getpid();
+#endif
+
+    char *text = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    bool appended = true;
+
+    *dropped = 0;
+
+    for (ThreadRecord *record = ATOMIC_LOAD(&records); record; record = record->next) {
+        *dropped += record->dropped;
+
+        for (size_t i = 0; i < record->event_count && appended; ++i) {
+            const TraceEvent *event = record->events + i;
+            char line[256];
+
+            // Times are in microseconds, which are written out exactly from the nanoseconds.
+            if (event->kind == INSTRUMENT_SCOPE) {
+                snprintf(line, sizeof(line), ", \"ph\": \"X\", \"ts\": %" PRIu64 ".%03u, \"dur\": %" PRIu64 ".%03u, \"pid\": %lu, \"tid\": %zu},\n",
+                    event->start / 1000u, (unsigned) (event->start % 1000u), event->value / 1000u, (unsigned) (event->value % 1000u), pid, record->thread);
+            } else {
+                snprintf(line, sizeof(line), ", \"ph\": \"C\", \"ts\": %" PRIu64 ".%03u, \"pid\": %lu, \"tid\": %zu, \"args\": {\"value\": %" PRIu64 "}},\n",
+                    event->start / 1000u, (unsigned) (event->start % 1000u), pid, record->thread, event->value);
+            }
+
+            appended = append(&text, &length, &capacity, "{\"name\": ", false)
+                && append(&text, &length, &capacity, event->name, true)
+                && append(&text, &length, &capacity, ", \"cat\": ", false)
+                && append(&text, &length, &capacity, event->context, true)
+                && append(&text, &length, &capacity, line, false);
+        }
+
+        record->event_count = 0;
+        record->dropped = 0;
+    }
+
+    bool written = appended && (length == 0 || append_to_file(path, "a", text, length));
+
+    free(text);
+    return written;
+}
@@ -0,0 +1,62 @@
+#ifndef __INSTRUMENT_H__
+#define __INSTRUMENT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Most scopes and counters each thread keeps totals of at once. Must be a power of two.
+#define MAX_INSTRUMENTS 1024
+
+// Most events each thread keeps for the trace between flushes. Later ones are left out of the trace, but not the totals.
+#define MAX_TRACE_EVENTS ((size_t) 1 << 18)
+
+/**
+ * What an instrument measures.
+ */
+typedef enum {
+    INSTRUMENT_SCOPE,   /**< Time spent in a scope. */
+    INSTRUMENT_COUNTER  /**< Amounts added to a counter. */
+} InstrumentKind;
+
+/**
+ * The totals of one scope or counter in one test or benchmark.
+ */
+typedef struct {
+    const char *context; /**< Name of the test or benchmark it was recorded in. */
+    const char *name;    /**< Name of the scope or counter. */
+    InstrumentKind kind; /**< Whether it is a scope or a counter. */
+    uint64_t count;      /**< Times the scope was left, or the counter was added to. */
+    uint64_t total;      /**< Nanoseconds spent in the scope, or the sum of the amounts added to the counter. */
+    uint64_t min;        /**< Shortest time spent in the scope, or the smallest amount added to the counter. */
+    uint64_t max;        /**< Longest time spent in the scope, or the largest amount added to the counter. */
+    uint64_t first;      /**< Wall-clock time it was first recorded at, which orders the totals. */
+} InstrumentTotal;
+
+// Set the name of the test or benchmark that is recorded into from now on, on every thread. Must be called by the
+// thread that runs it.
+void instrument_context(const char *context);
+
+// Set whether the events recorded are also kept for a trace.
+void instrument_tracing(const bool should_trace);
+
+// Record that a scope started at a wall-clock time and took value nanoseconds, or that value was added to a counter at
+// that time. Only ever touches the calling thread's own buffer, so it takes no locks.
+void instrument_record(const InstrumentKind kind, const char *name, const uint64_t start, const uint64_t value);
+
+// Add up what every thread recorded in a test or benchmark, merging scopes and counters of the same name, into out in
+// the order they were first recorded. Returns how many there are, and writes how many recordings did not fit in the
+// totals to lost. Like the functions below, must not be called while other threads are recording.
+size_t instrument_totals(const char *context, InstrumentTotal *out, const size_t capacity, size_t *lost);
+
+// Forget the totals of a test or benchmark.
+void instrument_clear(const char *context);
+
+// Start a trace in the Chrome trace event format, replacing the file. Returns false if it could not be written.
+bool instrument_start_trace(const char *path);
+
+// Append the events kept for the trace to it and forget them, writing how many were left out to dropped. The file is
+// written in one go, so that processes can share it. Returns false if it could not be written.
+bool instrument_flush_trace(const char *path, size_t *dropped);
+
+#endif  // __INSTRUMENT_H__
@@ -1,39 +1,177 @@
 #include "../catom.h"
+#include "arena.h"
 #include "memalloc.h"
 #include "vbprint.h"
 
 #include <inttypes.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static PointerListNode CONST_TAIL;
-static PointerListNode CONST_HEAD = { NULL, 0, NULL, &CONST_TAIL };
-static PointerListNode CONST_TAIL = { NULL, 0, &CONST_HEAD, NULL };
+// Number of allocations the table has room for when it is first used.
+#define INITIAL_CAPACITY 64
 
-static PointerList list = { &CONST_HEAD, &CONST_TAIL };
+static AllocationTable table = { NULL, 0, 0, NULL, 0 };
 
-void *testfunc_malloc(const size_t bytes) {
-    void *mem = malloc(bytes);
-    if (mem) {
-        PointerListNode *tail = list.tail;
-        PointerListNode *prev = tail->pred;
+static bool use_arena = false;
 
-        // Create a new list node to store the newly allocated pointer.
-        PointerListNode *node = (PointerListNode *) malloc(sizeof(PointerListNode));
-        if (!node) {
-            free(mem);
-            return NULL;
+static AllocationStats stats = { 0, 0, 0, 0, 0 };
+
+static void count_allocation(const size_t bytes) {
+    ++stats.allocations;
+    ++stats.live_allocations;
+    stats.allocated_bytes += bytes;
+    stats.live_bytes += bytes;
+
+    if (stats.live_bytes > stats.peak_bytes) {
+        stats.peak_bytes = stats.live_bytes;
+    }
+}
+
+static void count_free(const size_t bytes) {
+    // Memory allocated before the last reset is not counted as live, so never go below zero.
+    stats.live_allocations -= stats.live_allocations > 0 ? 1 : 0;
+    stats.live_bytes -= bytes < stats.live_bytes ? bytes : stats.live_bytes;
+}
+
+static void count_reallocation(const size_t old_bytes, const size_t bytes) {
+    count_free(old_bytes);
+    count_allocation(bytes);
+}
+
+static size_t bucket_of(const void *ptr) {
+    // Fibonacci hashing. The low bits of heap pointers are mostly alignment, so spread the whole pointer around.
+    return (size_t) (((uint64_t) (uintptr_t) ptr * 0x9E3779B97F4A7C15ull) >> 32) & table.mask;
+}
+
+// Find the bucket holding a pointer, or the empty bucket it would be put in.
+static size_t find_bucket(const void *ptr) {
+    size_t bucket = bucket_of(ptr);
+
+    while (table.buckets[bucket] != 0 && table.slab[table.buckets[bucket] - 1].ptr != ptr) {
+        bucket = (bucket + 1) & table.mask;
+    }
+
+    return bucket;
+}
+
+// Make sure there is room for one more allocation, keeping the hash table at most half full.
+static bool reserve(void) {
+    if (table.count < table.capacity) {
+        return true;
+    }
+
+    size_t capacity = table.capacity > 0 ? table.capacity * 2 : INITIAL_CAPACITY;
+
+    Allocation *slab = (Allocation *) realloc(table.slab, capacity * sizeof(Allocation));
+    if (!slab) {
+        return false;
+    }
+
+    table.slab = slab;
+
+    size_t *buckets = (size_t *) calloc(capacity * 2, sizeof(size_t));
+    if (!buckets) {
+        return false;
+    }
+
+    free(table.buckets);
+
+    table.buckets = buckets;
+    table.capacity = capacity;
+    table.mask = capacity * 2 - 1;
+
+    for (size_t i = 0; i < table.count; ++i) {
+        table.buckets[find_bucket(table.slab[i].ptr)] = i + 1;
+    }
+
+    return true;
+}
+
+// Empty a bucket, shifting back any entries that probed past it so that no tombstones are needed.
+static void erase_bucket(size_t hole) {
+    size_t next = (hole + 1) & table.mask;
+
+    while (table.buckets[next] != 0) {
+        size_t home = bucket_of(table.slab[table.buckets[next] - 1].ptr);
+
+        if (((next - home) & table.mask) >= ((next - hole) & table.mask)) {
+            table.buckets[hole] = table.buckets[next];
+            hole = next;
         }
 
-        tail->pred = node;
-        prev->succ = node;
+        next = (next + 1) & table.mask;
+    }
+
+    table.buckets[hole] = 0;
+}
+
+static void untrack(const size_t bucket) {
+    size_t index = table.buckets[bucket] - 1;
+    size_t last = table.count - 1;
+
+    erase_bucket(bucket);
+
+    // Keep the slab packed by moving the last allocation into the gap.
+    if (index != last) {
+        table.slab[index] = table.slab[last];
+        table.buckets[find_bucket(table.slab[index].ptr)] = index + 1;
+    }
+
+    --table.count;
+}
+
+// Find the bucket of a tracked pointer, or return false if the pointer is not tracked.
+static bool is_tracked(const void *ptr, size_t *bucket) {
+    if (table.count == 0) {
+        return false;
+    }
 
-        node->pred = prev;
-        node->succ = tail;
+    *bucket = find_bucket(ptr);
 
-        // Assign the other info in the node.
-        node->ptr = mem;
-        node->bytes = bytes;
+    return table.buckets[*bucket] != 0;
+}
+
+const AllocationStats *get_allocation_stats(void) {
+    return &stats;
+}
+
+void reset_allocation_stats(void) {
+    memset(&stats, 0, sizeof(AllocationStats));
+}
+
+bool get_arena_status(void) {
+    return use_arena;
+}
+
+void set_arena_status(const bool status) {
+    if (use_arena && !status) {
+        arena_release();
+    }
+
+    use_arena = status;
+}
+
+void *testfunc_malloc(const size_t bytes) {
+    if (use_arena) {
+        void *mem = arena_alloc(bytes);
+        if (mem) {
+            count_allocation(bytes);
+            vbprintf(stderr, "MEMORY: Allocated %zu bytes of arena memory at @%" PRIuPTR "!\n", bytes, mem);
+        }
+
+        return mem;
+    }
+
+    if (!reserve()) {
+        return NULL;
+    }
+
+    void *mem = malloc(bytes);
+    if (mem) {
+        table.slab[table.count] = (Allocation) { mem, bytes };
+        table.buckets[find_bucket(mem)] = ++table.count;
+        count_allocation(bytes);
 
         vbprintf(stderr, "MEMORY: Allocated %zu bytes of memory at @%" PRIuPTR "!\n", bytes, mem);
         return mem;
@@ -59,25 +197,50 @@ void *testfunc_realloc(void *ptr, const size_t bytes) {
         return testfunc_malloc(bytes);
     }
 
-    for (PointerListNode *cur = list.head; cur != list.tail; cur = cur->succ) {
-        if (cur->ptr == ptr) {
-            void *old_ptr = cur->ptr;
-            size_t old_bytes = cur->bytes;
-
-            cur->ptr = realloc(cur->ptr, bytes);
-            if (!cur->ptr) {
-                return NULL;
-            }
+    // Reallocating to no bytes frees the memory, whatever the C library's realloc would do with it.
+    if (bytes == 0) {
+        testfunc_free(ptr);
+        return NULL;
+    }
 
-            cur->bytes = bytes;
+    size_t bucket;
+    if (!is_tracked(ptr, &bucket)) {
+        if (!arena_owns(ptr)) {
+            return NULL;
+        }
 
-            vbprintf(stderr, "MEMORY: Reallocated %zu bytes of memory at @%" PRIuPTR " (from %zu bytes at @%" PRIuPTR ")!\n", bytes, cur->ptr, old_bytes, old_ptr);
+        size_t old_bytes = arena_allocation_size(ptr);
 
-            return cur->ptr;
+        void *mem = arena_realloc(ptr, bytes);
+        if (mem) {
+            count_reallocation(old_bytes, bytes);
+            vbprintf(stderr, "MEMORY: Reallocated %zu bytes of arena memory at @%" PRIuPTR " (from @%" PRIuPTR ")!\n", bytes, mem, ptr);
         }
+
+        return mem;
     }
 
-    return NULL;
+    size_t index = table.buckets[bucket] - 1;
+    size_t old_bytes = table.slab[index].bytes;
+
+    void *mem = realloc(ptr, bytes);
+    if (!mem) {
+        // The original allocation is still valid, so it stays tracked.
+        return NULL;
+    }
+
+    if (mem != ptr) {
+        erase_bucket(bucket);
+        table.slab[index].ptr = mem;
+        table.buckets[find_bucket(mem)] = index + 1;
+    }
+
+    table.slab[index].bytes = bytes;
+    count_reallocation(old_bytes, bytes);
+
+    vbprintf(stderr, "MEMORY: Reallocated %zu bytes of memory at @%" PRIuPTR " (from %zu bytes at @%" PRIuPTR ")!\n", bytes, mem, old_bytes, ptr);
+
+    return mem;
 }
 
 void testfunc_free(void *ptr) {
@@ -85,29 +248,55 @@ void testfunc_free(void *ptr) {
         return;
     }
 
-    for (PointerListNode *cur = list.head; cur != list.tail; cur = cur->succ) {
-        if (cur->ptr == ptr) {
-            free(cur->ptr);
-            vbprintf(stderr, "MEMORY: Freed %zu bytes of memory at @%" PRIuPTR "!\n", cur->bytes, cur->ptr);
+    size_t bucket;
+    if (!is_tracked(ptr, &bucket)) {
+        // Arena memory is given back all at once at the end of the test.
+        size_t bytes;
+        if (arena_free(ptr, &bytes)) {
+            count_free(bytes);
+        }
+
+        return;
+    }
+
+    size_t bytes = table.slab[table.buckets[bucket] - 1].bytes;
 
-            cur->pred->succ = cur->succ;
-            cur->succ->pred = cur->pred;
+    free(ptr);
+    vbprintf(stderr, "MEMORY: Freed %zu bytes of memory at @%" PRIuPTR "!\n", bytes, ptr);
 
-            free(cur);
-            return;
-        }
+    untrack(bucket);
+    count_free(bytes);
+}
+
+void testfunc_abandonall(void) {
+    arena_abandon();
+
+    stats.live_allocations = 0;
+    stats.live_bytes = 0;
+
+    if (table.count > 0) {
+        table.count = 0;
+        memset(table.buckets, 0, (table.mask + 1) * sizeof(size_t));
     }
 }
 
 void testfunc_freeall(void) {
-    PointerListNode *cur = list.head->succ;
+    arena_reset();
+
+    stats.live_allocations = 0;
+    stats.live_bytes = 0;
 
-    if (cur != list.tail) {
-        vbprintf(stderr, "\n");
+    if (table.count == 0) {
+        return;
     }
 
-    while (cur != list.tail) {
-        testfunc_free(cur->ptr);
-        cur = cur->succ;
+    vbprintf(stderr, "\n");
+
+    for (size_t i = 0; i < table.count; ++i) {
+        free(table.slab[i].ptr);
+        vbprintf(stderr, "MEMORY: Freed %zu bytes of memory at @%" PRIuPTR "!\n", table.slab[i].bytes, table.slab[i].ptr);
     }
+
+    table.count = 0;
+    memset(table.buckets, 0, (table.mask + 1) * sizeof(size_t));
 }
@@ -1,23 +1,53 @@
 #ifndef __MEMALLOC_H__
 #define __MEMALLOC_H__
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /**
- * A struct representing the nodes in the linked list used for keeping track of the memory allocated.
+ * An allocation made by one of the testfunc_?alloc functions.
  */
-typedef struct PLN {
-    void *ptr;        /**< Pointer to the allocated memory location. */
-    size_t bytes;     /**< Number of bytes allocated. */
+typedef struct {
+    void *ptr;    /**< Pointer to the allocated memory location. */
+    size_t bytes; /**< Number of bytes allocated. */
+} Allocation;
 
-    struct PLN *pred; /**< Previous node. */
-    struct PLN *succ; /**< Next node. */
-} PointerListNode;
+/**
+ * The table used for keeping track of the memory allocated.
+ *
+ * Live allocations are packed into a slab so that they can all be visited quickly, and are found by pointer through
+ * an open-addressing hash table of indices into that slab. Neither grows per allocation, so tracking is O(1).
+ */
+typedef struct {
+    Allocation *slab; /**< Every live allocation, in no particular order. */
+    size_t count;     /**< Number of live allocations. */
+    size_t capacity;  /**< Number of allocations the slab has room for. */
+    size_t *buckets;  /**< Hash table of slab indices, offset by one so that 0 marks an empty bucket. */
+    size_t mask;      /**< Number of buckets minus one. There is always a power of two of them. */
+} AllocationTable;
 
+/**
+ * Counters of the memory handed out by the testfunc_?alloc functions since they were last reset.
+ */
 typedef struct {
-    PointerListNode *head; /**< Head of the linked list. */
-    PointerListNode *tail; /**< Tail of the linked list. */
-} PointerList;
+    size_t allocations;      /**< Number of allocations and reallocations made. */
+    size_t allocated_bytes;  /**< Total number of bytes requested by those allocations. */
+    size_t live_allocations; /**< Number of allocations not yet freed. */
+    size_t live_bytes;       /**< Number of bytes not yet freed. */
+    size_t peak_bytes;       /**< Highest number of bytes live at once. */
+} AllocationStats;
+
+// Get the allocation counters.
+const AllocationStats *get_allocation_stats(void);
+
+// Zero the allocation counters. Memory that is still allocated is no longer counted as live.
+void reset_allocation_stats(void);
+
+// Are the testfunc_?alloc functions allocating from the per-test arena?
+bool get_arena_status(void);
+
+// Switch the testfunc_?alloc functions between tracked heap allocations and the per-test arena.
+void set_arena_status(const bool status);
 
 /**
  * Attempt to free every pointer allocated by the testfunc_?alloc functions.
@@ -26,4 +56,8 @@ typedef struct {
  */
 void testfunc_freeall(void);
 
+// Stop keeping track of every pointer allocated by the testfunc_?alloc functions without freeing any of them, for a
+// timed test thread that could not be stopped and may still be using them.
+void testfunc_abandonall(void);
+
 #endif  // __MEMALLOC_H__
@@ -0,0 +1,268 @@
+#include "output.h"
+#include "threads.h"
+#include "whatos.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OS_WINDOWS
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+// Position of a buffer that is not holding anything back.
+#define NOT_HELD SIZE_MAX
+
+// Signals that mean the program is crashing, and the handlers that were installed for them before ours.
+static const int CRASH_SIGNALS[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL };
+#define CRASH_SIGNAL_COUNT (sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]))
+
+#ifdef OS_WINDOWS
+static void (*previous_handlers[CRASH_SIGNAL_COUNT])(int);
+#else
+static struct sigaction previous_handlers[CRASH_SIGNAL_COUNT];
+#endif
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+static size_t used = 0;
+static size_t held = NOT_HELD;
+static bool installed = false;
+
+// Everything above is shared by the threads writing output, and guarded by this.
+static Lock lock = LOCK_INIT;
+
+// How much of the buffer is complete, as of the last time the lock was released. A crash handler cannot take the lock,
+// as the crashing thread may hold it, so this is all it writes out. Nothing below it is overwritten without it first
+// being lowered.
+static size_t snapshot = 0;
+
+// Take the lock. A timed test thread cancelled while writing would never give it back, so cancellation is held off
+// until it is released again.
+static void output_lock(int *cancel_state) {
+#ifdef OS_WINDOWS
+    *cancel_state = 0;
+#else
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, cancel_state);
+#endif
+
+    lock_acquire(&lock);
+}
+
+static void output_unlock(const int cancel_state) {
+    lock_release(&lock);
+
+#ifdef OS_WINDOWS
+    (void) cancel_state;
+#else
+    int disabled;
+    pthread_setcancelstate(cancel_state, &disabled);
+#endif
+}
+
+// Write straight to the stderr file descriptor, bypassing stdio. This is also safe to do while handling a crash.
+#ifdef OS_WINDOWS
+static void write_stderr(const char *data, size_t length) {
+    int fd = _fileno(stderr);
+
+    while (length > 0) {
+        int written = _write(fd, data, length > INT32_MAX ? INT32_MAX : (unsigned int) length);
+        if (written <= 0) {
+            return;
+        }
+
+        data += written;
+        length -= (size_t) written;
+    }
+}
+#else
+static void write_stderr(const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDERR_FILENO, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            return;
+        }
+
+        data += written;
+        length -= (size_t) written;
+    }
+}
+#endif
+
+// Record how much of the buffer is complete. The lock must be held.
+static void take_snapshot(void) {
+    ATOMIC_STORE(&snapshot, used);
+}
+
+// Only calls that are safe in a signal handler are made here.
+static void crash_handler(int signal_number) {
+    write_stderr(buffer, ATOMIC_LOAD(&snapshot));
+
+    // Let whatever would have happened without us happen. The signal stays blocked until this returns.
+    for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+        if (CRASH_SIGNALS[i] == signal_number) {
+#ifdef OS_WINDOWS
+            signal(signal_number, previous_handlers[i] == SIG_ERR ? SIG_DFL : previous_handlers[i]);
+#else
+            sigaction(signal_number, previous_handlers + i, NULL);
+#endif
+        }
+    }
+
+    raise(signal_number);
+}
+
+void output_install_crash_handlers(void) {
+    int cancel_state;
+    output_lock(&cancel_state);
+
+    if (!installed) {
+        installed = true;
+        atexit(output_flush);
+
+        for (size_t i = 0; i < CRASH_SIGNAL_COUNT; ++i) {
+#ifdef OS_WINDOWS
+            previous_handlers[i] = signal(CRASH_SIGNALS[i], crash_handler);
+#else
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = crash_handler;
+            sigemptyset(&action.sa_mask);
+
+            sigaction(CRASH_SIGNALS[i], &action, previous_handlers + i);
+#endif
+        }
+    }
+
+    output_unlock(cancel_state);
+}
+
+void output_printf(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    output_vprintf(format, args);
+    va_end(args);
+}
+
+// Write out the buffer. The lock must be held.
+static void flush_buffer(void) {
+    // Anything the program wrote to stderr through stdio came before what is in the buffer.
+    fflush(stderr);
+
+    write_stderr(buffer, used);
+    used = 0;
+    take_snapshot();
+
+    if (held != NOT_HELD) {
+        held = 0;
+    }
+}
+
+void output_vprintf(const char *format, va_list args) {
+    va_list argcopy;
+    va_copy(argcopy, args);
+
+    int cancel_state;
+    output_lock(&cancel_state);
+
+    int length = vsnprintf(buffer + used, OUTPUT_BUFFER_SIZE - used, format, args);
+
+    if (length >= 0 && (size_t) length < OUTPUT_BUFFER_SIZE - used) {
+        used += (size_t) length;
+    } else if (length >= 0) {
+        // It did not fit, so make room. Output too large for the buffer is written on its own.
+        flush_buffer();
+
+        if ((size_t) length < OUTPUT_BUFFER_SIZE) {
+            vsnprintf(buffer, OUTPUT_BUFFER_SIZE, format, argcopy);
+            used = (size_t) length;
+        } else {
+            char *large = (char *) malloc((size_t) length + 1u);
+
+            if (large) {
+                vsnprintf(large, (size_t) length + 1u, format, argcopy);
+                write_stderr(large, (size_t) length);
+                free(large);
+            }
+        }
+    }
+
+    take_snapshot();
+    output_unlock(cancel_state);
+
+    va_end(argcopy);
+}
+
+void output_write(const char *data, const size_t length) {
+    int cancel_state;
+    output_lock(&cancel_state);
+
+    if (length > OUTPUT_BUFFER_SIZE - used) {
+        flush_buffer();
+    }
+
+    if (length > OUTPUT_BUFFER_SIZE) {
+        write_stderr(data, length);
+    } else {
+        memcpy(buffer + used, data, length);
+        used += length;
+    }
+
+    take_snapshot();
+    output_unlock(cancel_state);
+}
+
+void output_flush(void) {
+    int cancel_state;
+    output_lock(&cancel_state);
+    flush_buffer();
+    output_unlock(cancel_state);
+}
+
+void output_sync(void) {
+    int cancel_state;
+    output_lock(&cancel_state);
+
+    if (held == NOT_HELD) {
+        flush_buffer();
+    }
+
+    output_unlock(cancel_state);
+}
+
+void output_discard(void) {
+    // Another thread of the parent may have held the lock when it forked, and that thread does not exist here.
+    lock = (Lock) LOCK_INIT;
+
+    used = 0;
+    held = NOT_HELD;
+    take_snapshot();
+}
+
+void output_hold(void) {
+    int cancel_state;
+    output_lock(&cancel_state);
+    held = used;
+    output_unlock(cancel_state);
+}
+
+void output_release(const bool keep) {
+    int cancel_state;
+    output_lock(&cancel_state);
+
+    if (!keep && held != NOT_HELD) {
+        used = held;
+    }
+
+    held = NOT_HELD;
+    take_snapshot();
+
+    output_unlock(cancel_state);
+}
@@ -0,0 +1,39 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size of the block output is collected in before it is written to stderr.
+#define OUTPUT_BUFFER_SIZE 65536
+
+// Print to the buffered output sink, from any thread. Output is written to stderr in one go when the buffer fills and
+// when it is flushed, as well as when the program exits or crashes once the crash handlers are installed.
+void output_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+void output_vprintf(const char *format, va_list args);
+
+void output_write(const char *data, const size_t length);
+
+// Write everything in the buffer to stderr.
+void output_flush(void);
+
+// Flush the buffer when the program exits, and write what it held when it crashes before passing the signal on to the
+// handler that was installed before. Only the first call does anything. The test runners call this as they start.
+void output_install_crash_handlers(void);
+
+// Write everything in the buffer to stderr, unless output is being held back.
+void output_sync(void);
+
+// Drop everything in the buffer. A forked child calls this, as what it inherited belongs to its parent.
+void output_discard(void);
+
+// Start holding output back, so that it can be dropped later if it turns out not to be needed.
+void output_hold(void);
+
+// Stop holding output back. The held output is kept to be printed, or dropped. Output that had to be written while it
+// was held, because the buffer filled or was flushed, cannot be dropped.
+void output_release(const bool keep);
+
+#endif  // __OUTPUT_H__
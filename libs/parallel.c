@@ -0,0 +1,257 @@
+// Needed for thread affinity on Linux.
+#define _GNU_SOURCE
+
+#include "parallel.h"
+#include "threads.h"
+#include "timer.h"
+#include "whatos.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef OS_WINDOWS
+#include <sched.h>
+#endif
+
+/**
+ * One thread of a team.
+ */
+typedef struct {
+    ThreadTeam *team;       /**< The team the thread belongs to. */
+    size_t index;           /**< Index of the thread in its team. */
+    uint64_t finish;        /**< Wall-clock time the thread finished its last sample at. */
+    CounterGroup counters;  /**< Events counted on the thread, if the team counts them. */
+    CounterReading counted; /**< Events counted while the thread ran its last sample. */
+#ifdef OS_WINDOWS
+    HANDLE id;              /**< Handle of the thread. */
+#else
+    pthread_t id;           /**< ID of the thread. */
+#endif
+} TeamMember;
+
+struct ThreadTeam {
+    ParallelBenchmarkFunction body;
+    size_t threads;
+    bool pin;
+    bool count;
+    TeamMember *members;
+
+    // Guards everything below, except ready and go.
+    Lock lock;
+    Condition wake;
+    Condition done;
+    size_t generation;
+    size_t finished;
+    size_t iterations;
+    bool stopping;
+
+    // The start barrier. Threads spin on it rather than sleeping, so that they are all released at the same moment.
+    size_t ready;
+    bool go;
+};
+
+// Pin the calling thread to a processor of its own, where that is supported.
+static void pin_thread(const size_t index) {
+#if defined(OS_WINDOWS)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << (index % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+
+    // Go round the processors this process is allowed to use.
+    size_t target = index % (size_t) CPU_COUNT(&allowed);
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t only;
+            CPU_ZERO(&only);
+            CPU_SET(cpu, &only);
+
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &only);
+            return;
+        }
+    }
+#else
+    (void) index;
+#endif
+}
+
+static void member_main(TeamMember *member) {
+    ThreadTeam *team = member->team;
+    size_t seen = 0;
+
+    if (team->pin) {
+        pin_thread(member->index);
+    }
+
+    // Counters only count the thread that opened them, so every thread opens its own. One that cannot leaves its
+    // readings invalid, which leaves the team's total invalid too.
+    bool counting = team->count && counter_group_open(&member->counters);
+    CounterReading before, after;
+
+    for (;;) {
+        lock_acquire(&team->lock);
+        while (team->generation == seen && !team->stopping) {
+            condition_wait(&team->wake, &team->lock);
+        }
+
+        if (team->stopping) {
+            lock_release(&team->lock);
+            counter_group_close(&member->counters);
+            return;
+        }
+
+        seen = team->generation;
+        size_t iterations = team->iterations;
+        lock_release(&team->lock);
+
+        ATOMIC_ADD(&team->ready, 1);
+        while (!ATOMIC_LOAD(&team->go)) {
+            // Wait for the others.
+        }
+
+        if (counting) {
+            counter_group_read(&member->counters, &before);
+        }
+
+        team->body(iterations, member->index, team->threads);
+        member->finish = timer_now(TIMER_WALL);
+
+        if (counting) {
+            counter_group_read(&member->counters, &after);
+            counters_difference(&before, &after, &member->counted);
+        }
+
+        lock_acquire(&team->lock);
+        if (++team->finished == team->threads) {
+            condition_broadcast(&team->done);
+        }
+        lock_release(&team->lock);
+    }
+}
+
+#ifdef OS_WINDOWS
+static DWORD WINAPI member_thread(void *member) {
+    member_main((TeamMember *) member);
+    return 0;
+}
+
+static bool start_member(TeamMember *member) {
+    member->id = CreateThread(NULL, 0, member_thread, member, 0, NULL);
+    return member->id != NULL;
+}
+
+static void join_member(TeamMember *member) {
+    WaitForSingleObject(member->id, INFINITE);
+    CloseHandle(member->id);
+}
+#else
+static void *member_thread(void *member) {
+    member_main((TeamMember *) member);
+    return NULL;
+}
+
+static bool start_member(TeamMember *member) {
+    return pthread_create(&member->id, NULL, member_thread, member) == 0;
+}
+
+static void join_member(TeamMember *member) {
+    pthread_join(member->id, NULL);
+}
+#endif
+
+// Stop the first n threads of a team, and free it.
+static void stop_members(ThreadTeam *team, const size_t n) {
+    lock_acquire(&team->lock);
+    team->stopping = true;
+    condition_broadcast(&team->wake);
+    lock_release(&team->lock);
+
+    for (size_t i = 0; i < n; ++i) {
+        join_member(team->members + i);
+    }
+
+    free(team->members);
+    free(team);
+}
+
+ThreadTeam *team_start(const ParallelBenchmarkFunction body, const size_t threads, const bool pin, const bool count) {
+    ThreadTeam *team = (ThreadTeam *) calloc(1, sizeof(ThreadTeam));
+    if (!team) {
+        return NULL;
+    }
+
+    team->members = (TeamMember *) calloc(threads, sizeof(TeamMember));
+    if (!team->members) {
+        free(team);
+        return NULL;
+    }
+
+    team->body = body;
+    team->threads = threads;
+    team->pin = pin;
+    team->count = count;
+    team->lock = (Lock) LOCK_INIT;
+    team->wake = (Condition) CONDITION_INIT;
+    team->done = (Condition) CONDITION_INIT;
+
+    for (size_t i = 0; i < threads; ++i) {
+        team->members[i].team = team;
+        team->members[i].index = i;
+        team->members[i].counters = (CounterGroup) COUNTER_GROUP_INIT;
+
+        if (!start_member(team->members + i)) {
+            stop_members(team, i);
+            return NULL;
+        }
+    }
+
+    return team;
+}
+
+uint64_t team_run(ThreadTeam *team, const size_t iterations, CounterReading *counted) {
+    lock_acquire(&team->lock);
+    ATOMIC_STORE(&team->ready, 0);
+    ATOMIC_STORE(&team->go, false);
+    team->finished = 0;
+    team->iterations = iterations;
+    ++team->generation;
+    condition_broadcast(&team->wake);
+    lock_release(&team->lock);
+
+    while (ATOMIC_LOAD(&team->ready) < team->threads) {
+        // Wait for every thread to reach the barrier.
+    }
+
+    uint64_t start = timer_now(TIMER_WALL);
+    ATOMIC_STORE(&team->go, true);
+
+    lock_acquire(&team->lock);
+    while (team->finished < team->threads) {
+        condition_wait(&team->done, &team->lock);
+    }
+    lock_release(&team->lock);
+
+    uint64_t last = start;
+    for (size_t i = 0; i < team->threads; ++i) {
+        last = team->members[i].finish > last ? team->members[i].finish : last;
+    }
+
+    if (counted) {
+        memset(counted->values, 0, sizeof(counted->values));
+        for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+            counted->valid[c] = team->count;
+        }
+
+        for (size_t i = 0; i < team->threads; ++i) {
+            counters_add(counted, &team->members[i].counted);
+        }
+    }
+
+    return last - start;
+}
+
+void team_stop(ThreadTeam *team) {
+    stop_members(team, team->threads);
+}
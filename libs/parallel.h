@@ -0,0 +1,26 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include "../catom.h"
+#include "counters.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A fixed set of threads that run a parallel benchmark body together, one sample at a time.
+typedef struct ThreadTeam ThreadTeam;
+
+// Start a team of threads for a parallel benchmark body, optionally pinning each to a processor of its own and having
+// each count its own events. Returns NULL if the threads could not be started.
+ThreadTeam *team_start(const ParallelBenchmarkFunction body, const size_t threads, const bool pin, const bool count);
+
+// Release every thread of the team from a barrier to run the body with a number of iterations each. Returns the
+// wall-clock ticks from their release until the last of them finished. If counted is given, the events every thread
+// counted while running the body are added up in it.
+uint64_t team_run(ThreadTeam *team, const size_t iterations, CounterReading *counted);
+
+// Stop the threads of a team and free it.
+void team_stop(ThreadTeam *team);
+
+#endif  // __PARALLEL_H__
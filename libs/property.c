@@ -0,0 +1,292 @@
+#include "property.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The generator of the case being run, and where its choices come from when it is replayed instead.
+static uint64_t state = 0;
+static bool replaying = false;
+static const uint64_t *replayed = NULL;
+static size_t replayed_n = 0;
+static size_t position = 0;
+
+// The choices the case has made.
+static uint64_t *made = NULL;
+static size_t made_n = 0;
+static size_t made_capacity = 0;
+
+// Memory handed out to the case.
+static void **allocations = NULL;
+static size_t allocation_count = 0;
+static size_t allocation_capacity = 0;
+
+// The output function of SplitMix64, which scrambles every bit of a number into every other.
+static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// SplitMix64, which is fast and passes BigCrush.
+static uint64_t next_random(void) {
+    return mix(state += 0x9E3779B97F4A7C15ull);
+}
+
+static void start_case(void) {
+    made_n = 0;
+    position = 0;
+    choices_release();
+}
+
+void choices_generate(const uint64_t seed) {
+    start_case();
+
+    // Scrambled, so that the streams of seeds that are close together do not overlap.
+    state = mix(seed);
+    replaying = false;
+}
+
+void choices_replay(const uint64_t *choices, const size_t n) {
+    start_case();
+    replayed = choices;
+    replayed_n = n;
+    replaying = true;
+}
+
+bool choices_replaying(void) {
+    return replaying;
+}
+
+static uint64_t record(uint64_t value, const uint64_t max) {
+    if (max != UINT64_MAX) {
+        value %= max + 1;
+    }
+
+    if (made_n == made_capacity) {
+        size_t capacity = made_capacity > 0 ? made_capacity * 2 : 256;
+        uint64_t *grown = capacity <= MAX_CHOICES ? (uint64_t *) realloc(made, capacity * sizeof(uint64_t)) : NULL;
+
+        if (!grown) {
+            return 0;
+        }
+
+        made = grown;
+        made_capacity = capacity;
+    }
+
+    made[made_n++] = value;
+    return value;
+}
+
+uint64_t choices_draw(const uint64_t max) {
+    if (replaying) {
+        return record(position < replayed_n ? replayed[position++] : 0, max);
+    }
+
+    return record(next_random(), max);
+}
+
+uint64_t choices_draw_planned(const uint64_t max, const uint64_t planned) {
+    if (replaying) {
+        return record(position < replayed_n ? replayed[position++] : 0, max);
+    }
+
+    return record(planned, max);
+}
+
+uint64_t choices_random(void) {
+    return replaying ? 0 : next_random();
+}
+
+const uint64_t *choices_made(size_t *n) {
+    *n = made_n;
+    return made;
+}
+
+void *choices_alloc(const size_t bytes) {
+    if (allocation_count == allocation_capacity) {
+        size_t capacity = allocation_capacity > 0 ? allocation_capacity * 2 : 16;
+        void **grown = (void **) realloc(allocations, capacity * sizeof(void *));
+
+        if (!grown) {
+            return NULL;
+        }
+
+        allocations = grown;
+        allocation_capacity = capacity;
+    }
+
+    void *memory = malloc(bytes > 0 ? bytes : 1);
+    if (memory) {
+        allocations[allocation_count++] = memory;
+    }
+
+    return memory;
+}
+
+void choices_release(void) {
+    for (size_t i = 0; i < allocation_count; ++i) {
+        free(allocations[i]);
+    }
+
+    allocation_count = 0;
+}
+
+/**
+ * The simplest failing choices found so far, and what is needed to look for simpler ones.
+ */
+typedef struct {
+    uint64_t *best;              /**< Simplest failing choices. */
+    size_t n;                    /**< Number of them. */
+    uint64_t *candidate;         /**< Choices being tried, which are never more than the first best ones. */
+    bool (*check)(void *);       /**< Runs the case, returning whether it fails. */
+    void *context;               /**< What to pass to check. */
+    size_t attempts;             /**< Number of times the case was run. */
+    size_t steps;                /**< Number of times simpler choices were found. */
+} Shrinker;
+
+// Are some choices simpler than others? Fewer choices are simpler, and then the smaller ones are, in order. Any
+// sequence has finitely many simpler ones, so shrinking always stops.
+static bool simpler(const uint64_t *a, const size_t na, const uint64_t *b, const size_t nb) {
+    if (na != nb) {
+        return na < nb;
+    }
+
+    for (size_t i = 0; i < na; ++i) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i];
+        }
+    }
+
+    return false;
+}
+
+// Run the case on the candidate choices, keeping the ones it made if it still fails with simpler ones.
+static bool try_candidate(Shrinker *shrinker, const size_t n) {
+    if (shrinker->attempts >= MAX_SHRINK_ATTEMPTS) {
+        return false;
+    }
+
+    ++shrinker->attempts;
+    choices_replay(shrinker->candidate, n);
+
+    if (!shrinker->check(shrinker->context)) {
+        return false;
+    }
+
+    // What the case made is what counts, as it may not have used every choice it was given.
+    size_t used_n;
+    const uint64_t *used = choices_made(&used_n);
+
+    if (!simpler(used, used_n, shrinker->best, shrinker->n)) {
+        return false;
+    }
+
+    memcpy(shrinker->best, used, used_n * sizeof(uint64_t));
+    shrinker->n = used_n;
+    ++shrinker->steps;
+
+    return true;
+}
+
+// Try deleting runs of choices, from the end, which drops whole values and elements of arrays.
+static bool delete_runs(Shrinker *shrinker, const size_t size) {
+    bool improved = false;
+    size_t end = shrinker->n;
+
+    while (end >= size && end > 0 && shrinker->attempts < MAX_SHRINK_ATTEMPTS) {
+        size_t start = end - size;
+
+        memcpy(shrinker->candidate, shrinker->best, start * sizeof(uint64_t));
+        memcpy(shrinker->candidate + start, shrinker->best + end, (shrinker->n - end) * sizeof(uint64_t));
+
+        if (try_candidate(shrinker, shrinker->n - size)) {
+            improved = true;
+            end = start < shrinker->n ? start : shrinker->n;
+        } else {
+            --end;
+        }
+    }
+
+    return improved;
+}
+
+// Try replacing runs of choices with zeros, which gives the simplest values at once.
+static bool zero_runs(Shrinker *shrinker, const size_t size) {
+    bool improved = false;
+
+    for (size_t start = 0; start + size <= shrinker->n && shrinker->attempts < MAX_SHRINK_ATTEMPTS; ++start) {
+        bool zero = true;
+        for (size_t i = start; i < start + size; ++i) {
+            zero = zero && shrinker->best[i] == 0;
+        }
+
+        if (zero) {
+            continue;
+        }
+
+        memcpy(shrinker->candidate, shrinker->best, shrinker->n * sizeof(uint64_t));
+        memset(shrinker->candidate + start, 0, size * sizeof(uint64_t));
+
+        improved = try_candidate(shrinker, shrinker->n) || improved;
+    }
+
+    return improved;
+}
+
+// Lower each choice as far as it goes with a binary search, assuming smaller ones keep failing until they stop.
+static bool lower_choices(Shrinker *shrinker) {
+    bool improved = false;
+
+    for (size_t i = 0; i < shrinker->n && shrinker->attempts < MAX_SHRINK_ATTEMPTS; ++i) {
+        uint64_t low = 0;
+        uint64_t high = shrinker->best[i];
+
+        while (low < high && i < shrinker->n && shrinker->attempts < MAX_SHRINK_ATTEMPTS) {
+            uint64_t middle = low + (high - low) / 2;
+
+            memcpy(shrinker->candidate, shrinker->best, shrinker->n * sizeof(uint64_t));
+            shrinker->candidate[i] = middle;
+
+            if (try_candidate(shrinker, shrinker->n)) {
+                improved = true;
+                high = i < shrinker->n ? shrinker->best[i] : 0;
+            } else {
+                low = middle + 1;
+            }
+        }
+    }
+
+    return improved;
+}
+
+size_t shrink_choices(uint64_t **choices, const size_t n, bool (*check)(void *context), void *context, size_t *steps) {
+    Shrinker shrinker = { *choices, n, (uint64_t *) malloc((n > 0 ? n : 1) * sizeof(uint64_t)), check, context, 0, 0 };
+
+    *steps = 0;
+
+    if (!shrinker.candidate) {
+        return n;
+    }
+
+    bool improved = true;
+
+    while (improved && shrinker.attempts < MAX_SHRINK_ATTEMPTS) {
+        improved = false;
+
+        for (size_t size = 8; size > 0; size /= 2) {
+            improved = delete_runs(&shrinker, size) || improved;
+        }
+
+        for (size_t size = 8; size > 0; size /= 2) {
+            improved = zero_runs(&shrinker, size) || improved;
+        }
+
+        improved = lower_choices(&shrinker) || improved;
+    }
+
+    free(shrinker.candidate);
+
+    *steps = shrinker.steps;
+    return shrinker.n;
+}
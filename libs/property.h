@@ -0,0 +1,48 @@
+#ifndef __PROPERTY_H__
+#define __PROPERTY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Most choices a single case can make. Draws past it all give 0.
+#define MAX_CHOICES ((size_t) 1 << 20)
+
+// Most times a failing case is rerun while shrinking it.
+#define MAX_SHRINK_ATTEMPTS 10000
+
+// Start a case that draws its choices from a seeded generator.
+void choices_generate(const uint64_t seed);
+
+// Start a case that replays recorded choices. Draws past the end of them give 0.
+void choices_replay(const uint64_t *choices, const size_t n);
+
+// Is the case replaying recorded choices?
+bool choices_replaying(void);
+
+// Draw a choice from 0 to max. Every generated value is made out of these, such that smaller and fewer choices give
+// simpler values, which is what shrinking relies on.
+uint64_t choices_draw(const uint64_t max);
+
+// Draw a choice from 0 to max, which is the planned one when generating rather than a random one. This is how a value
+// can be drawn in steps that shrink well, but with the distribution it would have been drawn with in one go.
+uint64_t choices_draw_planned(const uint64_t max, const uint64_t planned);
+
+// Get a random number that is not recorded, for planning choices with. Returns 0 when replaying.
+uint64_t choices_random(void);
+
+// Get the choices the case has made so far.
+const uint64_t *choices_made(size_t *n);
+
+// Allocate memory that lasts until the next case starts. Returns NULL if it could not be allocated.
+void *choices_alloc(const size_t bytes);
+
+// Free the memory of the last case.
+void choices_release(void);
+
+// Shrink the choices of a failing case, by rerunning it on simpler ones with check, which returns whether the case
+// still fails. choices is replaced by the simplest failing choices found. Returns how many of them there are, and
+// writes how many simpler ones were found along the way to steps.
+size_t shrink_choices(uint64_t **choices, const size_t n, bool (*check)(void *context), void *context, size_t *steps);
+
+#endif  // __PROPERTY_H__
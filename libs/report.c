@@ -0,0 +1,647 @@
+#include "report.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Column of the median in a CSV benchmark report.
+#define CSV_MEDIAN_COLUMN 7
+
+// Column of the duration in a CSV test report.
+#define CSV_SECONDS_COLUMN 2
+
+// Output helpers.
+static void json_string(FILE *out, const char *str) {
+    fputc('"', out);
+
+    for (const unsigned char *c = (const unsigned char *) str; *c; ++c) {
+        switch (*c) {
+            case '"':
+                fputs("\\\"", out);
+                break;
+            case '\\':
+                fputs("\\\\", out);
+                break;
+            case '\n':
+                fputs("\\n", out);
+                break;
+            case '\r':
+                fputs("\\r", out);
+                break;
+            case '\t':
+                fputs("\\t", out);
+                break;
+            default:
+                if (*c < 0x20) {
+                    fprintf(out, "\\u%04x", *c);
+                } else {
+                    fputc(*c, out);
+                }
+                break;
+        }
+    }
+
+    fputc('"', out);
+}
+
+static void json_number(FILE *out, const double value) {
+    if (isfinite(value)) {
+        fprintf(out, "%.9g", value);
+    } else {
+        fputs("null", out);
+    }
+}
+
+// Write part of a quoted CSV field.
+static void csv_chars(FILE *out, const char *str) {
+    for (const char *c = str; *c; ++c) {
+        if (*c == '"') {
+            fputc('"', out);
+        }
+
+        fputc(*c, out);
+    }
+}
+
+static void csv_string(FILE *out, const char *str) {
+    fputc('"', out);
+    csv_chars(out, str);
+    fputc('"', out);
+}
+
+static void csv_number(FILE *out, const double value) {
+    if (isfinite(value)) {
+        fprintf(out, "%.9g", value);
+    }
+}
+
+// JSON reporter.
+static void json_begin_tests(FILE *out) {
+    fputs("{\n  \"tests\": [", out);
+}
+
+static void json_test(FILE *out, const Test *test, const size_t index) {
+    fputs(index > 0 ? ",\n    {\n" : "\n    {\n", out);
+
+    fputs("      \"name\": ", out);
+    json_string(out, test->name);
+    fprintf(out, ",\n      \"passed\": %s,\n      \"seconds\": ", test->passed ? "true" : "false");
+    json_number(out, test->time);
+    fprintf(out, ",\n      \"allocations\": %zu,\n      \"allocated_bytes\": %zu,\n      \"peak_bytes\": %zu,\n", test->allocations, test->allocated_bytes, test->peak_bytes);
+    fprintf(out, "      \"leaked_bytes\": %zu,\n      \"leaked_allocations\": %zu", test->leaked_bytes, test->leaked_allocations);
+
+    fputs("\n    }", out);
+}
+
+static void json_end_tests(FILE *out, const size_t passed, const size_t failed, const double seconds) {
+    fprintf(out, "\n  ],\n  \"passed\": %zu,\n  \"failed\": %zu,\n  \"seconds\": ", passed, failed);
+    json_number(out, seconds);
+    fputs("\n}\n", out);
+}
+
+static void json_begin_benchmarks(FILE *out, const BenchmarkEnvironment *environment) {
+    fputs("{\n  \"environment\": {\n    \"cpu_model\": ", out);
+    json_string(out, environment->cpu_model);
+    fputs(",\n    \"governor\": ", out);
+    json_string(out, environment->governor);
+    fprintf(out, ",\n    \"processors\": %zu,\n    \"turbo\": %s,\n", environment->processors, environment->turbo < 0 ? "null" : environment->turbo ? "true" : "false");
+    fprintf(out, "    \"frequency_scaling\": %s,\n    \"load\": ", environment->frequency_scaling ? "true" : "false");
+    json_number(out, environment->load);
+    fprintf(out, ",\n    \"core\": %d,\n    \"raised_priority\": %s,\n", environment->core, environment->raised_priority ? "true" : "false");
+    fprintf(out, "    \"interleaved\": %s\n  },\n  \"benchmarks\": [", environment->interleaved ? "true" : "false");
+}
+
+static void json_benchmark(FILE *out, const BenchmarkResult *result, const size_t index) {
+    const SampleStats *stats = &result->stats;
+
+    const char *names[] = { "min", "median", "p90", "p99", "max", "mean", "stddev", "mad" };
+    const double values[] = { stats->min, stats->median, stats->p90, stats->p99, stats->max, stats->mean, stats->stddev, stats->mad };
+
+    fputs(index > 0 ? ",\n    {\n" : "\n    {\n", out);
+
+    fputs("      \"name\": ", out);
+    json_string(out, result->name);
+    fprintf(out, ",\n      \"timer\": \"%s\",\n      \"unit\": \"%s\",\n", timer_source_name(result->timer), result->unit);
+    fprintf(out, "      \"iterations\": %zu,\n      \"warmup\": %zu,\n      \"times\": %zu,\n", result->iterations, result->warmup, result->times);
+    fprintf(out, "      \"threads\": %zu,\n      \"efficiency\": ", result->threads);
+    json_number(out, result->efficiency);
+    fprintf(out, ",\n      \"size\": %zu,\n      \"throughput\": ", result->size);
+    json_number(out, result->throughput);
+    fprintf(out, ",\n      \"throughput_unit\": \"%s\",\n      \"complexity\": ", result->throughput_unit ? result->throughput_unit : "ops/s");
+    if (result->complexity) {
+        json_string(out, result->complexity);
+    } else {
+        fputs("null", out);
+    }
+    fputs(",\n", out);
+
+    if (result->counted) {
+        fputs("      \"counters\": {", out);
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            fprintf(out, "\"%s\": ", counter_name((CounterKind) i));
+            json_number(out, result->counters[i]);
+            fputs(", ", out);
+        }
+        fputs("\"ipc\": ", out);
+        json_number(out, result->ipc);
+        fputs("},\n", out);
+    } else {
+        fputs("      \"counters\": null,\n", out);
+    }
+
+    // Keyed by "instrument" rather than "name", which would look like another record to the report loader.
+    fputs("      \"instruments\": [", out);
+    for (size_t i = 0; i < result->instrument_count; ++i) {
+        const InstrumentTotal *total = result->instruments + i;
+
+        fputs(i > 0 ? ", {\"instrument\": " : "{\"instrument\": ", out);
+        json_string(out, total->name);
+        fprintf(out, ", \"kind\": \"%s\", \"count\": %" PRIu64 ", \"total\": %" PRIu64 ", \"mean\": ", total->kind == INSTRUMENT_SCOPE ? "scope" : "counter", total->count, total->total);
+        json_number(out, (double) total->total / (double) total->count);
+        fprintf(out, ", \"min\": %" PRIu64 ", \"max\": %" PRIu64 "}", total->min, total->max);
+    }
+    fputs("],\n", out);
+
+    fputs("      \"samples\": [", out);
+    for (size_t i = 0; i < result->times; ++i) {
+        fputs(i > 0 ? ", " : "", out);
+        json_number(out, result->samples[i]);
+    }
+    fputs("],\n", out);
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(double); ++i) {
+        fprintf(out, "      \"%s\": ", names[i]);
+        json_number(out, values[i]);
+        fputs(",\n", out);
+    }
+
+    fprintf(out, "      \"outliers\": %zu,\n      \"inlier_mean\": ", stats->outliers);
+    json_number(out, stats->inlier_mean);
+    fputs(",\n      \"ci_low\": ", out);
+    json_number(out, stats->ci_low);
+    fputs(",\n      \"ci_high\": ", out);
+    json_number(out, stats->ci_high);
+
+    fputs(",\n      \"baseline\": ", out);
+    json_number(out, result->has_baseline ? result->baseline : NAN);
+    fputs(",\n      \"change\": ", out);
+    json_number(out, result->has_baseline ? result->change : NAN);
+    fprintf(out, ",\n      \"regressed\": %s\n    }", result->regressed ? "true" : "false");
+}
+
+static void json_end_benchmarks(FILE *out, const size_t regressions, const double seconds) {
+    fprintf(out, "\n  ],\n  \"regressions\": %zu,\n  \"seconds\": ", regressions);
+    json_number(out, seconds);
+    fputs("\n}\n", out);
+}
+
+// CSV reporter.
+static void csv_begin_tests(FILE *out) {
+    fputs("name,passed,seconds,allocations,allocated_bytes,peak_bytes,leaked_bytes,leaked_allocations\n", out);
+}
+
+static void csv_test(FILE *out, const Test *test, const size_t index __attribute__((unused))) {
+    csv_string(out, test->name);
+    fprintf(out, ",%d,", test->passed ? 1 : 0);
+    csv_number(out, test->time);
+    fprintf(out, ",%zu,%zu,%zu,%zu,%zu\n", test->allocations, test->allocated_bytes, test->peak_bytes, test->leaked_bytes, test->leaked_allocations);
+}
+
+static void csv_end_tests(FILE *out __attribute__((unused)), const size_t passed __attribute__((unused)), const size_t failed __attribute__((unused)), const double seconds __attribute__((unused))) {
+    // CSV has no summary row; everything needed can be derived from the rows.
+}
+
+// The environment is repeated on every row, since CSV has nowhere else to put it.
+static void csv_begin_benchmarks(FILE *out, const BenchmarkEnvironment *environment __attribute__((unused))) {
+    fputs("name,timer,unit,iterations,warmup,times,min,median,p90,p99,max,mean,stddev,mad,outliers,inlier_mean,ci_low,ci_high,baseline,change,regressed,threads,efficiency,cycles,instructions,cache_misses,branch_misses,page_faults,ipc,size,throughput,throughput_unit,complexity,cpu_model,governor,processors,turbo,frequency_scaling,load,core,raised_priority,interleaved,instruments,samples\n", out);
+}
+
+static void csv_benchmark(FILE *out, const BenchmarkResult *result, const size_t index __attribute__((unused))) {
+    const SampleStats *stats = &result->stats;
+    const double values[] = { stats->min, stats->median, stats->p90, stats->p99, stats->max, stats->mean, stats->stddev, stats->mad };
+
+    csv_string(out, result->name);
+    fprintf(out, ",%s,%s,%zu,%zu,%zu", timer_source_name(result->timer), result->unit, result->iterations, result->warmup, result->times);
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(double); ++i) {
+        fputc(',', out);
+        csv_number(out, values[i]);
+    }
+
+    fprintf(out, ",%zu,", stats->outliers);
+    csv_number(out, stats->inlier_mean);
+    fputc(',', out);
+    csv_number(out, stats->ci_low);
+    fputc(',', out);
+    csv_number(out, stats->ci_high);
+    fputc(',', out);
+    csv_number(out, result->has_baseline ? result->baseline : NAN);
+    fputc(',', out);
+    csv_number(out, result->has_baseline ? result->change : NAN);
+    fprintf(out, ",%d,%zu,", result->regressed ? 1 : 0, result->threads);
+    csv_number(out, result->efficiency);
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        fputc(',', out);
+        csv_number(out, result->counted ? result->counters[i] : NAN);
+    }
+
+    fputc(',', out);
+    csv_number(out, result->counted ? result->ipc : NAN);
+    fprintf(out, ",%zu,", result->size);
+    csv_number(out, result->throughput);
+    fprintf(out, ",%s,", result->throughput_unit ? result->throughput_unit : "ops/s");
+    if (result->complexity) {
+        csv_string(out, result->complexity);
+    }
+
+    const BenchmarkEnvironment *environment = result->environment;
+    if (environment) {
+        fputc(',', out);
+        csv_string(out, environment->cpu_model);
+        fputc(',', out);
+        csv_string(out, environment->governor);
+        fprintf(out, ",%zu,", environment->processors);
+        if (environment->turbo >= 0) {
+            fputc(environment->turbo ? '1' : '0', out);
+        }
+        fprintf(out, ",%d,", environment->frequency_scaling ? 1 : 0);
+        csv_number(out, environment->load);
+        fprintf(out, ",%d,%d,%d", environment->core, environment->raised_priority ? 1 : 0, environment->interleaved ? 1 : 0);
+    } else {
+        fputs(",,,,,,,,,", out);
+    }
+
+    // Each scope or counter as name:kind:count:total:min:max, separated by semicolons.
+    fputs(",\"", out);
+    for (size_t i = 0; i < result->instrument_count; ++i) {
+        const InstrumentTotal *total = result->instruments + i;
+
+        fputs(i > 0 ? ";" : "", out);
+        csv_chars(out, total->name);
+        fprintf(out, ":%s:%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%" PRIu64, total->kind == INSTRUMENT_SCOPE ? "scope" : "counter", total->count, total->total, total->min, total->max);
+    }
+    fputs("\",\"", out);
+
+    for (size_t i = 0; i < result->times; ++i) {
+        fputs(i > 0 ? " " : "", out);
+        csv_number(out, result->samples[i]);
+    }
+
+    fputs("\"\n", out);
+}
+
+static void csv_end_benchmarks(FILE *out __attribute__((unused)), const size_t regressions __attribute__((unused)), const double seconds __attribute__((unused))) {
+    // Same as for tests.
+}
+
+static const Reporter JSON_REPORTER = {
+    json_begin_tests, json_test, json_end_tests,
+    json_begin_benchmarks, json_benchmark, json_end_benchmarks
+};
+
+static const Reporter CSV_REPORTER = {
+    csv_begin_tests, csv_test, csv_end_tests,
+    csv_begin_benchmarks, csv_benchmark, csv_end_benchmarks
+};
+
+const Reporter *get_reporter(const ReportFormat format) {
+    switch (format) {
+        case REPORT_JSON:
+            return &JSON_REPORTER;
+        case REPORT_CSV:
+            return &CSV_REPORTER;
+        default:
+            return NULL;
+    }
+}
+
+const char *timer_source_name(const TimerSource source) {
+    switch (source) {
+        case TIMER_THREAD_CPU:
+            return "thread_cpu";
+        case TIMER_CYCLES:
+            return "cycles";
+        default:
+            return "wall";
+    }
+}
+
+// Baseline parsing.
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    char *data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long length = ftell(file);
+
+        if (length >= 0 && fseek(file, 0, SEEK_SET) == 0 && (data = (char *) malloc((size_t) length + 1))) {
+            size_t got = fread(data, 1, (size_t) length, file);
+            data[got] = '\0';
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+// Read a JSON string starting just after its opening quote, undoing the escapes of json_string along with the rest of
+// those JSON has. Returns where it ends, just after its closing quote.
+static const char *parse_json_string(const char *cursor, char *out, const size_t capacity) {
+    size_t length = 0;
+
+    for (; *cursor && *cursor != '"'; ++cursor) {
+        char c = *cursor;
+        unsigned long code = 0;
+
+        if (c == '\\' && cursor[1]) {
+            switch (*++cursor) {
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'u':
+                    {
+                        char hex[5] = { '\0' };
+
+                        for (size_t i = 0; i < 4 && isxdigit((unsigned char) cursor[1]); ++i) {
+                            hex[i] = *++cursor;
+                        }
+
+                        code = strtoul(hex, NULL, 16);
+                        c = (char) code;
+                    }
+                    break;
+                default:
+                    c = *cursor;
+                    break;
+            }
+        }
+
+        // Characters escaped as code points outside ASCII are written back out as UTF-8.
+        char encoded[3] = { c, '\0', '\0' };
+        size_t bytes = 1;
+
+        if (code >= 0x800) {
+            encoded[0] = (char) (0xE0 | (code >> 12));
+            encoded[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+            encoded[2] = (char) (0x80 | (code & 0x3F));
+            bytes = 3;
+        } else if (code >= 0x80) {
+            encoded[0] = (char) (0xC0 | (code >> 6));
+            encoded[1] = (char) (0x80 | (code & 0x3F));
+            bytes = 2;
+        }
+
+        for (size_t i = 0; i < bytes && length + 1 < capacity; ++i) {
+            out[length++] = encoded[i];
+        }
+    }
+
+    out[length] = '\0';
+    return *cursor ? cursor + 1 : cursor;
+}
+
+static const char *skip_json_space(const char *cursor) {
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n') {
+        ++cursor;
+    }
+
+    return cursor;
+}
+
+// Skip over a JSON value of any kind, returning where it ends.
+static const char *skip_json_value(const char *cursor) {
+    char scratch[NAME_MAX_LENGTH];
+    cursor = skip_json_space(cursor);
+
+    if (*cursor == '"') {
+        return parse_json_string(cursor + 1, scratch, sizeof(scratch));
+    }
+
+    if (*cursor == '{' || *cursor == '[') {
+        char close = *cursor == '{' ? '}' : ']';
+        cursor = skip_json_space(cursor + 1);
+
+        while (*cursor && *cursor != close) {
+            // The key of a member of an object is skipped as a value, along with its colon. Anything out of place is
+            // skipped a character at a time, so that a broken report cannot stop the loop.
+            const char *skipped = skip_json_space(skip_json_value(cursor));
+            skipped = *skipped == ':' || *skipped == ',' ? skipped + 1 : skipped;
+
+            cursor = skip_json_space(skipped > cursor ? skipped : cursor + 1);
+        }
+
+        return *cursor ? cursor + 1 : cursor;
+    }
+
+    // A number, true, false or null.
+    while (*cursor && !strchr(",:}] \t\r\n", *cursor)) {
+        ++cursor;
+    }
+
+    return cursor;
+}
+
+// Read the members of a JSON object starting at its opening brace, keeping its name and the number under a key.
+// Returns where it ends, and whether it had both.
+static const char *parse_json_record(const char *cursor, const char *key, BaselineEntry *entry, bool *found) {
+    bool named = false;
+    bool valued = false;
+
+    cursor = skip_json_space(cursor + 1);
+
+    while (*cursor == '"') {
+        char member[NAME_MAX_LENGTH];
+        cursor = skip_json_space(parse_json_string(cursor + 1, member, sizeof(member)));
+        cursor = skip_json_space(*cursor == ':' ? cursor + 1 : cursor);
+
+        if (strcmp(member, "name") == 0 && *cursor == '"') {
+            cursor = parse_json_string(cursor + 1, entry->name, NAME_MAX_LENGTH);
+            named = true;
+        } else if (strcmp(member, key) == 0 && (*cursor == '-' || isdigit((unsigned char) *cursor))) {
+            char *end;
+            entry->value = strtod(cursor, &end);
+            cursor = end;
+            valued = true;
+        } else {
+            cursor = skip_json_value(cursor);
+        }
+
+        cursor = skip_json_space(cursor);
+        cursor = skip_json_space(*cursor == ',' ? cursor + 1 : cursor);
+    }
+
+    *found = named && valued;
+    return *cursor == '}' ? cursor + 1 : cursor;
+}
+
+// Read a CSV field, undoing the quoting of csv_string. Quoted fields may hold commas and line breaks. Returns where the
+// next field starts, and sets last if this one ended its record.
+static const char *parse_csv_field(const char *cursor, char *out, const size_t capacity, bool *last) {
+    size_t length = 0;
+    bool quoted = *cursor == '"';
+
+    if (quoted) {
+        ++cursor;
+    }
+
+    for (; *cursor; ++cursor) {
+        if (quoted && *cursor == '"') {
+            if (cursor[1] != '"') {
+                quoted = false;
+                continue;
+            }
+
+            ++cursor;
+        } else if (!quoted && (*cursor == ',' || *cursor == '\n' || *cursor == '\r')) {
+            break;
+        }
+
+        if (length + 1 < capacity) {
+            out[length++] = *cursor;
+        }
+    }
+
+    out[length] = '\0';
+    *last = *cursor != ',';
+
+    if (cursor[0] == '\r' && cursor[1] == '\n') {
+        ++cursor;
+    }
+
+    return *cursor ? cursor + 1 : cursor;
+}
+
+static bool append_entry(BaselineEntry **entries, size_t *n, size_t *capacity, const BaselineEntry *entry) {
+    if (*n == *capacity) {
+        size_t grown = *capacity > 0 ? *capacity * 2 : 16u;
+        BaselineEntry *resized = (BaselineEntry *) realloc(*entries, grown * sizeof(BaselineEntry));
+        if (!resized) {
+            return false;
+        }
+
+        *entries = resized;
+        *capacity = grown;
+    }
+
+    (*entries)[(*n)++] = *entry;
+    return true;
+}
+
+// Load the value of a field from each record of a report, keyed by the name of the record. JSON records are the
+// objects in the arrays of the report, and their field is found by its key. CSV records are rows, and their field is
+// found by its column.
+static size_t load_report_values(const char *path, const char *key, const size_t column_index, BaselineEntry **out) {
+    char *data = read_file(path);
+    *out = NULL;
+
+    if (!data) {
+        return 0;
+    }
+
+    size_t n = 0;
+    size_t capacity = 0;
+    bool appended = true;
+    BaselineEntry entry;
+
+    const char *cursor = skip_json_space(data);
+
+    if (*cursor == '{') {
+        cursor = skip_json_space(cursor + 1);
+
+        while (appended && *cursor == '"') {
+            char member[NAME_MAX_LENGTH];
+            cursor = skip_json_space(parse_json_string(cursor + 1, member, sizeof(member)));
+            cursor = skip_json_space(*cursor == ':' ? cursor + 1 : cursor);
+
+            if (*cursor != '[') {
+                cursor = skip_json_value(cursor);
+            } else {
+                cursor = skip_json_space(cursor + 1);
+
+                while (appended && *cursor && *cursor != ']') {
+                    bool found = false;
+                    const char *next = *cursor == '{' ? parse_json_record(cursor, key, &entry, &found) : skip_json_value(cursor);
+
+                    appended = !found || append_entry(out, &n, &capacity, &entry);
+
+                    next = skip_json_space(next > cursor ? next : cursor + 1);
+                    cursor = skip_json_space(*next == ',' ? next + 1 : next);
+                }
+
+                cursor = *cursor ? cursor + 1 : cursor;
+            }
+
+            cursor = skip_json_space(cursor);
+            cursor = skip_json_space(*cursor == ',' ? cursor + 1 : cursor);
+        }
+    } else {
+        char field[NAME_MAX_LENGTH];
+        bool last = false;
+
+        // Skip the header row.
+        while (*cursor && !last) {
+            cursor = parse_csv_field(cursor, field, sizeof(field), &last);
+        }
+
+        while (appended && *cursor) {
+            cursor = parse_csv_field(cursor, entry.name, NAME_MAX_LENGTH, &last);
+            *field = '\0';
+
+            size_t column = 0;
+            while (!last && column < column_index) {
+                cursor = parse_csv_field(cursor, field, sizeof(field), &last);
+                ++column;
+            }
+
+            if (column == column_index && *field) {
+                entry.value = strtod(field, NULL);
+                appended = append_entry(out, &n, &capacity, &entry);
+            }
+
+            // The rest of the row.
+            while (*cursor && !last) {
+                char rest[NAME_MAX_LENGTH];
+                cursor = parse_csv_field(cursor, rest, sizeof(rest), &last);
+            }
+        }
+    }
+
+    free(data);
+    return n;
+}
+
+size_t load_baseline(const char *path, BaselineEntry **out) {
+    return load_report_values(path, "median", CSV_MEDIAN_COLUMN, out);
+}
+
+size_t load_test_durations(const char *path, BaselineEntry **out) {
+    return load_report_values(path, "seconds", CSV_SECONDS_COLUMN, out);
+}
+
+const BaselineEntry *find_baseline(const BaselineEntry *entries, const size_t n, const char *name) {
+    for (size_t i = 0; i < n; ++i) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return entries + i;
+        }
+    }
+
+    return NULL;
+}
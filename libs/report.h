@@ -0,0 +1,90 @@
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include "../catom.h"
+#include "counters.h"
+#include "environment.h"
+#include "instrument.h"
+#include "stats.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Everything measured about one benchmark, in the form handed to reporters.
+ */
+typedef struct {
+    const Benchmark *benchmark;              /**< The benchmark that was run. */
+    const char *name;                        /**< Name of the record, which has the thread count added for parallel benchmarks. */
+    TimerSource timer;                       /**< Timer the benchmark was measured with. */
+    size_t warmup;                           /**< Number of warmup iterations. */
+    size_t times;                            /**< Number of measured iterations. */
+    size_t iterations;                       /**< Operations per iteration (1 unless the benchmark is scaled), on each thread. */
+    size_t threads;                          /**< Number of threads the benchmark ran on at once. */
+    double efficiency;                       /**< Throughput relative to perfect scaling from one thread (1 if not parallel). */
+    size_t size;                             /**< Size the benchmark was run at (0 unless it is a range benchmark). */
+    double throughput;                       /**< Operations (or items or bytes for range benchmarks) per second at the median. */
+    const char *throughput_unit;             /**< Unit of the throughput. */
+    const char *complexity;                  /**< Complexity fitted to every size of a range benchmark, or NULL. */
+    const char *unit;                        /**< Unit of the samples and statistics. */
+    const double *samples;                   /**< The measured samples, in iteration order. */
+    SampleStats stats;                       /**< Summary of the samples. */
+    bool counted;                            /**< Were hardware and kernel events counted? */
+    double counters[COUNTER_COUNT];          /**< Average of each counter per operation, or NAN if it could not be opened. */
+    double ipc;                              /**< Instructions per cycle over every sample, or NAN if they were not both counted. */
+    bool has_baseline;                       /**< Was this benchmark found in the baseline? */
+    double baseline;                         /**< Median of this benchmark in the baseline. */
+    double change;                           /**< Relative change of the median from the baseline. */
+    bool regressed;                          /**< Did the change exceed the regression threshold? */
+    const BenchmarkEnvironment *environment; /**< What the benchmark was measured on. */
+    const InstrumentTotal *instruments;      /**< Totals of the scopes and counters recorded in the benchmark. */
+    size_t instrument_count;                 /**< Number of them. */
+} BenchmarkResult;
+
+/**
+ * A machine-readable output format. Each run writes a complete document, one record at a time.
+ */
+typedef struct {
+    // Start of a test run.
+    void (*begin_tests)(FILE *out);
+
+    // One finished test.
+    void (*test)(FILE *out, const Test *test, const size_t index);
+
+    // End of a test run.
+    void (*end_tests)(FILE *out, const size_t passed, const size_t failed, const double seconds);
+
+    // Start of a benchmark run, along with what it is measured on.
+    void (*begin_benchmarks)(FILE *out, const BenchmarkEnvironment *environment);
+
+    // One finished benchmark.
+    void (*benchmark)(FILE *out, const BenchmarkResult *result, const size_t index);
+
+    // End of a benchmark run.
+    void (*end_benchmarks)(FILE *out, const size_t regressions, const double seconds);
+} Reporter;
+
+// Get the reporter for an output format, or NULL for REPORT_NONE.
+const Reporter *get_reporter(const ReportFormat format);
+
+// Short machine-readable name of a timer.
+const char *timer_source_name(const TimerSource source);
+
+/**
+ * One benchmark in a baseline report, or one test in a report of test durations.
+ */
+typedef struct {
+    char name[NAME_MAX_LENGTH];/**< Name of the benchmark or test. */
+    double value;               /**< Median of the benchmark's samples, or the seconds the test took. */
+} BaselineEntry;
+
+// Load the benchmarks out of a JSON or CSV benchmark report. Returns the number of entries loaded into *out.
+size_t load_baseline(const char *path, BaselineEntry **out);
+
+// Load the tests out of a JSON or CSV test report, with how long each took. Returns the number of entries loaded.
+size_t load_test_durations(const char *path, BaselineEntry **out);
+
+// Find a benchmark or test by name in a loaded report.
+const BaselineEntry *find_baseline(const BaselineEntry *entries, const size_t n, const char *name);
+
+#endif  // __REPORT_H__
@@ -0,0 +1,115 @@
+#include "selection.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool glob_match(const char *pattern, const char *name) {
+    // Where to go back to if what follows the last * stops matching.
+    const char *star = NULL;
+    const char *resume = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star = ++pattern;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            ++pattern;
+            ++name;
+        } else if (star) {
+            pattern = star;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*') {
+        ++pattern;
+    }
+
+    return *pattern == '\0';
+}
+
+bool filter_match(const char *filter, const char *name) {
+    bool included = false;
+    bool has_includes = false;
+
+    while (*filter) {
+        const char *end = strchr(filter, ',');
+        size_t length = end ? (size_t) (end - filter) : strlen(filter);
+
+        bool excluding = *filter == '-';
+        const char *start = excluding ? filter + 1 : filter;
+        size_t pattern_length = excluding ? length - 1 : length;
+
+        if (pattern_length > 0) {
+            char *pattern = (char *) malloc(pattern_length + 1);
+
+            if (pattern) {
+                memcpy(pattern, start, pattern_length);
+                pattern[pattern_length] = '\0';
+
+                bool matched = glob_match(pattern, name);
+                free(pattern);
+
+                if (excluding && matched) {
+                    return false;
+                }
+
+                has_includes = has_includes || !excluding;
+                included = included || (!excluding && matched);
+            }
+        }
+
+        filter += end ? length + 1 : length;
+    }
+
+    return included || !has_includes;
+}
+
+// The costs being sorted, which qsort has no way to pass to the comparison.
+static const double *sorting_costs = NULL;
+
+static int compare_costs(const void *a, const void *b) {
+    size_t i = *(const size_t *) a;
+    size_t j = *(const size_t *) b;
+
+    if (sorting_costs[i] != sorting_costs[j]) {
+        return sorting_costs[i] > sorting_costs[j] ? -1 : 1;
+    }
+
+    return i < j ? -1 : i > j;
+}
+
+bool assign_shards(const double *costs, const size_t n, const size_t shard_count, size_t *shards) {
+    size_t *order = (size_t *) malloc((n + 1) * sizeof(size_t));
+    double *loads = (double *) calloc(shard_count + 1, sizeof(double));
+
+    if (!order || !loads) {
+        free(order);
+        free(loads);
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+
+    sorting_costs = costs;
+    qsort(order, n, sizeof(size_t), compare_costs);
+    sorting_costs = NULL;
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t lightest = 0;
+        for (size_t shard = 1; shard < shard_count; ++shard) {
+            lightest = loads[shard] < loads[lightest] ? shard : lightest;
+        }
+
+        shards[order[i]] = lightest;
+        loads[lightest] += costs[order[i]];
+    }
+
+    free(order);
+    free(loads);
+    return true;
+}
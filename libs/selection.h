@@ -0,0 +1,21 @@
+#ifndef __SELECTION_H__
+#define __SELECTION_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Does a name match a glob pattern, where * matches any run of characters and ? matches any one character?
+bool glob_match(const char *pattern, const char *name);
+
+// Does a name pass a filter? Filters are comma-separated lists of glob patterns, and patterns starting with '-'
+// exclude the names they match. A name passes if it matches an including pattern (or there are none) and no excluding
+// pattern.
+bool filter_match(const char *filter, const char *name);
+
+// Split n jobs between a number of shards, balancing what they cost. Each job, from the most expensive down, goes to
+// the shard that costs the least so far. Ties go to the earliest job and shard, so that every machine computes the
+// same split, and jobs that all cost the same are dealt out in turn. Writes the shard of each job to shards. Returns
+// false if there was no memory to sort the jobs in.
+bool assign_shards(const double *costs, const size_t n, const size_t shard_count, size_t *shards);
+
+#endif  // __SELECTION_H__
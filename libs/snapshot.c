@@ -0,0 +1,479 @@
+#include "snapshot.h"
+#include "arrcmp.h"
+#include "hashing.h"
+#include "output.h"
+#include "whatos.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef OS_WINDOWS
+#include <direct.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Room for a path and the suffix of the temporary file it is written through, which holds the ID of the process.
+#define TEMPORARY_PATH_LENGTH (SNAPSHOT_PATH_LENGTH + 32)
+
+// Longest line in the index.
+#define INDEX_LINE_LENGTH (SNAPSHOT_PATH_LENGTH + 64)
+
+// First line of the index, which describes the lines after it.
+#define INDEX_HEADER "# hash size mtime-ns name\n"
+
+// A snapshot recorded in the index, along with what its file looked like when it was recorded.
+typedef struct {
+    char name[SNAPSHOT_PATH_LENGTH];
+    uint64_t hash;
+    size_t size;
+    long long mtime; // In nanoseconds, so that a file rewritten within the same second is not taken as unchanged.
+    size_t line;     // Which line of the index it was read from.
+} IndexEntry;
+
+// A file mapped into memory for reading.
+typedef struct {
+    const void *data;
+    size_t size;
+#ifdef OS_WINDOWS
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} MappedFile;
+
+static char directory[SNAPSHOT_PATH_LENGTH] = "snapshots";
+static bool update_snapshots = false;
+
+// The index of the snapshot directory, sorted by name. It is loaded once, and kept up to date with what is recorded.
+static IndexEntry *index_entries = NULL;
+static size_t index_count = 0;
+static size_t index_capacity = 0;
+static bool index_loaded = false;
+
+static void drop_index(void);
+
+void set_snapshot_directory(const char *path) {
+    strncpy(directory, path, SNAPSHOT_PATH_LENGTH - 1);
+    directory[SNAPSHOT_PATH_LENGTH - 1] = '\0';
+
+    drop_index();
+}
+
+void set_snapshot_update(const bool update) {
+    update_snapshots = update;
+}
+
+// OS-specific file handling.
+#ifdef OS_WINDOWS
+static void make_directory(const char *path) {
+    _mkdir(path);
+}
+
+static bool replace_file(const char *from, const char *to) {
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static long process_id(void) {
+    return (long) _getpid();
+}
+
+// Only whole seconds are kept here.
+static long long modified_time(const struct stat *info) {
+    return (long long) info->st_mtime * 1000000000LL;
+}
+
+static bool map_file(const char *path, const size_t size, MappedFile *out) {
+    memset(out, 0, sizeof(MappedFile));
+    out->size = size;
+
+    if (size == 0) {
+        out->data = "";
+        return true;
+    }
+
+    out->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (out->file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    out->mapping = CreateFileMappingA(out->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (out->mapping) {
+        out->data = MapViewOfFile(out->mapping, FILE_MAP_READ, 0, 0, size);
+    }
+
+    if (!out->data) {
+        if (out->mapping) {
+            CloseHandle(out->mapping);
+        }
+
+        CloseHandle(out->file);
+        return false;
+    }
+
+    return true;
+}
+
+static void unmap_file(MappedFile *file) {
+    if (file->size > 0) {
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping);
+        CloseHandle(file->file);
+    }
+}
+#else
+static void make_directory(const char *path) {
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        output_printf("*** [WARNING] Failed to create the snapshot directory \"%s\". ***\n", path);
+    }
+}
+
+static bool replace_file(const char *from, const char *to) {
+    return rename(from, to) == 0;
+}
+
+static long process_id(void) {
+    return (long) getpid();
+}
+
+static long long modified_time(const struct stat *info) {
+    return (long long) info->st_mtim.tv_sec * 1000000000LL + (long long) info->st_mtim.tv_nsec;
+}
+
+static bool map_file(const char *path, const size_t size, MappedFile *out) {
+    memset(out, 0, sizeof(MappedFile));
+    out->size = size;
+
+    // A zero-length mapping is an error, but there is nothing to map anyway.
+    if (size == 0) {
+        out->data = "";
+        return true;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    // The file is read front to back exactly once.
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    out->data = data;
+    return true;
+}
+
+static void unmap_file(MappedFile *file) {
+    if (file->size > 0) {
+        munmap((void *) file->data, file->size);
+    }
+}
+#endif
+
+// Create the directories a file is in, from the top down, since snapshot names may contain slashes.
+static void make_parent_directories(const char *path) {
+    char parent[SNAPSHOT_PATH_LENGTH];
+    strncpy(parent, path, SNAPSHOT_PATH_LENGTH - 1);
+    parent[SNAPSHOT_PATH_LENGTH - 1] = '\0';
+
+    for (char *c = parent + 1; *c; ++c) {
+        if (*c == '/') {
+            *c = '\0';
+            make_directory(parent);
+            *c = '/';
+        }
+    }
+}
+
+// Write the path of the temporary file that a file is written through. Each process has its own, so that processes
+// writing the same file at once do not write into each other's.
+static void temporary_path(char *out, const char *path) {
+    snprintf(out, TEMPORARY_PATH_LENGTH, "%s.%ld.tmp", path, process_id());
+}
+
+// Write the path of the index.
+static void index_path(char *out) {
+    snprintf(out, SNAPSHOT_PATH_LENGTH, "%s/%s", directory, SNAPSHOT_INDEX_NAME);
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(((const IndexEntry *) a)->name, ((const IndexEntry *) b)->name);
+}
+
+// Lines for the same name are sorted in the order they were read, so that the last of them can be kept.
+static int compare_entries(const void *a, const void *b) {
+    int names = compare_names(a, b);
+    size_t x = ((const IndexEntry *) a)->line;
+    size_t y = ((const IndexEntry *) b)->line;
+
+    return names != 0 ? names : (x > y) - (x < y);
+}
+
+// Make room for one more entry in the index. Returns false if there was no memory for it.
+static bool grow_index(void) {
+    if (index_count < index_capacity) {
+        return true;
+    }
+
+    size_t capacity = index_capacity > 0 ? index_capacity * 2 : 16;
+
+    IndexEntry *grown = (IndexEntry *) realloc(index_entries, capacity * sizeof(IndexEntry));
+    if (!grown) {
+        return false;
+    }
+
+    index_entries = grown;
+    index_capacity = capacity;
+    return true;
+}
+
+static void write_index_entry(FILE *index, const IndexEntry *entry) {
+    fprintf(index, "%016" PRIx64 " %zu %lld %s\n", entry->hash, entry->size, entry->mtime, entry->name);
+}
+
+// Rewrite the index with one line per snapshot, through a temporary file.
+static void compact_index(void) {
+    char path[SNAPSHOT_PATH_LENGTH];
+    char temporary[TEMPORARY_PATH_LENGTH];
+    index_path(path);
+    temporary_path(temporary, path);
+
+    FILE *index = fopen(temporary, "w");
+    if (!index) {
+        return;
+    }
+
+    fputs(INDEX_HEADER, index);
+    for (size_t i = 0; i < index_count; ++i) {
+        write_index_entry(index, index_entries + i);
+    }
+
+    if (fclose(index) != 0 || !replace_file(temporary, path)) {
+        remove(temporary);
+    }
+}
+
+// Load the index the first time it is needed. Snapshots are recorded by appending a line, so a snapshot recorded more
+// than once takes the last of its lines. If there were any such lines, the index is compacted so that it does not grow
+// from run to run. A line another process appends while this happens may be lost, which only means that snapshot is
+// read next time.
+static void ensure_index(void) {
+    if (index_loaded) {
+        return;
+    }
+
+    index_loaded = true;
+
+    char path[SNAPSHOT_PATH_LENGTH];
+    index_path(path);
+
+    FILE *index = fopen(path, "r");
+    if (!index) {
+        return;
+    }
+
+    size_t lines = 0;
+    bool complete = true;
+    char line[INDEX_LINE_LENGTH];
+
+    while (fgets(line, INDEX_LINE_LENGTH, index)) {
+        IndexEntry entry;
+        int name_start = 0;
+
+        if (line[0] == '#' || sscanf(line, "%" SCNx64 " %zu %lld %n", &entry.hash, &entry.size, &entry.mtime, &name_start) < 3 || name_start == 0) {
+            continue;
+        }
+
+        line[strcspn(line, "\r\n")] = '\0';
+        strncpy(entry.name, line + name_start, SNAPSHOT_PATH_LENGTH - 1);
+        entry.name[SNAPSHOT_PATH_LENGTH - 1] = '\0';
+        entry.line = lines++;
+
+        if (!grow_index()) {
+            complete = false;
+            break;
+        }
+
+        index_entries[index_count++] = entry;
+    }
+
+    fclose(index);
+
+    qsort(index_entries, index_count, sizeof(IndexEntry), compare_entries);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < index_count; ++i) {
+        if (unique > 0 && strcmp(index_entries[unique - 1].name, index_entries[i].name) == 0) {
+            index_entries[unique - 1] = index_entries[i];
+        } else {
+            index_entries[unique++] = index_entries[i];
+        }
+    }
+
+    index_count = unique;
+
+    // Only what was read can be written back.
+    if (complete && unique < lines) {
+        compact_index();
+    }
+}
+
+// Forget the index, so that it is loaded again the next time it is needed.
+static void drop_index(void) {
+    free(index_entries);
+    index_entries = NULL;
+    index_count = 0;
+    index_capacity = 0;
+    index_loaded = false;
+}
+
+static IndexEntry *find_index_entry(const char *name) {
+    ensure_index();
+
+    IndexEntry key;
+    strncpy(key.name, name, SNAPSHOT_PATH_LENGTH - 1);
+    key.name[SNAPSHOT_PATH_LENGTH - 1] = '\0';
+
+    return index_entries ? (IndexEntry *) bsearch(&key, index_entries, index_count, sizeof(IndexEntry), compare_names) : NULL;
+}
+
+// Record a snapshot in the index, both in memory and by appending a line to its file. Appending never rewrites what
+// other processes recorded, and it is left to the next process that loads the index to compact it.
+static void record_snapshot(const char *name, const uint64_t hash, const size_t size, const long long mtime) {
+    IndexEntry *entry = find_index_entry(name);
+
+    if (!entry) {
+        if (!grow_index()) {
+            return;
+        }
+
+        // Keep the entries sorted by name.
+        size_t i = 0;
+        size_t high = index_count;
+        while (i < high) {
+            size_t middle = i + (high - i) / 2;
+
+            if (strcmp(index_entries[middle].name, name) < 0) {
+                i = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+
+        memmove(index_entries + i + 1, index_entries + i, (index_count - i) * sizeof(IndexEntry));
+        ++index_count;
+
+        entry = index_entries + i;
+        strncpy(entry->name, name, SNAPSHOT_PATH_LENGTH - 1);
+        entry->name[SNAPSHOT_PATH_LENGTH - 1] = '\0';
+    }
+
+    entry->hash = hash;
+    entry->size = size;
+    entry->mtime = mtime;
+
+    char path[SNAPSHOT_PATH_LENGTH];
+    index_path(path);
+
+    FILE *index = fopen(path, "a");
+    if (index) {
+        if (ftell(index) == 0) {
+            fputs(INDEX_HEADER, index);
+        }
+
+        write_index_entry(index, entry);
+        fclose(index);
+    }
+}
+
+// Write a snapshot through a temporary file, so that an interrupted run never leaves half a snapshot behind.
+static bool write_snapshot(const char *path, const void *buf, const size_t size) {
+    make_parent_directories(path);
+
+    char temporary[TEMPORARY_PATH_LENGTH];
+    temporary_path(temporary, path);
+
+    FILE *out = fopen(temporary, "wb");
+    if (!out) {
+        return false;
+    }
+
+    bool written = fwrite(buf, 1, size, out) == size;
+    written = fclose(out) == 0 && written;
+
+    if (!written || !replace_file(temporary, path)) {
+        remove(temporary);
+        return false;
+    }
+
+    return true;
+}
+
+static SnapshotResult store_snapshot(const char *path, const char *name, const void *buf, const size_t size, const uint64_t hash) {
+    struct stat info;
+
+    if (!write_snapshot(path, buf, size) || stat(path, &info) != 0) {
+        return SNAPSHOT_FAILED;
+    }
+
+    record_snapshot(name, hash, size, modified_time(&info));
+    return SNAPSHOT_UPDATED;
+}
+
+void check_snapshot(const void *buf, const size_t size, const char *name, SnapshotCheck *out) {
+    memset(out, 0, sizeof(SnapshotCheck));
+
+    if (snprintf(out->path, SNAPSHOT_PATH_LENGTH, "%s/%s.snap", directory, name) >= SNAPSHOT_PATH_LENGTH) {
+        out->result = SNAPSHOT_FAILED;
+        return;
+    }
+
+    uint64_t hash = obj_hash(buf, size);
+
+    struct stat info;
+    if (stat(out->path, &info) != 0) {
+        out->result = update_snapshots ? store_snapshot(out->path, name, buf, size, hash) : SNAPSHOT_MISSING;
+        return;
+    }
+
+    out->expected_size = (size_t) info.st_size;
+
+    // If the file has not changed since it was indexed, its hash is enough to confirm it.
+    const IndexEntry *entry = find_index_entry(name);
+    if (entry && entry->hash == hash && entry->size == size && out->expected_size == size && entry->mtime == modified_time(&info)) {
+        out->result = SNAPSHOT_CONFIRMED;
+        return;
+    }
+
+    MappedFile file;
+    if (!map_file(out->path, out->expected_size, &file)) {
+        out->result = SNAPSHOT_FAILED;
+        return;
+    }
+
+    size_t common = size < out->expected_size ? size : out->expected_size;
+    out->mismatch = first_mismatch(file.data, buf, common);
+
+    unmap_file(&file);
+
+    if (out->mismatch == common && size == out->expected_size) {
+        record_snapshot(name, hash, size, modified_time(&info));
+        out->result = SNAPSHOT_MATCHED;
+    } else {
+        out->result = update_snapshots ? store_snapshot(out->path, name, buf, size, hash) : SNAPSHOT_MISMATCHED;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest path to a snapshot file.
+#define SNAPSHOT_PATH_LENGTH 1024
+
+// Name of the index of snapshot hashes inside the snapshot directory.
+#define SNAPSHOT_INDEX_NAME "index"
+
+// Outcome of checking a buffer against its snapshot.
+typedef enum {
+    SNAPSHOT_CONFIRMED,  // The index shows the snapshot is unchanged and has the buffer's hash, so it was not read.
+    SNAPSHOT_MATCHED,    // The snapshot was read and matches the buffer.
+    SNAPSHOT_UPDATED,    // The snapshot was missing or different, and has been rewritten with the buffer.
+    SNAPSHOT_MISSING,    // There is no snapshot to compare against.
+    SNAPSHOT_MISMATCHED, // The snapshot differs from the buffer.
+    SNAPSHOT_FAILED      // The snapshot could not be read or written.
+} SnapshotResult;
+
+/**
+ * Everything found out when checking a buffer against its snapshot.
+ */
+typedef struct {
+    SnapshotResult result;            /**< Outcome of the check. */
+    char path[SNAPSHOT_PATH_LENGTH];  /**< Path to the snapshot file. */
+    size_t expected_size;             /**< Size of the snapshot, if it exists. */
+    size_t mismatch;                  /**< Offset of the first byte that differs, if the snapshot was mismatched. */
+} SnapshotCheck;
+
+// Set the directory snapshots are kept in. It is created when the first snapshot is written.
+void set_snapshot_directory(const char *path);
+
+// Set whether missing or mismatched snapshots are rewritten instead of failing.
+void set_snapshot_update(const bool update);
+
+// Compare a buffer against the snapshot with a given name, mapping the snapshot into memory if it has to be read.
+void check_snapshot(const void *buf, const size_t size, const char *name, SnapshotCheck *out);
+
+#endif  // __SNAPSHOT_H__
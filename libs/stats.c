@@ -0,0 +1,171 @@
+#include "stats.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Two-sided 97.5% quantiles of Student's t-distribution for 1 to 30 degrees of freedom.
+static const double T_975[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+// Scale factor that makes the MAD a consistent estimator of the standard deviation for normal data.
+#define MAD_SCALE 0.6745
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Linearly interpolated percentile of sorted samples.
+static double percentile(const double *sorted, const size_t n, const double p) {
+    double rank = p * (double) (n - 1);
+    size_t lower = (size_t) rank;
+
+    if (lower + 1 >= n) {
+        return sorted[n - 1];
+    }
+
+    return sorted[lower] + (rank - (double) lower) * (sorted[lower + 1] - sorted[lower]);
+}
+
+void summarise_samples(const double *samples, const size_t n, double *scratch, SampleStats *out) {
+    memset(out, 0, sizeof(SampleStats));
+    out->n = n;
+
+    if (n == 0) {
+        return;
+    }
+
+    memcpy(scratch, samples, n * sizeof(double));
+    qsort(scratch, n, sizeof(double), compare_doubles);
+
+    out->min = scratch[0];
+    out->max = scratch[n - 1];
+    out->median = percentile(scratch, n, 0.5);
+    out->p90 = percentile(scratch, n, 0.9);
+    out->p99 = percentile(scratch, n, 0.99);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += samples[i];
+    }
+
+    out->mean = sum / (double) n;
+
+    double squares = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        squares += (samples[i] - out->mean) * (samples[i] - out->mean);
+    }
+
+    out->stddev = n > 1 ? sqrt(squares / (double) (n - 1)) : 0.0;
+
+    // The sorted copy is no longer needed, so reuse it for the absolute deviations.
+    for (size_t i = 0; i < n; ++i) {
+        scratch[i] = fabs(samples[i] - out->median);
+    }
+
+    qsort(scratch, n, sizeof(double), compare_doubles);
+    out->mad = percentile(scratch, n, 0.5);
+
+    double inliers = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        if (is_outlier(out, samples[i])) {
+            ++out->outliers;
+        } else {
+            inliers += samples[i];
+        }
+    }
+
+    out->inlier_mean = out->outliers < n ? inliers / (double) (n - out->outliers) : out->mean;
+
+    double t = n - 1 <= sizeof(T_975) / sizeof(double) ? T_975[n > 1 ? n - 2 : 0] : 1.96;
+    double margin = n > 1 ? t * out->stddev / sqrt((double) n) : 0.0;
+
+    out->ci_low = out->mean - margin;
+    out->ci_high = out->mean + margin;
+}
+
+bool is_outlier(const SampleStats *stats, const double sample) {
+    // With no spread around the median there is nothing to compare against.
+    if (stats->mad <= 0.0) {
+        return false;
+    }
+
+    return MAD_SCALE * fabs(sample - stats->median) / stats->mad > OUTLIER_THRESHOLD;
+}
+
+static const char *const COMPLEXITY_NAMES[COMPLEXITY_COUNT] = { "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)", "O(n^3)" };
+
+const char *complexity_name(const Complexity complexity) {
+    return complexity < COMPLEXITY_COUNT ? COMPLEXITY_NAMES[complexity] : "O(?)";
+}
+
+// The function of n that a complexity grows with.
+static double complexity_function(const Complexity complexity, const double n) {
+    // Sizes of 1 would make the logarithms 0, which cannot be fitted.
+    double log_n = log2(n > 2.0 ? n : 2.0);
+
+    switch (complexity) {
+        case COMPLEXITY_LOG_N:
+            return log_n;
+        case COMPLEXITY_N:
+            return n;
+        case COMPLEXITY_N_LOG_N:
+            return n * log_n;
+        case COMPLEXITY_N_SQUARED:
+            return n * n;
+        case COMPLEXITY_N_CUBED:
+            return n * n * n;
+        default:
+            return 1.0;
+    }
+}
+
+bool fit_complexity(const double *sizes, const double *times, const size_t k, ComplexityFit *out) {
+    bool distinct = false;
+    for (size_t i = 0; i < k; ++i) {
+        if (times[i] <= 0.0) {
+            return false;
+        }
+
+        distinct = distinct || sizes[i] != sizes[0];
+    }
+
+    if (!distinct) {
+        return false;
+    }
+
+    out->rms = INFINITY;
+
+    for (Complexity complexity = COMPLEXITY_1; complexity < COMPLEXITY_COUNT; ++complexity) {
+        // Minimising the errors relative to each time keeps the largest sizes from drowning out the smallest.
+        double numerator = 0.0, denominator = 0.0;
+        for (size_t i = 0; i < k; ++i) {
+            double ratio = complexity_function(complexity, sizes[i]) / times[i];
+            numerator += ratio;
+            denominator += ratio * ratio;
+        }
+
+        double coefficient = denominator > 0.0 ? numerator / denominator : 0.0;
+
+        double squares = 0.0;
+        for (size_t i = 0; i < k; ++i) {
+            double error = (times[i] - coefficient * complexity_function(complexity, sizes[i])) / times[i];
+            squares += error * error;
+        }
+
+        double rms = sqrt(squares / (double) k);
+        if (rms < out->rms) {
+            out->complexity = complexity;
+            out->coefficient = coefficient;
+            out->rms = rms;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Modified z-score (using the median absolute deviation) above which a sample is an outlier.
+#define OUTLIER_THRESHOLD 3.5
+
+/**
+ * A summary of a set of samples.
+ */
+typedef struct {
+    size_t n;           /**< Number of samples. */
+    double min;         /**< Smallest sample. */
+    double median;      /**< 50th percentile. */
+    double p90;         /**< 90th percentile. */
+    double p99;         /**< 99th percentile. */
+    double max;         /**< Largest sample. */
+    double mean;        /**< Arithmetic mean. */
+    double stddev;      /**< Sample standard deviation. */
+    double mad;         /**< Median absolute deviation from the median. */
+    size_t outliers;    /**< Number of samples flagged as outliers. */
+    double inlier_mean; /**< Mean of the samples that are not outliers. */
+    double ci_low;      /**< Lower bound of the 95% confidence interval for the mean. */
+    double ci_high;     /**< Upper bound of the 95% confidence interval for the mean. */
+} SampleStats;
+
+// Summarise n samples. The samples are left untouched; scratch must have room for n doubles.
+void summarise_samples(const double *samples, const size_t n, double *scratch, SampleStats *out);
+
+// Is a sample an outlier with respect to a summary?
+bool is_outlier(const SampleStats *stats, const double sample);
+
+// Complexities that the times of a range benchmark can be fitted to.
+typedef enum {
+    COMPLEXITY_1,
+    COMPLEXITY_LOG_N,
+    COMPLEXITY_N,
+    COMPLEXITY_N_LOG_N,
+    COMPLEXITY_N_SQUARED,
+    COMPLEXITY_N_CUBED,
+    COMPLEXITY_COUNT
+} Complexity;
+
+/**
+ * The complexity that explains a set of times best.
+ */
+typedef struct {
+    Complexity complexity; /**< The complexity that fitted best. */
+    double coefficient;    /**< The time is estimated as this times the complexity's function of n. */
+    double rms;            /**< Root mean square of the errors of the estimate, relative to each time. */
+} ComplexityFit;
+
+// Fit times measured at k sizes to each complexity by least squares on their relative errors, and pick the one with
+// the smallest. Needs at least two different sizes and positive times; returns false without fitting otherwise.
+bool fit_complexity(const double *sizes, const double *times, const size_t k, ComplexityFit *out);
+
+// Big O notation for a complexity.
+const char *complexity_name(const Complexity complexity);
+
+#endif  // __STATS_H__
@@ -0,0 +1,694 @@
+#include "testcache.h"
+#include "hashing.h"
+#include "whatos.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OS_WINDOWS
+#include <windows.h>
+#endif
+
+// Written at the start of every cache file, and changed whenever the format or the fingerprints change.
+static const char MAGIC[8] = { 'C', 'A', 'T', 'O', 'M', 'T', 'C', '3' };
+
+static int compare_entries(const void *a, const void *b) {
+    uint64_t x = ((const CacheEntry *) a)->name;
+    uint64_t y = ((const CacheEntry *) b)->name;
+
+    return x < y ? -1 : x > y;
+}
+
+size_t load_test_cache(const char *path, CacheEntry **out) {
+    *out = NULL;
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char magic[sizeof(MAGIC)];
+    uint64_t n = 0;
+    CacheEntry *entries = NULL;
+
+    // The whole cache is read in one go, and is already sorted for searching.
+    if (fread(magic, 1, sizeof(MAGIC), file) == sizeof(MAGIC) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && fread(&n, sizeof(uint64_t), 1, file) == 1 && n > 0 && n < SIZE_MAX / sizeof(CacheEntry)) {
+        entries = (CacheEntry *) malloc((size_t) n * sizeof(CacheEntry));
+
+        if (entries && fread(entries, sizeof(CacheEntry), (size_t) n, file) != n) {
+            free(entries);
+            entries = NULL;
+        }
+    }
+
+    fclose(file);
+
+    *out = entries;
+    return entries ? (size_t) n : 0;
+}
+
+bool save_test_cache(const char *path, CacheEntry *entries, const size_t n) {
+    qsort(entries, n, sizeof(CacheEntry), compare_entries);
+
+    // Written through a temporary file, so that an interrupted run never leaves half a cache behind.
+    size_t length = strlen(path) + 5;
+    char *temporary = (char *) malloc(length);
+    if (!temporary) {
+        return false;
+    }
+
+    snprintf(temporary, length, "%s.tmp", path);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) {
+        free(temporary);
+        return false;
+    }
+
+    uint64_t count = n;
+    bool written = fwrite(MAGIC, 1, sizeof(MAGIC), file) == sizeof(MAGIC) && fwrite(&count, sizeof(uint64_t), 1, file) == 1 && fwrite(entries, sizeof(CacheEntry), n, file) == n;
+    written = fclose(file) == 0 && written;
+
+#ifdef OS_WINDOWS
+    written = written && MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    written = written && rename(temporary, path) == 0;
+#endif
+
+    if (!written) {
+        remove(temporary);
+    }
+
+    free(temporary);
+    return written;
+}
+
+CacheEntry *find_cache_entry(CacheEntry *entries, const size_t n, const uint64_t name) {
+    CacheEntry key = { name, 0, 0.0, 0 };
+    return n > 0 ? (CacheEntry *) bsearch(&key, entries, n, sizeof(CacheEntry), compare_entries) : NULL;
+}
+
+#if defined(__linux__) && defined(__ELF__)
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if UINTPTR_MAX > 0xffffffffu
+typedef Elf64_Ehdr ElfHeader;
+typedef Elf64_Shdr ElfSection;
+typedef Elf64_Sym ElfSymbol;
+#define SYMBOL_TYPE ELF64_ST_TYPE
+#else
+typedef Elf32_Ehdr ElfHeader;
+typedef Elf32_Shdr ElfSection;
+typedef Elf32_Sym ElfSymbol;
+#define SYMBOL_TYPE ELF32_ST_TYPE
+#endif
+
+// Most sections of the program that are kept track of.
+#define MAX_RANGES 64
+
+// Size of the entries of the PLT, which calls into shared libraries go through.
+#define STUB_SIZE 16
+
+// Bytes hashed of read-only data that has no symbol and is not a string, which covers the widest constants that the
+// compiler loads from memory in one go.
+#define ANONYMOUS_SIZE 16
+
+/**
+ * A function in the program's symbol table.
+ */
+typedef struct {
+    uintptr_t start; /**< Address of the function in memory. */
+    size_t size;     /**< Size of its code. */
+    size_t visited;  /**< Last fingerprint that included the function. */
+} FunctionSymbol;
+
+/**
+ * An object in data in the program's symbol table, like a const array or a global variable.
+ */
+typedef struct {
+    uintptr_t start; /**< Address of the object in memory. */
+    size_t size;     /**< Size of the object. */
+    uint64_t name;   /**< Hash of its name, which stands in for it where code refers to writable data. */
+    uint64_t initial; /**< Hash of the value it starts with if it is writable, or 0 if it starts zeroed. */
+} DataSymbol;
+
+/**
+ * A section of the program that is loaded into memory.
+ */
+typedef struct {
+    uintptr_t start; /**< Address of the section in memory. */
+    uintptr_t end;   /**< Address just past its end. */
+    uint64_t name;   /**< Hash of its name. */
+    bool code;       /**< Does it hold code? */
+    bool constant;   /**< Is it read-only data, like string literals, whose contents are hashed where code refers to it? */
+    bool stubs;      /**< Is it a PLT, whose entries call functions in shared libraries? */
+    bool table;      /**< Is it a GOT, whose entries hold the addresses that code refers to through them? */
+} LoadedRange;
+
+static FunctionSymbol *functions = NULL;
+static size_t function_count = 0;
+static DataSymbol *objects = NULL;
+static size_t object_count = 0;
+static LoadedRange ranges[MAX_RANGES];
+static size_t range_count = 0;
+static bool loaded = false;
+static size_t generation = 0;
+
+static int compare_functions(const void *a, const void *b) {
+    uintptr_t x = ((const FunctionSymbol *) a)->start;
+    uintptr_t y = ((const FunctionSymbol *) b)->start;
+
+    return x < y ? -1 : x > y;
+}
+
+static int compare_objects(const void *a, const void *b) {
+    uintptr_t x = ((const DataSymbol *) a)->start;
+    uintptr_t y = ((const DataSymbol *) b)->start;
+
+    return x < y ? -1 : x > y;
+}
+
+static const LoadedRange *find_range(const uintptr_t address);
+
+// Hash the value that an object in writable data starts with, out of the section in the executable that holds it.
+// Words that point into the program are left out, since they are relocated when it is loaded and move whenever
+// anything linked before what they point to changes size.
+static uint64_t hash_initial(const unsigned char *image, const size_t size, const ElfSection *section, const ElfSymbol *symbol, const uintptr_t bias) {
+    if (section->sh_type != SHT_PROGBITS || symbol->st_value < section->sh_addr || symbol->st_value - section->sh_addr + symbol->st_size > section->sh_size || section->sh_offset + section->sh_size > size) {
+        return 0;
+    }
+
+    const unsigned char *data = image + section->sh_offset + (symbol->st_value - section->sh_addr);
+    size_t length = (size_t) symbol->st_size;
+    size_t flushed = 0;
+    HashState state;
+    hash_init(&state);
+
+    for (size_t j = 0; j + sizeof(uintptr_t) <= length; j += sizeof(uintptr_t)) {
+        uintptr_t word;
+        memcpy(&word, data + j, sizeof(uintptr_t));
+
+        if (word != 0 && (find_range(word) || find_range(word + bias))) {
+            hash_update(&state, data + flushed, j - flushed);
+            flushed = j + sizeof(uintptr_t);
+        }
+    }
+
+    hash_update(&state, data + flushed, length - flushed);
+    return hash_digest(&state);
+}
+
+// Read the functions and sections of the program out of its own executable.
+static void load_functions(const unsigned char *image, const size_t size) {
+    const ElfHeader *header = (const ElfHeader *) image;
+
+    if (size < sizeof(ElfHeader) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_shentsize != sizeof(ElfSection) || header->e_shoff == 0 || header->e_shoff + (size_t) header->e_shnum * sizeof(ElfSection) > size) {
+        return;
+    }
+
+    const ElfSection *sections = (const ElfSection *) (image + header->e_shoff);
+    const ElfSection *symtab = NULL;
+
+    for (size_t i = 0; i < header->e_shnum; ++i) {
+        if (sections[i].sh_type == SHT_SYMTAB) {
+            symtab = sections + i;
+        }
+    }
+
+    if (!symtab || symtab->sh_link >= header->e_shnum || symtab->sh_offset + symtab->sh_size > size) {
+        return;
+    }
+
+    const ElfSection *strtab = sections + symtab->sh_link;
+    if (strtab->sh_offset + strtab->sh_size > size) {
+        return;
+    }
+
+    const ElfSymbol *symbols = (const ElfSymbol *) (image + symtab->sh_offset);
+    const char *names = (const char *) (image + strtab->sh_offset);
+    size_t symbol_count = symtab->sh_size / sizeof(ElfSymbol);
+
+    // Executables may be loaded anywhere, so find where by looking up this file's own function.
+    bool found_self = false;
+    uintptr_t bias = 0;
+
+    for (size_t i = 0; i < symbol_count && !found_self; ++i) {
+        if (SYMBOL_TYPE(symbols[i].st_info) == STT_FUNC && symbols[i].st_name < strtab->sh_size && strcmp(names + symbols[i].st_name, "function_fingerprint") == 0) {
+            bias = (uintptr_t) function_fingerprint - (uintptr_t) symbols[i].st_value;
+            found_self = true;
+        }
+    }
+
+    functions = found_self ? (FunctionSymbol *) calloc(symbol_count + 1, sizeof(FunctionSymbol)) : NULL;
+    if (!functions) {
+        return;
+    }
+
+    for (size_t i = 0; i < symbol_count; ++i) {
+        if (SYMBOL_TYPE(symbols[i].st_info) == STT_FUNC && symbols[i].st_size > 0 && symbols[i].st_shndx != SHN_UNDEF) {
+            functions[function_count].start = (uintptr_t) symbols[i].st_value + bias;
+            functions[function_count++].size = (size_t) symbols[i].st_size;
+        }
+    }
+
+    qsort(functions, function_count, sizeof(FunctionSymbol), compare_functions);
+
+    // Functions with several names are only kept once.
+    size_t unique = 0;
+    for (size_t i = 0; i < function_count; ++i) {
+        if (unique == 0 || functions[i].start != functions[unique - 1].start) {
+            functions[unique++] = functions[i];
+        }
+    }
+
+    function_count = unique;
+
+    const ElfSection *shstrtab = header->e_shstrndx < header->e_shnum ? sections + header->e_shstrndx : NULL;
+    const char *section_names = shstrtab && shstrtab->sh_offset + shstrtab->sh_size <= size ? (const char *) (image + shstrtab->sh_offset) : NULL;
+
+    for (size_t i = 0; i < header->e_shnum && range_count < MAX_RANGES; ++i) {
+        if ((sections[i].sh_flags & SHF_ALLOC) && sections[i].sh_addr != 0 && sections[i].sh_size > 0) {
+            const char *name = section_names && sections[i].sh_name < shstrtab->sh_size ? section_names + sections[i].sh_name : "";
+            ranges[range_count].name = obj_hash(name, strlen(name));
+            ranges[range_count].stubs = strncmp(name, ".plt", 4) == 0;
+            ranges[range_count].table = strncmp(name, ".got", 4) == 0;
+            ranges[range_count].start = (uintptr_t) sections[i].sh_addr + bias;
+            ranges[range_count].end = ranges[range_count].start + (uintptr_t) sections[i].sh_size;
+            ranges[range_count].code = (sections[i].sh_flags & SHF_EXECINSTR) != 0;
+            ranges[range_count++].constant = !(sections[i].sh_flags & SHF_WRITE) && sections[i].sh_type == SHT_PROGBITS && strncmp(name, ".rodata", 7) == 0;
+        }
+    }
+
+    // Objects in read-only data are hashed whole wherever code refers to them, so their sizes are kept too. Objects in
+    // writable data are hashed by name and by the value they start with instead, since their contents change as the
+    // program runs.
+    objects = (DataSymbol *) calloc(symbol_count + 1, sizeof(DataSymbol));
+    if (!objects) {
+        return;
+    }
+
+    for (size_t i = 0; i < symbol_count; ++i) {
+        uintptr_t start = (uintptr_t) symbols[i].st_value + bias;
+        const LoadedRange *range = find_range(start);
+
+        if (SYMBOL_TYPE(symbols[i].st_info) == STT_OBJECT && symbols[i].st_size > 0 && symbols[i].st_shndx != SHN_UNDEF && symbols[i].st_name < strtab->sh_size && range && !range->code && start + (uintptr_t) symbols[i].st_size <= range->end) {
+            const char *name = names + symbols[i].st_name;
+
+            objects[object_count].start = start;
+            objects[object_count].size = (size_t) symbols[i].st_size;
+
+            if (!range->constant && symbols[i].st_shndx < header->e_shnum && (sections[symbols[i].st_shndx].sh_flags & SHF_WRITE)) {
+                objects[object_count].initial = hash_initial(image, size, sections + symbols[i].st_shndx, symbols + i, bias);
+            }
+
+            objects[object_count++].name = obj_hash(name, strlen(name));
+        }
+    }
+
+    qsort(objects, object_count, sizeof(DataSymbol), compare_objects);
+}
+
+static bool ensure_loaded(void) {
+    if (loaded) {
+        return functions != NULL;
+    }
+
+    loaded = true;
+
+    int fd = open("/proc/self/exe", O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    void *image = fstat(fd, &info) == 0 && info.st_size > 0 ? mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (image == MAP_FAILED) {
+        return false;
+    }
+
+    load_functions((const unsigned char *) image, (size_t) info.st_size);
+    munmap(image, (size_t) info.st_size);
+
+    return functions != NULL;
+}
+
+static FunctionSymbol *find_function(const uintptr_t address) {
+    FunctionSymbol key = { address, 0, 0 };
+    return (FunctionSymbol *) bsearch(&key, functions, function_count, sizeof(FunctionSymbol), compare_functions);
+}
+
+static const LoadedRange *find_range(const uintptr_t address) {
+    for (size_t i = 0; i < range_count; ++i) {
+        if (address >= ranges[i].start && address < ranges[i].end) {
+            return ranges + i;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Functions waiting to be fingerprinted.
+ */
+typedef struct {
+    FunctionSymbol **items; /**< The functions, which are each pushed at most once. */
+    size_t n;               /**< Number of functions waiting. */
+} Worklist;
+
+static void visit(Worklist *worklist, FunctionSymbol *function) {
+    if (function->visited != generation) {
+        function->visited = generation;
+        worklist->items[worklist->n++] = function;
+    }
+}
+
+// Is the address the start of an entry of a PLT?
+static bool is_stub(const LoadedRange *range, const uintptr_t target) {
+    return range && range->stubs && (target - range->start) % STUB_SIZE == 0;
+}
+
+// Does the address a reference resolves to look like somewhere in the program? If it is code, that has to be the start
+// of a function or of a PLT entry, since anything else is more likely to be a small constant that happens to point into
+// the code.
+static bool is_reference(const uintptr_t target, FunctionSymbol **callee, const LoadedRange **range) {
+    *callee = find_function(target);
+    *range = *callee ? NULL : find_range(target);
+
+    return *callee || (*range && (!(*range)->code || is_stub(*range, target)));
+}
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+// Does a string literal that ends before the limit start at the address? Its bytes must all be text, which the entries
+// of jump tables are not, and it must have a terminator. Returns its size along with the terminator, or 0 if not.
+static size_t string_size(const uintptr_t target, const uintptr_t limit) {
+    const unsigned char *c = (const unsigned char *) target;
+    size_t length = 0;
+
+    for (; target + length < limit && c[length] != '\0'; ++length) {
+        bool text = (c[length] >= 0x20 && c[length] != 0x7F) || (c[length] >= '\a' && c[length] <= '\r') || c[length] == 0x1B;
+
+        // Bytes from 0xF5 on never appear in UTF-8.
+        if (!text || c[length] >= 0xF5) {
+            return 0;
+        }
+    }
+
+    return target + length < limit ? length + 1 : 0;
+}
+
+// Count the objects that start at or before an address. The last of them is the only one that can hold it.
+static size_t objects_up_to(const uintptr_t target) {
+    size_t low = 0;
+    size_t high = object_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (objects[middle].start <= target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+// Find the read-only data that an address a function refers to is part of: the whole object in the symbol table that
+// holds it, or else the string literal there, or else a few bytes of it, up to the next object. Hashing any more of
+// what has no symbol would take in the data of unrelated code, like its jump tables. Writes where it starts, and
+// returns its size. Sets whether it is a string, which has no words relative to code to leave out.
+static size_t find_constant(const LoadedRange *range, const uintptr_t target, uintptr_t *start, bool *string) {
+    // The last object that starts at or before the address, and the first one after it.
+    size_t low = objects_up_to(target);
+
+    *start = target;
+    *string = false;
+
+    if (low > 0 && target < objects[low - 1].start + objects[low - 1].size) {
+        *start = objects[low - 1].start;
+        return objects[low - 1].size;
+    }
+
+    uintptr_t limit = low < object_count && objects[low].start < range->end ? objects[low].start : range->end;
+    size_t size = string_size(target, limit);
+
+    if (size > 0) {
+        *string = true;
+        return size;
+    }
+
+    return limit - target < ANONYMOUS_SIZE ? (size_t) (limit - target) : ANONYMOUS_SIZE;
+}
+
+// Does a word of read-only data lead into code, relative to where it is or to the start of the data? Such words are
+// the entries of jump tables and the like, which change whenever the code moves.
+static bool is_code_relative(const uintptr_t start, const uintptr_t word, const int32_t offset) {
+    const LoadedRange *from_start = find_range(start + (uintptr_t) (intptr_t) offset);
+    const LoadedRange *from_word = find_range(word + (uintptr_t) (intptr_t) offset);
+
+    return (from_start && from_start->code) || (from_word && from_word->code);
+}
+
+// Hash read-only data that a function refers to, leaving out the words in it that are relative to code.
+static void hash_constant(HashState *state, const uintptr_t start, const size_t size) {
+    const unsigned char *data = (const unsigned char *) start;
+    size_t flushed = 0;
+
+    for (size_t j = 0; j + 4 <= size; j += 4) {
+        int32_t offset;
+        memcpy(&offset, data + j, sizeof(int32_t));
+
+        if (is_code_relative(start, start + j, offset)) {
+            hash_update(state, data + flushed, j - flushed);
+            flushed = j + 4;
+        }
+    }
+
+    hash_update(state, data + flushed, size - flushed);
+}
+
+// Hash writable data that a function refers to by what it is rather than what it holds, which changes as the program
+// runs: the name of the object that holds it, or else of the last object before it in its section, how far past the
+// start of that object the address is, and the value that object starts with.
+static void hash_variable(HashState *state, const LoadedRange *range, const uintptr_t target) {
+    size_t low = objects_up_to(target);
+    uint64_t identity[4] = { range->name, 0, (uint64_t) (target - range->start), 0 };
+
+    if (low > 0 && objects[low - 1].start >= range->start) {
+        identity[1] = objects[low - 1].name;
+        identity[2] = (uint64_t) (target - objects[low - 1].start);
+        identity[3] = objects[low - 1].initial;
+    }
+
+    hash_update(state, identity, sizeof(identity));
+}
+
+// Hash what a function refers to at an address, in place of the address itself. Functions are added to the worklist,
+// read-only data is hashed by its contents and writable data by its name and the value it starts with. An entry of the GOT stands for the address
+// it holds, which is resolved in turn. Calls into the PLT add nothing.
+static void hash_reference(HashState *state, Worklist *worklist, const uintptr_t target, FunctionSymbol *callee, const LoadedRange *range) {
+    if (callee) {
+        visit(worklist, callee);
+    } else if (range->constant) {
+        uintptr_t start;
+        bool string;
+        size_t size = find_constant(range, target, &start, &string);
+
+        if (string) {
+            hash_update(state, (const void *) start, size);
+        } else {
+            hash_constant(state, start, size);
+        }
+    } else if (range->table) {
+        uintptr_t held;
+        memcpy(&held, (const void *) target, sizeof(uintptr_t));
+
+        FunctionSymbol *held_callee;
+        const LoadedRange *held_range;
+
+        // Entries pointing into shared libraries are left out, like calls into the PLT.
+        if (is_reference(held, &held_callee, &held_range) && (held_callee || !held_range->table)) {
+            hash_reference(state, worklist, held, held_callee, held_range);
+        }
+    } else if (!range->code) {
+        hash_variable(state, range, target);
+    }
+}
+#endif
+
+// Hash the code of a function without the addresses it refers to, which change whenever anything linked before them
+// changes size. Functions it refers to are added to the worklist, and what else it refers to is hashed instead.
+static uint64_t hash_function(FunctionSymbol *function, Worklist *worklist) {
+    const unsigned char *code = (const unsigned char *) function->start;
+    HashState state;
+    hash_init(&state);
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Instructions are not decoded, so every 4 bytes that follow the opcode of a call or jump (E8, E9 or 0F 8x) or a
+    // RIP-relative ModRM byte (00xxx101) are tried as a displacement from the end of an instruction, which is where
+    // they are kept. Any other bytes could point somewhere by chance, and where is different in every build.
+    size_t flushed = 0;
+
+    for (size_t i = 1; i + 4 <= function->size; ++i) {
+        unsigned char before = code[i - 1];
+        bool branch = before == 0xE8 || before == 0xE9 || (i >= 2 && code[i - 2] == 0x0F && (before & 0xF0) == 0x80);
+
+        if (!branch && (before & 0xC7) != 0x05) {
+            continue;
+        }
+
+        int32_t displacement;
+        memcpy(&displacement, code + i, sizeof(int32_t));
+
+        uintptr_t target = function->start + i + 4 + (uintptr_t) (intptr_t) displacement;
+        FunctionSymbol *callee;
+        const LoadedRange *range;
+
+        if (!is_reference(target, &callee, &range)) {
+            continue;
+        }
+
+        hash_update(&state, code + flushed, i - flushed);
+        hash_reference(&state, worklist, target, callee, range);
+
+        i += 3;
+        flushed = i + 1;
+    }
+
+    hash_update(&state, code + flushed, function->size - flushed);
+#elif defined(__aarch64__)
+    // The page each register was last set to by an ADRP. The :lo12: offset of an ADD, load or store based on it
+    // completes the address the code refers to. Instructions are read in order rather than along their branches, so a
+    // register is forgotten as soon as anything may have written to it.
+    uintptr_t pages[32];
+    bool paged[32] = { false };
+
+    for (size_t i = 0; i + 4 <= function->size; i += 4) {
+        uint32_t instruction;
+        memcpy(&instruction, code + i, sizeof(uint32_t));
+
+        uintptr_t target = 0;
+        bool resolved = false;
+
+        if ((instruction & 0x7C000000u) == 0x14000000u) {
+            // B and BL, whose targets are 26-bit word offsets.
+            int32_t offset = (int32_t) (instruction << 6) >> 6;
+            target = function->start + i + (uintptr_t) ((intptr_t) offset * 4);
+            FunctionSymbol *callee = find_function(target);
+
+            if (callee) {
+                visit(worklist, callee);
+            }
+
+            if (callee || is_stub(find_range(target), target)) {
+                instruction &= 0xFC000000u;
+            }
+
+            // A call may change every register the callee does not have to preserve.
+            if (instruction & 0x80000000u) {
+                memset(paged, 0, 19 * sizeof(bool));
+                paged[30] = false;
+            }
+        } else if ((instruction & 0x9F000000u) == 0x90000000u) {
+            // ADRP, whose page offset changes with the layout of the program. The 21-bit offset is split in two.
+            uint32_t split = ((instruction >> 3) & 0x1FFFFCu) | ((instruction >> 29) & 0x3u);
+            int64_t offset = (int64_t) (split ^ 0x100000u) - 0x100000;
+
+            pages[instruction & 0x1F] = ((function->start + i) & ~(uintptr_t) 0xFFF) + (uintptr_t) (offset * 4096);
+            paged[instruction & 0x1F] = true;
+            instruction &= 0x9F00001Fu;
+        } else if ((instruction & 0xFFC00000u) == 0x91000000u) {
+            // A 64-bit ADD of an unshifted 12-bit immediate, which gives the full address of a page and offset.
+            uint32_t base = (instruction >> 5) & 0x1F;
+
+            if (paged[base]) {
+                target = pages[base] + ((instruction >> 10) & 0xFFF);
+                resolved = true;
+            }
+
+            paged[instruction & 0x1F] = false;
+        } else if ((instruction & 0x3B000000u) == 0x39000000u) {
+            // A load or store of a register at an unsigned 12-bit offset, scaled by the size it moves.
+            uint32_t base = (instruction >> 5) & 0x1F;
+            uint32_t scale = instruction >> 30;
+            bool vector = (instruction & 0x04000000u) != 0;
+
+            if (vector && scale == 0 && (instruction & 0x00800000u)) {
+                scale = 4;
+            }
+
+            if (paged[base]) {
+                target = pages[base] + ((uintptr_t) ((instruction >> 10) & 0xFFF) << scale);
+                resolved = true;
+            }
+
+            if (!vector && (instruction & 0x00400000u)) {
+                paged[instruction & 0x1F] = false;
+            }
+        } else {
+            // Most other instructions write to the register in their lowest bits, if they write to any.
+            paged[instruction & 0x1F] = false;
+        }
+
+        FunctionSymbol *callee;
+        const LoadedRange *range;
+
+        if (resolved && is_reference(target, &callee, &range)) {
+            instruction &= ~(0xFFFu << 10);
+            hash_update(&state, &instruction, sizeof(uint32_t));
+            hash_reference(&state, worklist, target, callee, range);
+        } else {
+            hash_update(&state, &instruction, sizeof(uint32_t));
+        }
+    }
+#else
+    (void) worklist;
+    hash_update(&state, code, function->size);
+#endif
+
+    return hash_digest(&state);
+}
+
+uint64_t function_fingerprint(void (*function)(void)) {
+    if (!ensure_loaded()) {
+        return 0;
+    }
+
+    FunctionSymbol *root = find_function((uintptr_t) function);
+    if (!root) {
+        return 0;
+    }
+
+    Worklist worklist = { (FunctionSymbol **) malloc(function_count * sizeof(FunctionSymbol *)), 0 };
+    if (!worklist.items) {
+        return 0;
+    }
+
+    ++generation;
+    visit(&worklist, root);
+
+    // Every function reached is added in, so the order they are reached in does not matter.
+    uint64_t fingerprint = 0;
+
+    while (worklist.n > 0) {
+        FunctionSymbol *next = worklist.items[--worklist.n];
+        fingerprint += hash_function(next, &worklist) * 0x9E3779B97F4A7C15ull;
+    }
+
+    free(worklist.items);
+    return fingerprint != 0 ? fingerprint : 1;
+}
+#else
+uint64_t function_fingerprint(void (*function)(void)) {
+    (void) function;
+    return 0;
+}
+#endif
@@ -0,0 +1,36 @@
+#ifndef __TESTCACHE_H__
+#define __TESTCACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * How a test went the last time it ran, and the fingerprint of everything it ran if it passed.
+ */
+typedef struct {
+    uint64_t name;        /**< Hash of the name of the test. */
+    uint64_t fingerprint; /**< Fingerprint of the test when it passed, or 0 if it failed or could not be fingerprinted. */
+    double seconds;       /**< How long the test took. */
+    uint64_t failed;      /**< Did the test fail? A whole word, so that entries have no padding to write out. */
+} CacheEntry;
+
+// Fingerprint the machine code of a function along with every function it calls directly or through others, found
+// through the program's ELF symbol table. Returns 0 if the function could not be found there, e.g. on other platforms
+// or in stripped programs. Calls are followed on x86 and AArch64, where read-only data the code refers to is hashed by
+// its contents and writable data by the name and initial value of the global that holds it; elsewhere only the
+// function itself is fingerprinted. Calls into shared libraries through the PLT are not followed, so changes to those
+// libraries do not change the fingerprint.
+uint64_t function_fingerprint(void (*function)(void));
+
+// Load the entries of a test cache, sorted by name. Returns the number of entries loaded into *out, which must be
+// freed, or 0 if the cache is missing or was not written by this version.
+size_t load_test_cache(const char *path, CacheEntry **out);
+
+// Write the entries of a test cache, sorting them by name first. Returns false if it could not be written.
+bool save_test_cache(const char *path, CacheEntry *entries, const size_t n);
+
+// Find the entry of a test by the hash of its name in a loaded cache.
+CacheEntry *find_cache_entry(CacheEntry *entries, const size_t n, const uint64_t name);
+
+#endif  // __TESTCACHE_H__
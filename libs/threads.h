@@ -0,0 +1,72 @@
+/**
+ * A header utility for state shared between threads: thread-local storage, atomics, and a plain lock and condition.
+ */
+
+#ifndef __THREADS_H__
+#define __THREADS_H__
+
+#include "whatos.h"
+
+#ifdef OS_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Storage that each thread has its own copy of.
+#define THREAD_LOCAL __thread
+
+// Atomic operations, ordered so that a value stored by one thread is seen along with everything written before it.
+#define ATOMIC_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define ATOMIC_ADD(ptr, value) __atomic_add_fetch(ptr, value, __ATOMIC_ACQ_REL)
+// Store desired if the value is still expected, or load the value into expected if not. Returns whether it stored.
+#define ATOMIC_COMPARE_EXCHANGE(ptr, expected, desired) __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+// A lock that is not recursive, and that can be initialised statically with LOCK_INIT, along with a condition that
+// threads holding it can wait on, initialised with CONDITION_INIT.
+#ifdef OS_WINDOWS
+typedef SRWLOCK Lock;
+typedef CONDITION_VARIABLE Condition;
+#define LOCK_INIT SRWLOCK_INIT
+#define CONDITION_INIT CONDITION_VARIABLE_INIT
+
+static inline void lock_acquire(Lock *lock) {
+    AcquireSRWLockExclusive(lock);
+}
+
+static inline void lock_release(Lock *lock) {
+    ReleaseSRWLockExclusive(lock);
+}
+
+static inline void condition_wait(Condition *condition, Lock *lock) {
+    SleepConditionVariableSRW(condition, lock, INFINITE, 0);
+}
+
+static inline void condition_broadcast(Condition *condition) {
+    WakeAllConditionVariable(condition);
+}
+#else
+typedef pthread_mutex_t Lock;
+typedef pthread_cond_t Condition;
+#define LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#define CONDITION_INIT PTHREAD_COND_INITIALIZER
+
+static inline void lock_acquire(Lock *lock) {
+    pthread_mutex_lock(lock);
+}
+
+static inline void lock_release(Lock *lock) {
+    pthread_mutex_unlock(lock);
+}
+
+static inline void condition_wait(Condition *condition, Lock *lock) {
+    pthread_cond_wait(condition, lock);
+}
+
+static inline void condition_broadcast(Condition *condition) {
+    pthread_cond_broadcast(condition);
+}
+#endif
+
+#endif  // __THREADS_H__
@@ -0,0 +1,141 @@
+#include "timer.h"
+#include "whatos.h"
+
+#include <time.h>
+
+// How long the cycle counter is calibrated against the wall clock, in nanoseconds.
+#define CALIBRATION_NS 10000000ull
+
+// Only x86 has a cycle counter that user space can always read. AArch64's cntvct_el0 is the generic timer, which ticks
+// at a fixed frequency rather than once per cycle, so TIMER_CYCLES falls back to wall-clock time there.
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_CYCLE_COUNTER
+
+static inline uint64_t read_cycles(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+#endif
+
+#ifdef OS_WINDOWS
+#include <windows.h>
+
+static uint64_t wall_ticks(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (uint64_t) now.QuadPart;
+}
+
+static uint64_t wall_ticks_to_ns(const uint64_t ticks) {
+    static uint64_t frequency = 0;
+
+    if (frequency == 0) {
+        LARGE_INTEGER result;
+        QueryPerformanceFrequency(&result);
+        frequency = (uint64_t) result.QuadPart;
+    }
+
+    // Split up the conversion so that it does not overflow for long runs.
+    return (ticks / frequency) * 1000000000ull + ((ticks % frequency) * 1000000000ull) / frequency;
+}
+
+static uint64_t thread_cpu_ns(void) {
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+
+    uint64_t k = ((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime;
+
+    // FILETIMEs count in units of 100 nanoseconds.
+    return (k + u) * 100u;
+}
+#else
+static uint64_t timespec_ns(const clockid_t clock) {
+    struct timespec now;
+
+    if (clock_gettime(clock, &now) != 0) {
+        return 0;
+    }
+
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+static uint64_t wall_ticks(void) {
+    return timespec_ns(CLOCK_MONOTONIC);
+}
+
+static uint64_t wall_ticks_to_ns(const uint64_t ticks) {
+    return ticks;
+}
+
+static uint64_t thread_cpu_ns(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    return timespec_ns(CLOCK_THREAD_CPUTIME_ID);
+#else
+    return timespec_ns(CLOCK_PROCESS_CPUTIME_ID);
+#endif
+}
+#endif
+
+#ifdef HAS_CYCLE_COUNTER
+// Cycles per nanosecond, measured the first time it is needed.
+static double cycles_per_ns = 0.0;
+
+static void calibrate_cycles(void) {
+    uint64_t wall_start = wall_ticks_to_ns(wall_ticks());
+    uint64_t cycles_start = read_cycles();
+    uint64_t wall_end;
+
+    do {
+        wall_end = wall_ticks_to_ns(wall_ticks());
+    } while (wall_end - wall_start < CALIBRATION_NS);
+
+    cycles_per_ns = (double) (read_cycles() - cycles_start) / (double) (wall_end - wall_start);
+}
+#endif
+
+uint64_t timer_now(const TimerSource source) {
+    switch (source) {
+        case TIMER_THREAD_CPU:
+            return thread_cpu_ns();
+#ifdef HAS_CYCLE_COUNTER
+        case TIMER_CYCLES:
+            return read_cycles();
+#endif
+        default:
+            return wall_ticks();
+    }
+}
+
+uint64_t timer_ticks_to_ns(const TimerSource source, const uint64_t ticks) {
+    switch (source) {
+        case TIMER_THREAD_CPU:
+            return ticks;
+#ifdef HAS_CYCLE_COUNTER
+        case TIMER_CYCLES:
+            if (cycles_per_ns <= 0.0) {
+                calibrate_cycles();
+            }
+
+            return (uint64_t) ((double) ticks / cycles_per_ns);
+#endif
+        default:
+            return wall_ticks_to_ns(ticks);
+    }
+}
+
+double timer_seconds_since(const uint64_t start) {
+    return (double) timer_ticks_to_ns(TIMER_WALL, timer_now(TIMER_WALL) - start) / 1e9;
+}
+
+bool timer_has_cycles(void) {
+#ifdef HAS_CYCLE_COUNTER
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "../catom.h"
+
+#include <stdint.h>
+
+// Read the current value of a timer, in that timer's own ticks.
+uint64_t timer_now(const TimerSource source);
+
+// Convert a number of ticks of a timer into nanoseconds.
+uint64_t timer_ticks_to_ns(const TimerSource source, const uint64_t ticks);
+
+// Seconds elapsed on the wall-clock timer since a previous reading of it.
+double timer_seconds_since(const uint64_t start);
+
+// Is the timer backed by a real cycle counter on this machine?
+bool timer_has_cycles(void);
+
+#endif  // __TIMER_H__
@@ -1,4 +1,5 @@
 #include "tprinterr.h"
+#include "output.h"
 #include "whatos.h"
 
 #include <stdio.h>
@@ -70,34 +71,46 @@ void tprinterr(const char* str, const bool passing) {
     if (istty) {
         if (__stderr_mode__ & ENABLE_VIRTUAL_TERMINAL_PROCESSING) {
             // Use ASCII escapes; console has VT-compat.
-            fwprintf(stderr, passing ? PASSING : FAILING, str);
+            output_printf(passing ? PASSING : FAILING, str);
         } else {
             // Get current console colour or default.
             WORD colour = DEFAULT_ATTR;
             if (!get_console_colour(__stderr_handle__, &colour)) {
-                fwprintf(stderr, L"*** [WARNING] STDERR attribute fetching failed! ***\n");
+                output_printf("*** [WARNING] STDERR attribute fetching failed! ***\n");
             }
 
-            // Legacy handling, using text attributes.
+            // Legacy handling, using text attributes. These apply to what is written while they are set, so the
+            // buffer has to be written out around them.
+            output_flush();
             SetConsoleTextAttribute(__stderr_handle__, passing ? PASSING_ATTR : FAILING_ATTR);
-            fwprintf(stderr, L"%s", str);
+            output_printf("%s", str);
+            output_flush();
             SetConsoleTextAttribute(__stderr_handle__, colour);
         }
     } else {
         // No colour.
-        fwprintf(stderr, L"%s", str);
+        output_printf("%s", str);
     }
 }
 #else
 #include <unistd.h>
 
 void tprinterr(const char* str, const bool passing) {
-    if (isatty(fileno(stderr))) {
+    // Check if terminal.
+    static bool set = false;
+    static bool istty = false;
+
+    if (!set) {
+        set = true;
+        istty = isatty(fileno(stderr));
+    }
+
+    if (istty) {
         // Use ASCII escapes.
-        fwprintf(stderr, passing ? PASSING : FAILING, str);
+        output_printf(passing ? PASSING : FAILING, str);
     } else {
         // No colour.
-        fwprintf(stderr, L"%s", str);
+        output_printf("%s", str);
     }
 }
 #endif
@@ -1,14 +1,15 @@
 #include "vbprint.h"
+#include "output.h"
 
 #include <stdarg.h>
 
 #ifdef __VERBOSE__
-static bool __use_verbose_printing = true;
+bool __use_verbose_printing = true;
 #else
-static bool __use_verbose_printing = false;
+bool __use_verbose_printing = false;
 #endif
 
-MessageMeta Message;
+THREAD_LOCAL MessageMeta Message;
 
 void vbprintf(FILE *stream, const char *format, ...) {
     va_list args, argcopy;
@@ -21,7 +22,9 @@ void vbprintf(FILE *stream, const char *format, ...) {
 
     Message.width = NARROW;
 
-    if (__use_verbose_printing) {
+    if (__use_verbose_printing && stream == stderr) {
+        output_vprintf(format, argcopy);
+    } else if (__use_verbose_printing) {
         wchar_t wide_format[MAX_STR_LEN];
         swprintf(wide_format, MAX_STR_LEN, L"%s", format);
         wide_format[MAX_STR_LEN - 1] = L'\0';
@@ -44,7 +47,9 @@ void vbwprintf(FILE *stream, const wchar_t *format, ...) {
 
     Message.width = WIDE;
 
-    if (__use_verbose_printing) {
+    if (__use_verbose_printing && stream == stderr) {
+        output_printf("%ls", Message.__msg.__wessage);
+    } else if (__use_verbose_printing) {
         vfwprintf(stream, format, argcopy);
     }
 
@@ -1,6 +1,8 @@
 #ifndef __VBPRINT_H__
 #define __VBPRINT_H__
 
+#include "threads.h"
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <wchar.h>
@@ -22,7 +24,11 @@ typedef struct {
     } __msg;
 } MessageMeta;
 
-extern MessageMeta Message;
+// Each thread has its own, so that threads can assert at the same time.
+extern THREAD_LOCAL MessageMeta Message;
+
+// Whether verbose printing is on. Read it directly where a function call would be too slow.
+extern bool __use_verbose_printing;
 
 void vbprintf(FILE *stream, const char *format, ...);
 
@@ -0,0 +1,386 @@
+#include "workpool.h"
+#include "output.h"
+#include "whatos.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OS_WINDOWS
+#include <windows.h>
+
+size_t available_cores(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors > 0 ? (size_t) info.dwNumberOfProcessors : 1u;
+}
+
+bool run_job_pool(const size_t n __attribute__((unused)), const size_t workers __attribute__((unused)), const size_t payload_size __attribute__((unused)), const JobFunction run __attribute__((unused)), const JobCollector collect __attribute__((unused)), void *context __attribute__((unused))) {
+    // There is no fork on Windows. Callers run their jobs in-process instead.
+    return false;
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NO_WORKER SIZE_MAX
+
+// How long the parent waits for a message before checking on its workers, in milliseconds.
+#define POLL_INTERVAL 10
+
+// Sent by a worker when it finishes a job. Small enough to always be written to a pipe atomically.
+typedef struct {
+    size_t job;
+    size_t worker;
+    off_t offset;
+    size_t length;
+} JobMessage;
+
+// Where the output of a worker's current job starts, visible to the parent even after the worker dies.
+typedef struct {
+    off_t start;
+} WorkerSlot;
+
+// The worker that claimed each job is kept in owners, which lets the parent find the job a dead worker was on.
+typedef struct {
+    size_t next;
+    size_t *owners;
+    WorkerSlot slots[];
+} SharedState;
+
+typedef struct {
+    bool ready;
+    JobStatus status;
+    char *output;
+    size_t length;
+} JobResult;
+
+typedef struct {
+    size_t n;
+    size_t workers;
+    size_t payload_size;
+    JobFunction run;
+    void *context;
+
+    SharedState *shared;
+    size_t shared_size;
+    uint8_t *payloads;
+    size_t payloads_size;
+
+    int pipe_fds[2];
+    pid_t *pids;
+    FILE **captures;
+    JobResult *results;
+} Pool;
+
+static void write_all(const int fd, const void *data, const size_t length) {
+    size_t written = 0;
+
+    while (written < length) {
+        ssize_t result = write(fd, (const uint8_t *) data + written, length - written);
+
+        // Only retry writes that were interrupted before writing anything.
+        if (result == 0 || (result < 0 && errno != EINTR)) {
+            return;
+        }
+
+        written += result > 0 ? (size_t) result : 0u;
+    }
+}
+
+static char *read_output(FILE *capture, const off_t offset, size_t length, size_t *out_length) {
+    int fd = fileno(capture);
+
+    if (length == SIZE_MAX) {
+        // The worker died mid-job, so read whatever it managed to write.
+        struct stat info;
+        length = fstat(fd, &info) == 0 && info.st_size > offset ? (size_t) (info.st_size - offset) : 0u;
+    }
+
+    char *output = (char *) malloc(length + 1);
+    if (!output) {
+        *out_length = 0;
+        return NULL;
+    }
+
+    size_t got = 0;
+    while (got < length) {
+        ssize_t result = pread(fd, output + got, length - got, offset + (off_t) got);
+
+        // Reading nothing means the capture ended early, so stop there rather than trying again forever.
+        if (result == 0 || (result < 0 && errno != EINTR)) {
+            break;
+        }
+
+        got += result > 0 ? (size_t) result : 0u;
+    }
+
+    output[got] = '\0';
+    *out_length = got;
+
+    return output;
+}
+
+static __attribute__((noreturn)) void worker_main(const Pool *pool, const size_t worker) {
+    WorkerSlot *slot = pool->shared->slots + worker;
+
+    output_discard();
+
+    close(pool->pipe_fds[0]);
+    dup2(fileno(pool->captures[worker]), STDERR_FILENO);
+
+    for (;;) {
+        size_t job = __atomic_load_n(&pool->shared->next, __ATOMIC_SEQ_CST);
+        if (job >= pool->n) {
+            break;
+        }
+
+        JobMessage message = { job, worker, lseek(STDERR_FILENO, 0, SEEK_CUR), 0 };
+        slot->start = message.offset;
+
+        // Claiming a job records who has it in the same step, so that a worker dying at any point never loses one.
+        size_t unowned = NO_WORKER;
+        bool claimed = __atomic_compare_exchange_n(pool->shared->owners + job, &unowned, worker, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+        // Whoever claimed it, next moves past it, unless someone has moved it already.
+        size_t expected = job;
+        __atomic_compare_exchange_n(&pool->shared->next, &expected, job + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+        if (!claimed) {
+            continue;
+        }
+
+        pool->run(job, pool->payloads + (job * pool->payload_size), pool->context);
+
+        output_flush();
+        message.length = (size_t) (lseek(STDERR_FILENO, 0, SEEK_CUR) - message.offset);
+
+        write_all(pool->pipe_fds[1], &message, sizeof(JobMessage));
+    }
+
+    output_flush();
+    fflush(NULL);
+    _exit(0);
+}
+
+static bool spawn_worker(Pool *pool, const size_t worker) {
+    FILE *capture = tmpfile();
+    if (!capture) {
+        return false;
+    }
+
+    pool->captures[worker] = capture;
+    pool->shared->slots[worker].start = 0;
+
+    // Anything still sitting in a stdio or output buffer would otherwise be printed twice.
+    output_flush();
+    fflush(NULL);
+
+    pid_t pid = fork();
+    switch (pid) {
+        case -1:
+            fclose(capture);
+            pool->captures[worker] = NULL;
+            return false;
+        case 0:
+            worker_main(pool, worker);
+            break;
+        default:
+            pool->pids[worker] = pid;
+            break;
+    }
+
+    return true;
+}
+
+static void drain_messages(Pool *pool) {
+    JobMessage message;
+
+    while (read(pool->pipe_fds[0], &message, sizeof(JobMessage)) == (ssize_t) sizeof(JobMessage)) {
+        JobResult *result = pool->results + message.job;
+
+        result->output = read_output(pool->captures[message.worker], message.offset, message.length, &result->length);
+        result->status.state = JOB_FINISHED;
+        result->ready = true;
+    }
+}
+
+static size_t reap_workers(Pool *pool) {
+    size_t alive = 0;
+
+    for (size_t w = 0; w < pool->workers; ++w) {
+        int status;
+
+        if (pool->pids[w] <= 0) {
+            continue;
+        }
+
+        if (waitpid(pool->pids[w], &status, WNOHANG) != pool->pids[w]) {
+            ++alive;
+            continue;
+        }
+
+        pool->pids[w] = -1;
+
+        // Everything the worker sent before dying is already in the pipe.
+        drain_messages(pool);
+
+        // Its jobs that have not finished can only be the one it was on.
+        for (size_t job = 0; job < pool->n; ++job) {
+            JobResult *result = pool->results + job;
+
+            if (!result->ready && __atomic_load_n(pool->shared->owners + job, __ATOMIC_SEQ_CST) == w) {
+                result->output = read_output(pool->captures[w], pool->shared->slots[w].start, SIZE_MAX, &result->length);
+                result->status.state = JOB_CRASHED;
+                result->status.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+                result->status.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 0;
+                result->ready = true;
+            }
+        }
+
+        fclose(pool->captures[w]);
+        pool->captures[w] = NULL;
+
+        // Replace the worker if it left jobs behind.
+        if (__atomic_load_n(&pool->shared->next, __ATOMIC_SEQ_CST) < pool->n && spawn_worker(pool, w)) {
+            ++alive;
+        }
+    }
+
+    return alive;
+}
+
+size_t available_cores(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t) cores : 1u;
+}
+
+bool run_job_pool(const size_t n, const size_t workers, const size_t payload_size, const JobFunction run, const JobCollector collect, void *context) {
+    Pool pool = {
+        .n = n,
+        .workers = workers > 0 ? workers : 1u,
+        .payload_size = payload_size,
+        .run = run,
+        .context = context,
+        .pipe_fds = { -1, -1 }
+    };
+
+    pool.shared_size = sizeof(SharedState) + pool.workers * sizeof(WorkerSlot) + n * sizeof(size_t);
+    pool.payloads_size = n * payload_size > 0 ? n * payload_size : 1u;
+
+    pool.shared = (SharedState *) mmap(NULL, pool.shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pool.payloads = (uint8_t *) mmap(NULL, pool.payloads_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pool.pids = (pid_t *) calloc(pool.workers, sizeof(pid_t));
+    pool.captures = (FILE **) calloc(pool.workers, sizeof(FILE *));
+    pool.results = (JobResult *) calloc(n > 0 ? n : 1u, sizeof(JobResult));
+
+    bool started = pool.shared != MAP_FAILED && pool.payloads != MAP_FAILED && pool.pids && pool.captures && pool.results
+        && pipe(pool.pipe_fds) == 0
+        && fcntl(pool.pipe_fds[0], F_SETFL, fcntl(pool.pipe_fds[0], F_GETFL) | O_NONBLOCK) == 0;
+
+    if (started) {
+        pool.shared->owners = (size_t *) (pool.shared->slots + pool.workers);
+
+        for (size_t job = 0; job < n; ++job) {
+            pool.shared->owners[job] = NO_WORKER;
+        }
+    }
+
+    size_t alive = 0;
+    for (size_t w = 0; started && w < pool.workers; ++w) {
+        if (spawn_worker(&pool, w)) {
+            ++alive;
+        }
+    }
+
+    started = started && alive > 0;
+
+    size_t collected = 0;
+    bool stopped = false;
+
+    while (started && !stopped && collected < n) {
+        struct pollfd fds = { pool.pipe_fds[0], POLLIN, 0 };
+        poll(&fds, 1, POLL_INTERVAL);
+
+        drain_messages(&pool);
+        alive = reap_workers(&pool);
+
+        if (alive == 0) {
+            // Nobody is left to run the remaining jobs, so they are lost.
+            for (size_t i = collected; i < n; ++i) {
+                if (!pool.results[i].ready) {
+                    pool.results[i].ready = true;
+                    pool.results[i].status.state = JOB_LOST;
+                }
+            }
+        }
+
+        while (!stopped && collected < n && pool.results[collected].ready) {
+            JobResult *result = pool.results + collected;
+
+            stopped = !collect(collected, &result->status, pool.payloads + (collected * payload_size), result->output ? result->output : "", result->length, context);
+
+            free(result->output);
+            result->output = NULL;
+            ++collected;
+        }
+    }
+
+    if (stopped) {
+        // Idle workers find no jobs left to take, and workers still on one are killed rather than waited on, since
+        // nobody will collect what they are running.
+        __atomic_store_n(&pool.shared->next, n, __ATOMIC_SEQ_CST);
+
+        for (size_t job = collected; job < n; ++job) {
+            size_t owner = __atomic_load_n(pool.shared->owners + job, __ATOMIC_SEQ_CST);
+
+            if (!pool.results[job].ready && owner != NO_WORKER && pool.pids[owner] > 0) {
+                kill(pool.pids[owner], SIGKILL);
+            }
+        }
+    }
+
+    // Workers exit by themselves once they run out of jobs.
+    for (size_t w = 0; pool.pids && w < pool.workers; ++w) {
+        if (pool.pids[w] > 0) {
+            waitpid(pool.pids[w], NULL, 0);
+        }
+
+        if (pool.captures && pool.captures[w]) {
+            fclose(pool.captures[w]);
+        }
+    }
+
+    if (pool.pipe_fds[0] >= 0) {
+        close(pool.pipe_fds[0]);
+        close(pool.pipe_fds[1]);
+    }
+
+    if (pool.shared != MAP_FAILED) {
+        munmap(pool.shared, pool.shared_size);
+    }
+
+    if (pool.payloads != MAP_FAILED) {
+        munmap(pool.payloads, pool.payloads_size);
+    }
+
+    for (size_t i = collected; pool.results && i < n; ++i) {
+        free(pool.results[i].output);
+    }
+
+    free(pool.pids);
+    free(pool.captures);
+    free(pool.results);
+
+    return started;
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef __WORKPOOL_H__
+#define __WORKPOOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * What happened to a job run by the worker pool.
+ */
+typedef enum {
+    JOB_FINISHED, /**< The job ran to completion inside its worker. */
+    JOB_CRASHED,  /**< The worker running the job died before the job finished. */
+    JOB_LOST      /**< The job was never started, as every worker died and none could be started in their place. */
+} JobState;
+
+/**
+ * The status of a job, as seen by the parent process.
+ */
+typedef struct {
+    JobState state; /**< Did the job finish, did its worker die, or was it never run? */
+    int signal;     /**< Signal that killed the worker, or 0 if it was not killed by a signal. */
+    int exit_code;  /**< Exit code of the worker if it exited without finishing the job. */
+} JobStatus;
+
+// Runs one job inside a worker process, writing its results into the job's shared payload.
+typedef void (*JobFunction)(const size_t job, void *payload, void *context);
+
+// Collects the results of one job in the parent process. Jobs are always collected in order. Returns false to stop the
+// pool, which then starts no more jobs and kills the workers still running one.
+typedef bool (*JobCollector)(const size_t job, const JobStatus *status, void *payload, const char *output, const size_t length, void *context);
+
+// Number of processors currently online.
+size_t available_cores(void);
+
+// Run n jobs across a pool of forked worker processes, capturing everything each job writes to stderr.
+// Returns false if the pool could not be started, in which case no job has been run or collected.
+bool run_job_pool(const size_t n, const size_t workers, const size_t payload_size, const JobFunction run, const JobCollector collect, void *context);
+
+#endif  // __WORKPOOL_H__